@@ -0,0 +1,630 @@
+/*
+ * Carla base64 utils
+ * Copyright (C) 2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the doc/GPL.txt file.
+ */
+
+#ifndef CARLA_BASE64_UTILS_HPP_INCLUDED
+#define CARLA_BASE64_UTILS_HPP_INCLUDED
+
+#include "CarlaUtils.hpp"
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+// AVX2 code is always built on x86-64, and only used if the CPU supports it
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# define CARLA_BASE64_AVX2
+# include <immintrin.h>
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+// base64 tables
+
+static const char kBase64EncodeTable[64+1] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "abcdefghijklmnopqrstuvwxyz"
+    "0123456789+/";
+
+// 0xff for anything that is not a base64 character, including padding
+static const uint8_t kBase64DecodeTable[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// size helpers
+
+/*
+ * Number of characters needed to encode 'size' bytes, including padding.
+ */
+static inline
+std::size_t carla_base64EncodedSize(const std::size_t size) noexcept
+{
+    return (size + 2) / 3 * 4;
+}
+
+/*
+ * Maximum number of bytes that 'length' base64 characters decode into.
+ */
+static inline
+std::size_t carla_base64DecodedMaxSize(const std::size_t length) noexcept
+{
+    return (length + 3) / 4 * 3;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// block encoding and decoding, returning how many input bytes or characters were handled.
+// these only work on full groups of 3 bytes or 4 characters, the rest is up to the caller.
+
+static inline
+std::size_t carla_base64EncodeBlocksScalar(const uint8_t* src, const std::size_t size, char* dst) noexcept
+{
+    const std::size_t blocks(size / 3);
+
+    for (std::size_t i=0; i<blocks; ++i, src += 3, dst += 4)
+    {
+        const uint32_t v((uint32_t(src[0]) << 16) | (uint32_t(src[1]) << 8) | src[2]);
+
+        dst[0] = kBase64EncodeTable[v >> 18];
+        dst[1] = kBase64EncodeTable[(v >> 12) & 0x3f];
+        dst[2] = kBase64EncodeTable[(v >> 6) & 0x3f];
+        dst[3] = kBase64EncodeTable[v & 0x3f];
+    }
+
+    return blocks * 3;
+}
+
+/*
+ * Stops at the first character that is not part of a full 4-character group, like padding or invalid data.
+ */
+static inline
+std::size_t carla_base64DecodeBlocksScalar(const char* src, const std::size_t length, uint8_t* dst) noexcept
+{
+    const uint8_t* const usrc((const uint8_t*)src);
+    std::size_t i = 0;
+
+    for (; i + 4 <= length; i += 4, dst += 3)
+    {
+        const uint32_t a(kBase64DecodeTable[usrc[i]]);
+        const uint32_t b(kBase64DecodeTable[usrc[i+1]]);
+        const uint32_t c(kBase64DecodeTable[usrc[i+2]]);
+        const uint32_t d(kBase64DecodeTable[usrc[i+3]]);
+
+        if ((a | b | c | d) & 0x80)
+            break;
+
+        const uint32_t v((a << 18) | (b << 12) | (c << 6) | d);
+
+        dst[0] = static_cast<uint8_t>(v >> 16);
+        dst[1] = static_cast<uint8_t>(v >> 8);
+        dst[2] = static_cast<uint8_t>(v);
+    }
+
+    return i;
+}
+
+#ifdef __SSE2__
+/*
+ * Turn 16 6-bit values into base64 characters.
+ */
+static inline
+__m128i carla_base64TranslateSSE2(const __m128i indices) noexcept
+{
+    __m128i ret = _mm_add_epi8(indices, _mm_set1_epi8('A'));
+    ret = _mm_add_epi8(ret, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(25)), _mm_set1_epi8(6)));
+    ret = _mm_add_epi8(ret, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(51)), _mm_set1_epi8(-75)));
+    ret = _mm_add_epi8(ret, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(61)), _mm_set1_epi8(-15)));
+    ret = _mm_add_epi8(ret, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(62)), _mm_set1_epi8(3)));
+    return ret;
+}
+
+/*
+ * Turn 16 base64 characters into 6-bit values, 'valid' gets a mask of the characters that were valid.
+ */
+static inline
+__m128i carla_base64UntranslateSSE2(const __m128i chars, __m128i& valid) noexcept
+{
+    const __m128i upper(_mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z'+1), chars)));
+    const __m128i lower(_mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('z'+1), chars)));
+    const __m128i digit(_mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('9'+1), chars)));
+    const __m128i plus (_mm_cmpeq_epi8(chars, _mm_set1_epi8('+')));
+    const __m128i slash(_mm_cmpeq_epi8(chars, _mm_set1_epi8('/')));
+
+    valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+
+    __m128i delta = _mm_and_si128(upper, _mm_set1_epi8(-65));
+    delta = _mm_or_si128(delta, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+    delta = _mm_or_si128(delta, _mm_and_si128(digit, _mm_set1_epi8(4)));
+    delta = _mm_or_si128(delta, _mm_and_si128(plus,  _mm_set1_epi8(19)));
+    delta = _mm_or_si128(delta, _mm_and_si128(slash, _mm_set1_epi8(16)));
+
+    return _mm_add_epi8(chars, delta);
+}
+
+static inline
+std::size_t carla_base64EncodeBlocksSSE2(const uint8_t* src, const std::size_t size, char* dst) noexcept
+{
+    std::size_t i = 0;
+
+    // SSE2 has no byte shuffle, so groups are gathered with scalar loads and split into 6-bit values here
+    for (; i + 12 <= size; i += 12, dst += 16)
+    {
+        const uint8_t* const s(src + i);
+
+        const __m128i words(_mm_setr_epi32(
+            static_cast<int>((uint32_t(s[0]) << 16) | (uint32_t(s[1])  << 8) | s[2]),
+            static_cast<int>((uint32_t(s[3]) << 16) | (uint32_t(s[4])  << 8) | s[5]),
+            static_cast<int>((uint32_t(s[6]) << 16) | (uint32_t(s[7])  << 8) | s[8]),
+            static_cast<int>((uint32_t(s[9]) << 16) | (uint32_t(s[10]) << 8) | s[11])));
+
+        __m128i indices = _mm_srli_epi32(words, 18);
+        indices = _mm_or_si128(indices, _mm_and_si128(_mm_srli_epi32(words, 4),  _mm_set1_epi32(0x00003f00)));
+        indices = _mm_or_si128(indices, _mm_and_si128(_mm_slli_epi32(words, 10), _mm_set1_epi32(0x003f0000)));
+        indices = _mm_or_si128(indices, _mm_and_si128(_mm_slli_epi32(words, 24), _mm_set1_epi32(0x3f000000)));
+
+        _mm_storeu_si128((__m128i*)dst, carla_base64TranslateSSE2(indices));
+    }
+
+    return i;
+}
+
+/*
+ * Writes 14 bytes for every 12 decoded ones, so 'dst' needs 2 extra bytes of room.
+ */
+static inline
+std::size_t carla_base64DecodeBlocksSSE2(const char* src, const std::size_t length, uint8_t* dst) noexcept
+{
+    std::size_t i = 0;
+
+    for (; i + 16 <= length; i += 16, dst += 12)
+    {
+        __m128i valid;
+        const __m128i values(carla_base64UntranslateSSE2(_mm_loadu_si128((const __m128i*)(src + i)), valid));
+
+        if (_mm_movemask_epi8(valid) != 0xffff)
+            break;
+
+        // merge 4 6-bit values into a 24-bit word per 32-bit lane
+        const __m128i pairs(_mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x003f)), 6),
+                                         _mm_srli_epi16(values, 8)));
+        const __m128i words(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0x0000ffff)), 12),
+                                         _mm_srli_epi32(pairs, 16)));
+
+        // swap the first and last byte of each word, then close the gap between the 2 words of each 64-bit half
+        __m128i out = _mm_or_si128(_mm_and_si128(words, _mm_set1_epi32(0x0000ff00)),
+                                   _mm_or_si128(_mm_and_si128(_mm_slli_epi32(words, 16), _mm_set1_epi32(0x00ff0000)),
+                                                _mm_srli_epi32(words, 16)));
+        out = _mm_or_si128(_mm_and_si128(out, _mm_set1_epi64x(0x0000000000ffffffLL)),
+                           _mm_srli_epi64(_mm_and_si128(out, _mm_set1_epi64x(0x00ffffff00000000LL)), 8));
+
+        _mm_storel_epi64((__m128i*)dst, out);
+        _mm_storel_epi64((__m128i*)(dst + 6), _mm_unpackhi_epi64(out, out));
+    }
+
+    return i;
+}
+#endif // __SSE2__
+
+#ifdef CARLA_BASE64_AVX2
+__attribute__((target("avx2")))
+static inline
+std::size_t carla_base64EncodeBlocksAVX2(const uint8_t* src, const std::size_t size, char* dst) noexcept
+{
+    std::size_t i = 0;
+
+    // 24 bytes per loop, but 28 are read so each 128-bit lane gets its 12 bytes in place
+    for (; i + 28 <= size; i += 24, dst += 32)
+    {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + i))),
+                                             _mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+
+        // bytes of each group as [b1 b0 b2 b1], then split into 6-bit values
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+        const __m256i t0(_mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040)));
+        const __m256i t1(_mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010)));
+        const __m256i indices(_mm256_or_si256(t0, t1));
+
+        // ranges of the base64 alphabet, see Muła & Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions"
+        __m256i offsets = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        offsets = _mm256_or_si256(offsets, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+        offsets = _mm256_shuffle_epi8(_mm256_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+                                                       '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0,
+                                                       'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+                                                       '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0), offsets);
+
+        _mm256_storeu_si256((__m256i*)dst, _mm256_add_epi8(indices, offsets));
+    }
+
+    return i;
+}
+
+/*
+ * Writes 32 bytes for every 24 decoded ones, so 'dst' needs 8 extra bytes of room.
+ */
+__attribute__((target("avx2")))
+static inline
+std::size_t carla_base64DecodeBlocksAVX2(const char* src, const std::size_t length, uint8_t* dst) noexcept
+{
+    std::size_t i = 0;
+
+    for (; i + 32 <= length; i += 32, dst += 24)
+    {
+        const __m256i chars(_mm256_loadu_si256((const __m256i*)(src + i)));
+
+        const __m256i upper(_mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('A'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z'+1), chars)));
+        const __m256i lower(_mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('a'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z'+1), chars)));
+        const __m256i digit(_mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1), chars)));
+        const __m256i plus (_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('+')));
+        const __m256i slash(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/')));
+
+        const __m256i valid(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(_mm256_or_si256(digit, plus), slash)));
+
+        if (_mm256_movemask_epi8(valid) != -1)
+            break;
+
+        __m256i delta = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+        delta = _mm256_or_si256(delta, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+        delta = _mm256_or_si256(delta, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+        delta = _mm256_or_si256(delta, _mm256_and_si256(plus,  _mm256_set1_epi8(19)));
+        delta = _mm256_or_si256(delta, _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+
+        const __m256i values(_mm256_add_epi8(chars, delta));
+
+        // merge into 24-bit words, then pack the 3 useful bytes of each word together
+        const __m256i pairs(_mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)));
+        const __m256i words(_mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000)));
+
+        __m256i out = _mm256_shuffle_epi8(words, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                                  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+        _mm256_storeu_si256((__m256i*)dst, out);
+    }
+
+    return i;
+}
+
+static inline
+bool carla_base64UseAVX2() noexcept
+{
+    static const bool ret(__builtin_cpu_supports("avx2"));
+    return ret;
+}
+#endif // CARLA_BASE64_AVX2
+
+/*
+ * Encode as many full 3-byte groups as possible, with the fastest code available.
+ */
+static inline
+std::size_t carla_base64EncodeBlocks(const uint8_t* const src, const std::size_t size, char* const dst) noexcept
+{
+    std::size_t done = 0;
+
+#ifdef CARLA_BASE64_AVX2
+    if (carla_base64UseAVX2())
+        done = carla_base64EncodeBlocksAVX2(src, size, dst);
+#endif
+
+#ifdef __SSE2__
+    done += carla_base64EncodeBlocksSSE2(src + done, size - done, dst + done / 3 * 4);
+#endif
+
+    return done + carla_base64EncodeBlocksScalar(src + done, size - done, dst + done / 3 * 4);
+}
+
+/*
+ * Decode as many full 4-character groups as possible, with the fastest code available.
+ * 'dstSize' is the room available in 'dst', which must be enough for the full groups in 'src'.
+ */
+static inline
+std::size_t carla_base64DecodeBlocks(const char* const src, const std::size_t length,
+                                     uint8_t* const dst, const std::size_t dstSize) noexcept
+{
+    std::size_t done = 0;
+
+    // the SIMD code writes a few bytes past its output, keep that inside 'dst'
+#ifdef CARLA_BASE64_AVX2
+    if (carla_base64UseAVX2() && length >= 32 && dstSize >= 8)
+    {
+        const std::size_t maxLength((dstSize - 8) / 3 * 4);
+        done = carla_base64DecodeBlocksAVX2(src, length < maxLength ? length : maxLength, dst);
+    }
+#endif
+
+#ifdef __SSE2__
+    if (length - done >= 16 && dstSize - done / 4 * 3 >= 2)
+    {
+        const std::size_t maxLength((dstSize - done / 4 * 3 - 2) / 3 * 4);
+        done += carla_base64DecodeBlocksSSE2(src + done, length - done < maxLength ? length - done : maxLength,
+                                             dst + done / 4 * 3);
+    }
+#endif
+
+    return done + carla_base64DecodeBlocksScalar(src + done, length - done, dst + done / 4 * 3);
+
+    // unused without SIMD
+    (void)dstSize;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// streaming encoder
+
+/*
+ * Base64 encoder that takes data in any number of chunks.
+ * Output is written straight into caller-provided memory.
+ */
+struct CarlaBase64Encoder {
+    uint8_t pending[2];
+    uint    pendingSize;
+
+    CarlaBase64Encoder() noexcept
+        : pending(),
+          pendingSize(0) {}
+
+    /*
+     * Maximum number of characters encode() writes for 'size' bytes.
+     */
+    static std::size_t getMaxOutputSize(const std::size_t size) noexcept
+    {
+        return (size + 2) / 3 * 4;
+    }
+
+    /*
+     * Encode a chunk of data, returning the number of characters written to 'out'.
+     * Up to 2 bytes are kept back until more data or finish().
+     */
+    std::size_t encode(const void* const data, std::size_t size, char* out) noexcept
+    {
+        const uint8_t* bytes((const uint8_t*)data);
+        char* const outStart(out);
+
+        if (pendingSize != 0)
+        {
+            uint8_t group[3] = { pending[0], pending[1], 0 };
+
+            for (; pendingSize < 3 && size != 0; --size)
+                group[pendingSize++] = *bytes++;
+
+            if (pendingSize < 3)
+            {
+                pending[0] = group[0];
+                pending[1] = group[1];
+                return 0;
+            }
+
+            out += carla_base64EncodeBlocksScalar(group, 3, out) / 3 * 4;
+            pendingSize = 0;
+        }
+
+        const std::size_t done(carla_base64EncodeBlocks(bytes, size, out));
+        out += done / 3 * 4;
+
+        for (std::size_t i=done; i<size; ++i)
+            pending[pendingSize++] = bytes[i];
+
+        return static_cast<std::size_t>(out - outStart);
+    }
+
+    /*
+     * Write the last group with padding, up to 4 characters, and reset for new data.
+     */
+    std::size_t finish(char* const out) noexcept
+    {
+        if (pendingSize == 0)
+            return 0;
+
+        const uint32_t v((uint32_t(pending[0]) << 16) | (pendingSize == 2 ? uint32_t(pending[1]) << 8 : 0));
+
+        out[0] = kBase64EncodeTable[v >> 18];
+        out[1] = kBase64EncodeTable[(v >> 12) & 0x3f];
+        out[2] = pendingSize == 2 ? kBase64EncodeTable[(v >> 6) & 0x3f] : '=';
+        out[3] = '=';
+
+        pendingSize = 0;
+        return 4;
+    }
+
+    CARLA_DECLARE_NON_COPY_STRUCT(CarlaBase64Encoder)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// streaming decoder
+
+/*
+ * Base64 decoder that takes text in any number of chunks.
+ * Output is written straight into caller-provided memory, such as an LV2_Atom buffer.
+ * Padding is optional, anything else that is not base64 makes decoding fail.
+ */
+struct CarlaBase64Decoder {
+    uint32_t bits;
+    uint     bitsCount;  // characters in 'bits', 0 to 3
+    uint     padding;    // padding characters seen so far
+    bool     failed;
+
+    CarlaBase64Decoder() noexcept
+        : bits(0),
+          bitsCount(0),
+          padding(0),
+          failed(false) {}
+
+    /*
+     * Decode a chunk of text into 'out', which has 'outSize' bytes of room.
+     * 'written' gets the number of bytes written.
+     * Returns false on invalid input or if 'out' is too small.
+     */
+    bool decode(const char* text, std::size_t length, void* const out, const std::size_t outSize, std::size_t& written) noexcept
+    {
+        uint8_t* dst((uint8_t*)out);
+        uint8_t* const dstEnd(dst + outSize);
+
+        written = 0;
+
+        for (; length != 0 && ! failed;)
+        {
+            if (bitsCount == 0 && padding == 0)
+            {
+                std::size_t blocksLength(length / 4 * 4);
+
+                if (blocksLength / 4 * 3 > static_cast<std::size_t>(dstEnd - dst))
+                    blocksLength = static_cast<std::size_t>(dstEnd - dst) / 3 * 4;
+
+                const std::size_t done(carla_base64DecodeBlocks(text, blocksLength, dst, static_cast<std::size_t>(dstEnd - dst)));
+
+                text   += done;
+                length -= done;
+                dst    += done / 4 * 3;
+
+                if (length == 0)
+                    break;
+            }
+
+            const char c(*text++);
+            --length;
+
+            if (c == '=')
+            {
+                // "xx==" or "xxx=", bytes are written once the group ends
+                if (bitsCount < 2 || bitsCount + padding >= 4)
+                    failed = true;
+                else if (++padding + bitsCount == 4)
+                    failed = ! flush(dst, dstEnd);
+                continue;
+            }
+
+            const uint8_t value(kBase64DecodeTable[static_cast<uint8_t>(c)]);
+
+            if (value == 0xff || padding != 0)
+            {
+                failed = true;
+                break;
+            }
+
+            bits = (bits << 6) | value;
+
+            if (++bitsCount == 4)
+                failed = ! flush(dst, dstEnd);
+        }
+
+        written = static_cast<std::size_t>(dst - (uint8_t*)out);
+        return ! failed;
+    }
+
+    /*
+     * Write the last, unpadded group if any, and reset for new text.
+     * Returns false if the text was invalid or did not end on a valid group.
+     */
+    bool finish(void* const out, const std::size_t outSize, std::size_t& written) noexcept
+    {
+        uint8_t* dst((uint8_t*)out);
+
+        written = 0;
+
+        if (! failed && bitsCount != 0 && padding == 0)
+        {
+            if (bitsCount == 1)
+                failed = true;
+            else
+                failed = ! flush(dst, dst + outSize);
+        }
+
+        written = static_cast<std::size_t>(dst - (uint8_t*)out);
+
+        const bool ok(! failed && bitsCount == 0);
+
+        bits = bitsCount = padding = 0;
+        failed = false;
+        return ok;
+    }
+
+private:
+    /*
+     * Write the bytes of the current group, which has 2 to 4 characters.
+     */
+    bool flush(uint8_t*& dst, uint8_t* const dstEnd) noexcept
+    {
+        const uint count(bitsCount - 1);
+
+        if (static_cast<std::size_t>(dstEnd - dst) < count)
+            return false;
+
+        const uint32_t v(bits << (6 * (4 - bitsCount)));
+
+        dst[0] = static_cast<uint8_t>(v >> 16);
+        if (count > 1) dst[1] = static_cast<uint8_t>(v >> 8);
+        if (count > 2) dst[2] = static_cast<uint8_t>(v);
+
+        dst += count;
+        bits = bitsCount = 0;
+        return true;
+    }
+
+    CARLA_DECLARE_NON_COPY_STRUCT(CarlaBase64Decoder)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// one-shot helpers
+
+/*
+ * Encode 'size' bytes into 'out', which needs carla_base64EncodedSize(size) characters of room.
+ * No null terminator is written. Returns the number of characters written.
+ */
+static inline
+std::size_t carla_base64Encode(const void* const data, const std::size_t size, char* const out) noexcept
+{
+    CarlaBase64Encoder encoder;
+    const std::size_t written(encoder.encode(data, size, out));
+    return written + encoder.finish(out + written);
+}
+
+/*
+ * Decode 'length' characters into 'out', which has 'outSize' bytes of room.
+ * Returns false on invalid input or if 'out' is too small, 'size' gets the decoded size.
+ */
+static inline
+bool carla_base64Decode(const char* const text, const std::size_t length,
+                        void* const out, const std::size_t outSize, std::size_t& size) noexcept
+{
+    CarlaBase64Decoder decoder;
+    std::size_t written, lastWritten;
+
+    if (! decoder.decode(text, length, out, outSize, written))
+        return false;
+    if (! decoder.finish((uint8_t*)out + written, outSize - written, lastWritten))
+        return false;
+
+    size = written + lastWritten;
+    return true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // CARLA_BASE64_UTILS_HPP_INCLUDED
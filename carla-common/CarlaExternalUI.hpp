@@ -37,7 +37,10 @@ public:
         : fFilename(),
           fArg1(),
           fArg2(),
-          fUiState(UiNone) {}
+          fUiState(UiNone)
+    {
+        setMsgHandler(kPipeMsgExiting, &CarlaExternalUI::msgExiting);
+    }
 
     ~CarlaExternalUI() /*noexcept*/ override
     {
@@ -77,18 +80,28 @@ public:
         return false;
     }
 
+    bool startPipeServerAsync() noexcept
+    {
+        return CarlaPipeServer::startPipeServerAsync(fFilename, fArg1, fArg2);
+    }
+
 protected:
-    // returns true if msg was handled
-    bool msgReceived(const char* const msg) noexcept override
+    // report a crash if the client went away without sending "exiting", call after reading what is left in the pipe
+    void setUiCrashedIfRunning() noexcept
     {
-        if (std::strcmp(msg, "exiting") == 0)
-        {
-            closePipeServer();
-            fUiState = UiHide;
-            return true;
-        }
+        if (! isPipeRunning())
+            return;
 
-        return false;
+        closePipeServer();
+        fUiState = UiCrashed;
+    }
+
+    // handler for "exiting", the client closed its UI
+    bool msgExiting() noexcept
+    {
+        closePipeServer();
+        fUiState = UiHide;
+        return true;
     }
 
 private:
@@ -75,12 +75,12 @@ class LeakedObjectDetector
 {
 public:
     //=================================================================================================================
-    LeakedObjectDetector() noexcept                            { ++(getCounter().numObjects); }
-    LeakedObjectDetector(const LeakedObjectDetector&) noexcept { ++(getCounter().numObjects); }
+    LeakedObjectDetector() noexcept                            { __atomic_add_fetch(&getCounter().numObjects, 1, __ATOMIC_RELAXED); }
+    LeakedObjectDetector(const LeakedObjectDetector&) noexcept { __atomic_add_fetch(&getCounter().numObjects, 1, __ATOMIC_RELAXED); }
 
     ~LeakedObjectDetector() noexcept
     {
-        if (--(getCounter().numObjects) < 0)
+        if (__atomic_sub_fetch(&getCounter().numObjects, 1, __ATOMIC_RELAXED) < 0)
         {
             /** If you hit this, then you've managed to delete more instances of this class than you've
                 created.. That indicates that you're deleting some dangling pointers.
@@ -122,8 +122,8 @@ private:
             }
         }
 
-        // this should be an atomic...
-        volatile int numObjects;
+        // only accessed through __atomic builtins, objects may be created and deleted from any thread
+        int numObjects;
     };
 
     static const char* getLeakedObjectClassName() noexcept
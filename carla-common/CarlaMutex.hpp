@@ -64,9 +64,7 @@ public:
      */
     bool wasTryLockCalled() const noexcept
     {
-        const bool ret(fTryLockWasCalled);
-        fTryLockWasCalled = false;
-        return ret;
+        return __atomic_exchange_n(&fTryLockWasCalled, false, __ATOMIC_RELAXED);
     }
 
     /*
@@ -92,7 +90,7 @@ public:
      */
     bool tryLock() const noexcept
     {
-        fTryLockWasCalled = true;
+        __atomic_store_n(&fTryLockWasCalled, true, __ATOMIC_RELAXED);
 
 #if 0 //def CARLA_OS_WIN
         if (TryEnterCriticalSection(&fSection) == FALSE)
@@ -117,7 +115,7 @@ public:
     void unlock(const bool resetTryLock = false) const noexcept
     {
         if (resetTryLock)
-            fTryLockWasCalled = false;
+            __atomic_store_n(&fTryLockWasCalled, false, __ATOMIC_RELAXED);
 
 #if 0 //def CARLA_OS_WIN
         fAlreadyLocked = false;
@@ -134,7 +132,7 @@ private:
 #else
     mutable pthread_mutex_t fMutex;
 #endif
-    mutable volatile bool fTryLockWasCalled; // true if "tryLock()" was called at least once
+    mutable bool fTryLockWasCalled; // true if "tryLock()" was called at least once, accessed atomically
 
     CARLA_PREVENT_HEAP_ALLOCATION
     CARLA_DECLARE_NON_COPY_CLASS(CarlaMutex)
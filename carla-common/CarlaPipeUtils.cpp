@@ -17,6 +17,8 @@
 
 #include "CarlaPipeUtils.hpp"
 #include "CarlaString.hpp"
+#include "CarlaThread.hpp"
+#include "CarlaTraceUtils.hpp"
 #include "CarlaMIDI.h"
 
 // needed for atom-util
@@ -31,17 +33,32 @@
 # include "lv2/lv2plug.in/ns/ext/atom/util.h"
 #endif
 
+#include <cfloat>
 #include <clocale>
+#include <cmath>
 
 #if defined(CARLA_OS_MAC) || defined(CARLA_OS_WINDOWS)
 # include "juce_core.h"
 #else
 # include <cerrno>
 # include <fcntl.h>
+# include <poll.h>
 # include <signal.h>
+# include <sys/mman.h>
+# include <sys/socket.h>
 # include <sys/wait.h>
 #endif
 
+#ifdef CARLA_OS_LINUX
+# include <linux/futex.h>
+# include <sys/eventfd.h>
+# include <sys/stat.h>
+# include <sys/syscall.h>
+# ifndef MFD_CLOEXEC
+#  define MFD_CLOEXEC 0x0001U
+# endif
+#endif
+
 #ifdef CARLA_OS_WIN
 # define INVALID_PIPE_VALUE INVALID_HANDLE_VALUE
 #else
@@ -91,7 +108,12 @@ ssize_t ReadFileNonBlock(const HANDLE pipeh, const HANDLE cancelh, void* const b
     OverlappedEvent over;
 
     if (::ReadFile(pipeh, buf, numBytes, nullptr /*&dsize*/, &over.over) != FALSE)
-        return static_cast<ssize_t>(dsize);
+    {
+        // reads can be partial now that we request more than 1 byte at a time
+        if (::GetOverlappedResult(pipeh, &over.over, &dsize, FALSE) != FALSE)
+            return static_cast<ssize_t>(dsize);
+        return -1;
+    }
 
     if (::GetLastError() == ERROR_IO_PENDING)
     {
@@ -103,7 +125,7 @@ ssize_t ReadFileNonBlock(const HANDLE pipeh, const HANDLE cancelh, void* const b
             return -1;
         }
 
-        if (::GetOverlappedResult(pipeh, &over.over, nullptr /*&dsize*/, FALSE) != FALSE)
+        if (::GetOverlappedResult(pipeh, &over.over, &dsize, FALSE) != FALSE)
             return static_cast<ssize_t>(dsize);
     }
 
@@ -169,23 +191,435 @@ uint32_t getMillisecondCounter() noexcept
     clock_gettime(CLOCK_MONOTONIC, &t);
     now =  t.tv_sec * 1000 + t.tv_nsec / 1000000;
 
-    if (now < lastMSCounterValue)
+    const uint32_t last(__atomic_load_n(&lastMSCounterValue, __ATOMIC_RELAXED));
+
+    if (now < last)
     {
         // in multi-threaded apps this might be called concurrently, so
         // make sure that our last counter value only increases and doesn't
         // go backwards..
-        if (now < lastMSCounterValue - 1000)
-            lastMSCounterValue = now;
+        if (now < last - 1000)
+            __atomic_store_n(&lastMSCounterValue, now, __ATOMIC_RELAXED);
     }
     else
     {
-        lastMSCounterValue = now;
+        __atomic_store_n(&lastMSCounterValue, now, __ATOMIC_RELAXED);
     }
 
     return now;
 #endif
 }
 
+// -----------------------------------------------------------------------
+// getMicrosecondCounter
+
+static inline
+uint64_t getMicrosecondCounter() noexcept
+{
+#if defined(CARLA_OS_MAC) || defined(CARLA_OS_WINDOWS)
+    return static_cast<uint64_t>(juce::Time::getMillisecondCounterHiRes() * 1000.0);
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return static_cast<uint64_t>(t.tv_sec) * 1000000 + static_cast<uint64_t>(t.tv_nsec) / 1000;
+#endif
+}
+
+// -----------------------------------------------------------------------
+// number formatting and parsing, independent of the current locale
+
+static const double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const uint64_t kPow10Int[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+/*
+ * Multiply or divide 'value' by a power of 10.
+ * Exact (single rounding) for exponents up to 22, which covers the parsing fast path.
+ */
+static inline
+double scaleByPow10(double value, int exponent) noexcept
+{
+    if (exponent >= 0)
+    {
+        for (; exponent > 22; exponent -= 22)
+            value *= kPow10[22];
+        return value * kPow10[exponent];
+    }
+
+    for (; exponent < -22; exponent += 22)
+        value /= kPow10[22];
+    return value / kPow10[-exponent];
+}
+
+/*
+ * Write an unsigned integer as decimal text.
+ * Returns a pointer to the terminating null character.
+ */
+static inline
+char* uintToChars(char* buf, uint64_t value) noexcept
+{
+    char tmp[20];
+    std::size_t count = 0;
+
+    do {
+        tmp[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    for (; count != 0;)
+        *buf++ = tmp[--count];
+
+    *buf = '\0';
+    return buf;
+}
+
+/*
+ * Write a signed integer as decimal text.
+ * Returns a pointer to the terminating null character.
+ */
+static inline
+char* intToChars(char* buf, const int64_t value) noexcept
+{
+    if (value >= 0)
+        return uintToChars(buf, static_cast<uint64_t>(value));
+
+    *buf++ = '-';
+    return uintToChars(buf, static_cast<uint64_t>(-(value + 1)) + 1);
+}
+
+/*
+ * Write the shortest decimal text that reads back as the same float.
+ * Uses plain notation for common magnitudes and exponent notation otherwise, never more than 16 characters.
+ * Returns a pointer to the terminating null character.
+ */
+static inline
+char* floatToChars(char* buf, const float value) noexcept
+{
+    if (value != value)
+    {
+        std::memcpy(buf, "nan", 4);
+        return buf + 3;
+    }
+
+    float absValue(value);
+
+    if (value < 0.0f)
+    {
+        *buf++ = '-';
+        absValue = -value;
+    }
+
+    if (absValue > FLT_MAX)
+    {
+        std::memcpy(buf, "inf", 4);
+        return buf + 3;
+    }
+
+    if (absValue == 0.0f)
+    {
+        std::memcpy(buf, "0", 2);
+        return buf + 1;
+    }
+
+    // find the fewest significant digits that round-trip, 9 is always enough for a float
+    const double v(absValue);
+    int exp10(static_cast<int>(std::floor(std::log10(v))));
+    int numDigits;
+    uint64_t digits = 0;
+
+    for (numDigits = 1; numDigits <= 9; ++numDigits)
+    {
+        digits = static_cast<uint64_t>(scaleByPow10(v, numDigits - 1 - exp10) + 0.5);
+
+        // log10 can be off by one near powers of 10, and rounding can carry into an extra digit
+        if (digits >= kPow10Int[numDigits])
+        {
+            ++exp10;
+            digits = static_cast<uint64_t>(scaleByPow10(v, numDigits - 1 - exp10) + 0.5);
+        }
+        else if (digits < kPow10Int[numDigits - 1])
+        {
+            --exp10;
+            digits = static_cast<uint64_t>(scaleByPow10(v, numDigits - 1 - exp10) + 0.5);
+        }
+
+        if (static_cast<float>(scaleByPow10(static_cast<double>(digits), exp10 - numDigits + 1)) == absValue)
+            break;
+    }
+
+    if (numDigits > 9)
+        numDigits = 9;
+
+    for (; numDigits > 1 && digits % 10 == 0; --numDigits)
+        digits /= 10;
+
+    char digitChars[9];
+
+    for (int i = numDigits; --i >= 0;)
+    {
+        digitChars[i] = static_cast<char>('0' + digits % 10);
+        digits /= 10;
+    }
+
+    if (exp10 < -5 || exp10 > 8)
+    {
+        *buf++ = digitChars[0];
+
+        if (numDigits > 1)
+        {
+            *buf++ = '.';
+            for (int i = 1; i < numDigits; ++i)
+                *buf++ = digitChars[i];
+        }
+
+        *buf++ = 'e';
+        return intToChars(buf, exp10);
+    }
+
+    if (exp10 < 0)
+    {
+        *buf++ = '0';
+        *buf++ = '.';
+        for (int i = -1; i > exp10; --i)
+            *buf++ = '0';
+        for (int i = 0; i < numDigits; ++i)
+            *buf++ = digitChars[i];
+    }
+    else
+    {
+        for (int i = 0; i <= exp10; ++i)
+            *buf++ = (i < numDigits) ? digitChars[i] : '0';
+
+        if (numDigits > exp10 + 1)
+        {
+            *buf++ = '.';
+            for (int i = exp10 + 1; i < numDigits; ++i)
+                *buf++ = digitChars[i];
+        }
+    }
+
+    *buf = '\0';
+    return buf;
+}
+
+/*
+ * Parse an unsigned decimal integer, the whole string must be a valid number.
+ */
+static inline
+bool charsToUInt(const char* str, uint64_t& value) noexcept
+{
+    if (*str < '0' || *str > '9')
+        return false;
+
+    uint64_t ret = 0;
+
+    for (; *str >= '0' && *str <= '9'; ++str)
+    {
+        const uint64_t digit(static_cast<uint64_t>(*str - '0'));
+
+        if (ret > (UINT64_MAX - digit) / 10)
+            return false;
+
+        ret = ret * 10 + digit;
+    }
+
+    if (*str != '\0')
+        return false;
+
+    value = ret;
+    return true;
+}
+
+/*
+ * Parse a signed decimal integer, the whole string must be a valid number.
+ */
+static inline
+bool charsToInt(const char* str, int64_t& value) noexcept
+{
+    const bool negative(*str == '-');
+
+    if (negative || *str == '+')
+        ++str;
+
+    uint64_t uvalue;
+
+    if (! charsToUInt(str, uvalue))
+        return false;
+
+    if (negative)
+    {
+        if (uvalue > static_cast<uint64_t>(INT64_MAX) + 1)
+            return false;
+        value = (uvalue == 0) ? 0 : -static_cast<int64_t>(uvalue - 1) - 1;
+    }
+    else
+    {
+        if (uvalue > static_cast<uint64_t>(INT64_MAX))
+            return false;
+        value = static_cast<int64_t>(uvalue);
+    }
+
+    return true;
+}
+
+/*
+ * Parse a floating point number using strtod, for anything the fast path does not handle.
+ * strtod expects the decimal point of the current locale, so the '.' is swapped in a copy if needed.
+ */
+static inline
+bool charsToDoubleSlow(const char* const str, double& value) noexcept
+{
+    const char* const decimalPoint(std::localeconv()->decimal_point);
+    const char* parseStr(str);
+    char tmpBuf[0xff+1];
+
+    if (decimalPoint != nullptr && decimalPoint[0] != '.' && decimalPoint[0] != '\0' && decimalPoint[1] == '\0')
+    {
+        if (const char* const dot = std::strchr(str, '.'))
+        {
+            const std::size_t size(std::strlen(str));
+            CARLA_SAFE_ASSERT_RETURN(size <= 0xff, false);
+
+            std::memcpy(tmpBuf, str, size+1);
+            tmpBuf[dot - str] = decimalPoint[0];
+            parseStr = tmpBuf;
+        }
+    }
+
+    char* end;
+    const double ret(std::strtod(parseStr, &end));
+
+    if (end == parseStr || *end != '\0')
+        return false;
+
+    value = ret;
+    return true;
+}
+
+/*
+ * Parse a floating point number, the whole string must be a valid number.
+ * Numbers with up to 15 significant digits and small exponents are converted exactly without strtod.
+ */
+static inline
+bool charsToDouble(const char* const str, double& value) noexcept
+{
+    const char* s(str);
+    const bool negative(*s == '-');
+
+    if (negative || *s == '+')
+        ++s;
+
+    uint64_t mantissa = 0;
+    int numDigits = 0, sigDigits = 0, exponent = 0;
+    bool inFraction = false;
+
+    for (;; ++s)
+    {
+        if (*s == '.' && ! inFraction)
+        {
+            inFraction = true;
+            continue;
+        }
+
+        if (*s < '0' || *s > '9')
+            break;
+
+        ++numDigits;
+
+        // too many digits for the fast path, let strtod deal with it
+        if (sigDigits == 15)
+            return charsToDoubleSlow(str, value);
+
+        if (mantissa != 0 || *s != '0')
+        {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+            ++sigDigits;
+        }
+
+        if (inFraction)
+            --exponent;
+    }
+
+    if (numDigits == 0)
+        return charsToDoubleSlow(str, value);
+
+    if (*s == 'e' || *s == 'E')
+    {
+        ++s;
+
+        const bool expNegative(*s == '-');
+
+        if (expNegative || *s == '+')
+            ++s;
+
+        if (*s < '0' || *s > '9')
+            return false;
+
+        int exp = 0;
+
+        for (; *s >= '0' && *s <= '9'; ++s)
+        {
+            if (exp < 10000)
+                exp = exp * 10 + (*s - '0');
+        }
+
+        exponent += expNegative ? -exp : exp;
+    }
+
+    if (*s != '\0')
+        return false;
+
+    // mantissa and power of 10 are both exact doubles, so a single operation rounds correctly
+    if (exponent < -22 || exponent > 22)
+        return charsToDoubleSlow(str, value);
+
+    const double ret(scaleByPow10(static_cast<double>(mantissa), exponent));
+    value = negative ? -ret : ret;
+    return true;
+}
+
+/*
+ * Fixed-size buffer for the lines of a prepared message.
+ */
+struct PipeMessageBuilder {
+    char  buf[0xff+1];
+    char* end;
+
+    PipeMessageBuilder() noexcept
+        : end(buf) {}
+
+    void addLine(const char* const line, const std::size_t size) noexcept
+    {
+        std::memcpy(end, line, size);
+        end += size;
+        *end++ = '\n';
+    }
+
+    void addUIntLine(const uint64_t value) noexcept
+    {
+        end = uintToChars(end, value);
+        *end++ = '\n';
+    }
+
+    void addFloatLine(const float value) noexcept
+    {
+        end = floatToChars(end, value);
+        *end++ = '\n';
+    }
+
+    std::size_t size() const noexcept
+    {
+        return static_cast<std::size_t>(end - buf);
+    }
+
+    CARLA_DECLARE_NON_COPY_STRUCT(PipeMessageBuilder)
+};
+
 // -----------------------------------------------------------------------
 // startProcess
 
@@ -228,14 +662,22 @@ bool startProcess(const char* const argv[], PROCESS_INFORMATION* const processIn
                           nullptr, nullptr, TRUE, 0x0, nullptr, nullptr, &startupInfo, processInfo) != FALSE;
 }
 #else
+/*
+ * 'inheritFds' are created close-on-exec, the child clears that flag just before exec so only it gets them.
+ */
 static inline
-bool startProcess(const char* const argv[], pid_t& pidinst) noexcept
+bool startProcess(const char* const argv[], pid_t& pidinst,
+                  const int* const inheritFds = nullptr, const uint32_t inheritFdCount = 0) noexcept
 {
     const pid_t ret = pidinst = vfork();
 
     switch (ret)
     {
     case 0: { // child process
+        // the child has its own fd table, this does not change the parent's flags
+        for (uint32_t i=0; i < inheritFdCount; ++i)
+            ::fcntl(inheritFds[i], F_SETFD, 0);
+
         execvp(argv[0], const_cast<char* const*>(argv));
 
         CarlaString error(std::strerror(errno));
@@ -255,80 +697,186 @@ bool startProcess(const char* const argv[], pid_t& pidinst) noexcept
 #endif
 
 // -----------------------------------------------------------------------
-// waitForClientFirstMessage
+// waitForPipeData
 
-template<typename P>
+#ifndef CARLA_OS_WIN
+/*
+ * Sleep until the pipe has data to read or the timeout is reached.
+ * Returns false if the other side closed its end and there is nothing left to read.
+ */
 static inline
-bool waitForClientFirstMessage(const P& pipe, const uint32_t timeOutMilliseconds) noexcept
+bool waitForPipeData(const int pipe, const uint32_t timeOutMilliseconds) noexcept
 {
-#ifdef CARLA_OS_WIN
-    CARLA_SAFE_ASSERT_RETURN(pipe.handle != INVALID_HANDLE_VALUE, false);
-    CARLA_SAFE_ASSERT_RETURN(pipe.cancel != INVALID_HANDLE_VALUE, false);
-#else
-    CARLA_SAFE_ASSERT_RETURN(pipe > 0, false);
-#endif
-    CARLA_SAFE_ASSERT_RETURN(timeOutMilliseconds > 0, false);
+    struct pollfd pfd;
+    pfd.fd      = pipe;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
 
-    char c;
-    ssize_t ret;
-    const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);
+    int ret;
 
-    for (;;)
-    {
-        try {
-#ifdef CARLA_OS_WIN
-            //ret = ::ReadFileBlock(pipe.handle, &c, 1);
-            ret = ::ReadFileNonBlock(pipe.handle, pipe.cancel, &c, 1);
-#else
-            ret = ::read(pipe, &c, 1);
-#endif
-        } CARLA_SAFE_EXCEPTION_BREAK("read pipefd");
+    try {
+        ret = ::poll(&pfd, 1, static_cast<int>(timeOutMilliseconds));
+    } CARLA_SAFE_EXCEPTION_RETURN("poll", true);
 
-        switch (ret)
-        {
-        case -1: // failed to read
-#ifndef CARLA_OS_WIN
-            if (errno == EAGAIN)
-#endif
-            {
-                if (getMillisecondCounter() < timeoutEnd)
-                {
-                    carla_msleep(5);
-                    continue;
-                }
-                carla_stderr("waitForClientFirstMessage() - timed out");
-            }
-#ifndef CARLA_OS_WIN
-            else
-            {
-                carla_stderr("waitForClientFirstMessage() - read failed");
-                CarlaString error(std::strerror(errno));
-                carla_stderr("waitForClientFirstMessage() - read failed: %s", error.buffer());
-            }
-#endif
-            break;
+    // timed out or interrupted, caller checks again
+    if (ret <= 0)
+        return true;
+
+    return (pfd.revents & POLLIN) != 0 || (pfd.revents & (POLLHUP|POLLERR|POLLNVAL)) == 0;
+}
+
+/*
+ * Check if the other side closed its end of a pipe we write to.
+ */
+static inline
+bool isPipeBroken(const int pipe) noexcept
+{
+    struct pollfd pfd;
+    pfd.fd      = pipe;
+    pfd.events  = 0;
+    pfd.revents = 0;
+
+    try {
+        if (::poll(&pfd, 1, 0) <= 0)
+            return false;
+    } CARLA_SAFE_EXCEPTION_RETURN("poll", false);
+
+    return (pfd.revents & (POLLHUP|POLLERR|POLLNVAL)) != 0;
+}
+#endif
+
+// -----------------------------------------------------------------------
+// readClientFirstMessage
+
+// the client's first line is empty for the default text protocol and pipes, or a space separated list of these keywords
+static const char* const kPipeBinaryHandshake       = "binary";
+static const char* const kPipeSharedMemoryHandshake = "shm";
+
+enum PipeFeatures {
+    kPipeFeatureBinary       = 0x1, // binary protocol requested, server replies with the protocol to use
+    kPipeFeatureSharedMemory = 0x2  // client attached to the shared memory, message data goes through it after the handshake
+};
+
+// how long a server waits for the client's first line
+static const uint32_t kPipeHandshakeTimeout = 10*1000;
+
+/*
+ * The client's first line as read so far, kept between calls so the server does not need to block on it.
+ */
+struct PipeHandshake {
+    char line[0xf+1];
+    std::size_t lineSize;
+    uint32_t timeoutEnd;
+
+    void reset(const uint32_t timeOutMilliseconds) noexcept
+    {
+        lineSize   = 0;
+        timeoutEnd = getMillisecondCounter() + timeOutMilliseconds;
+    }
+};
+
+enum PipeHandshakeStatus {
+    kPipeHandshakeFailed,
+    kPipeHandshakePending,
+    kPipeHandshakeDone
+};
+
+/*
+ * Read what is available of the client's first line, without blocking.
+ * Returns kPipeHandshakePending if the line is not complete yet and the timeout was not reached.
+ */
+template<typename P>
+static inline
+PipeHandshakeStatus readClientFirstMessage(const P& pipe, PipeHandshake& handshake, uint& features) noexcept
+{
+#ifdef CARLA_OS_WIN
+    CARLA_SAFE_ASSERT_RETURN(pipe.handle != INVALID_HANDLE_VALUE, kPipeHandshakeFailed);
+    CARLA_SAFE_ASSERT_RETURN(pipe.cancel != INVALID_HANDLE_VALUE, kPipeHandshakeFailed);
+#else
+    CARLA_SAFE_ASSERT_RETURN(pipe > 0, kPipeHandshakeFailed);
+#endif
+
+    char c;
+    ssize_t ret;
+
+    // read one byte at a time so we never consume anything past the first line
+    for (;;)
+    {
+        try {
+#ifdef CARLA_OS_WIN
+            ret = ::ReadFileNonBlock(pipe.handle, pipe.cancel, &c, 1);
+#else
+            ret = ::read(pipe, &c, 1);
+#endif
+        } CARLA_SAFE_EXCEPTION_BREAK("read pipefd");
+
+        switch (ret)
+        {
+        case -1: // failed to read
+#ifndef CARLA_OS_WIN
+            if (errno == EAGAIN)
+#endif
+            {
+                if (getMillisecondCounter() < handshake.timeoutEnd)
+                    return kPipeHandshakePending;
+
+                carla_stderr("readClientFirstMessage() - timed out");
+            }
+#ifndef CARLA_OS_WIN
+            else
+            {
+                CarlaString error(std::strerror(errno));
+                carla_stderr("readClientFirstMessage() - read failed: %s", error.buffer());
+            }
+#endif
+            break;
 
         case 1: // read ok
             if (c == '\n')
             {
+                handshake.line[handshake.lineSize] = '\0';
+                features = 0x0;
+
+                for (char* word = handshake.line; word != nullptr;)
+                {
+                    char* const space(std::strchr(word, ' '));
+
+                    if (space != nullptr)
+                        *space = '\0';
+
+                    if (std::strcmp(word, kPipeBinaryHandshake) == 0)
+                        features |= kPipeFeatureBinary;
+                    else if (std::strcmp(word, kPipeSharedMemoryHandshake) == 0)
+                        features |= kPipeFeatureSharedMemory;
+                    else if (word[0] != '\0')
+                        carla_stderr("readClientFirstMessage() - ignoring unknown feature '%s'", word);
+
+                    word = (space != nullptr) ? space + 1 : nullptr;
+                }
+
                 // success
-                return true;
+                return kPipeHandshakeDone;
+            }
+            else if (handshake.lineSize < 0xf)
+            {
+                handshake.line[handshake.lineSize++] = c;
+                continue;
             }
             else
             {
-                carla_stderr("waitForClientFirstMessage() - read has wrong first char '%c'", c);
+                carla_stderr("readClientFirstMessage() - first line is too long");
             }
             break;
 
         default: // ???
-            carla_stderr("waitForClientFirstMessage() - read returned %i", int(ret));
+            carla_stderr("readClientFirstMessage() - read returned %i", int(ret));
             break;
         }
 
         break;
     }
 
-    return false;
+    return kPipeHandshakeFailed;
 }
 
 // -----------------------------------------------------------------------
@@ -392,6 +940,15 @@ bool waitForChildToStop(const pid_t pid, const uint32_t timeOutMilliseconds, boo
             ret = ::waitpid(pid, nullptr, WNOHANG);
         } CARLA_SAFE_EXCEPTION_BREAK("waitpid");
 
+        // not our child if started through a zygote (which reaps it), poll until it is gone
+        if (ret == -1 && errno == ECHILD)
+        {
+            if (::kill(pid, 0) == 0)
+                ret = 0;
+            else
+                errno = ECHILD;
+        }
+
         switch (ret)
         {
         case -1:
@@ -466,212 +1023,2906 @@ void waitForChildToStopOrKillIt(pid_t& pid, const uint32_t timeOutMilliseconds)
 #endif
 
 // -----------------------------------------------------------------------
+// pidfd helpers
 
-struct CarlaPipeCommon::PrivateData {
-    // pipes
-#ifdef CARLA_OS_WIN
-    PROCESS_INFORMATION processInfo;
-    HANDLE cancelEvent;
-    HANDLE pipeRecv;
-    HANDLE pipeSend;
-#else
-    pid_t pid;
-    int pipeRecv;
-    int pipeSend;
-#endif
-
-    // read functions must only be called in context of idlePipe()
-    bool isReading;
+#ifndef CARLA_OS_WIN
+/*
+ * Get a pidfd for @a pid, which becomes readable once the process exits.
+ * Returns -1 if not supported, callers then fall back to polling the pid.
+ */
+static inline
+int openPidFd(const pid_t pid) noexcept
+{
+#if defined(CARLA_OS_LINUX) && defined(__NR_pidfd_open)
+    int fd;
 
-    // common write lock
-    CarlaMutex writeLock;
+    try {
+        fd = static_cast<int>(::syscall(__NR_pidfd_open, pid, 0));
+    } CARLA_SAFE_EXCEPTION_RETURN("pidfd_open", -1);
 
-    // temporary buffers for _readline()
-    mutable char        tmpBuf[0xff+1];
-    mutable CarlaString tmpStr;
+    if (fd >= 0)
+        try { ::fcntl(fd, F_SETFD, FD_CLOEXEC); } CARLA_SAFE_EXCEPTION("fcntl(pidfd, FD_CLOEXEC)");
 
-    PrivateData() noexcept
-#ifdef CARLA_OS_WIN
-        : processInfo(),
-          cancelEvent(INVALID_HANDLE_VALUE),
+    return fd;
 #else
-        : pid(-1),
+    return -1;
+    (void)pid;
 #endif
-          pipeRecv(INVALID_PIPE_VALUE),
-          pipeSend(INVALID_PIPE_VALUE),
-          isReading(false),
-          writeLock(),
-          tmpBuf(),
-          tmpStr()
-    {
-#ifdef CARLA_OS_WIN
-        carla_zeroStruct(processInfo);
-        processInfo.hProcess = INVALID_HANDLE_VALUE;
-        processInfo.hThread  = INVALID_HANDLE_VALUE;
+}
 
+/*
+ * Signal the process of @a pidfd, or @a pid if there is no pidfd.
+ * A pidfd cannot refer to a new process that reused the pid, which matters for clients that are not our children.
+ */
+static inline
+void signalPidFd(const int pidfd, const pid_t pid, const int sig) noexcept
+{
+#if defined(CARLA_OS_LINUX) && defined(__NR_pidfd_send_signal)
+    if (pidfd >= 0)
+    {
         try {
-            cancelEvent = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        } CARLA_SAFE_EXCEPTION("CreateEvent");
+            ::syscall(__NR_pidfd_send_signal, pidfd, sig, nullptr, 0);
+        } CARLA_SAFE_EXCEPTION("pidfd_send_signal");
+        return;
+    }
+#else
+    (void)pidfd;
 #endif
 
-        carla_zeroChars(tmpBuf, 0xff+1);
-    }
+    ::kill(pid, sig);
+}
 
-    ~PrivateData() noexcept
+/*
+ * Check if the process is gone, without blocking. Reaps it if it is our child.
+ */
+static inline
+bool hasPidExited(const int pidfd, const pid_t pid) noexcept
+{
+    if (pidfd >= 0)
     {
-#ifdef CARLA_OS_WIN
-        if (cancelEvent != INVALID_HANDLE_VALUE)
-        {
-            ::CloseHandle(cancelEvent);
-            cancelEvent = INVALID_HANDLE_VALUE;
-        }
-#endif
-    }
+        struct pollfd pfd;
+        pfd.fd      = pidfd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
 
-    CARLA_DECLARE_NON_COPY_STRUCT(PrivateData)
-};
+        int ret;
 
-// -----------------------------------------------------------------------
+        try {
+            ret = ::poll(&pfd, 1, 0);
+        } CARLA_SAFE_EXCEPTION_RETURN("poll", false);
 
-CarlaPipeCommon::CarlaPipeCommon() noexcept
-    : pData(new PrivateData())
-{
-    carla_debug("CarlaPipeCommon::CarlaPipeCommon()");
-}
+        if (ret <= 0)
+            return false;
+    }
 
-CarlaPipeCommon::~CarlaPipeCommon() /*noexcept*/
-{
-    carla_debug("CarlaPipeCommon::~CarlaPipeCommon()");
+    pid_t ret;
 
-    delete pData;
-}
+    try {
+        ret = ::waitpid(pid, nullptr, WNOHANG);
+    } CARLA_SAFE_EXCEPTION_RETURN("waitpid", false);
 
-// -------------------------------------------------------------------
+    if (ret == pid)
+        return true;
 
-bool CarlaPipeCommon::isPipeRunning() const noexcept
-{
-    return (pData->pipeRecv != INVALID_PIPE_VALUE && pData->pipeSend != INVALID_PIPE_VALUE);
+    // not our child if started through a zygote, which reaps it
+    if (ret == -1 && errno == ECHILD)
+        return pidfd >= 0 || (::kill(pid, 0) == -1 && errno == ESRCH);
+
+    return false;
 }
 
-void CarlaPipeCommon::idlePipe(const bool onlyOnce) noexcept
-{
-    const char* locale = nullptr;
+// -----------------------------------------------------------------------
+// background reaper
 
-    for (;;)
+/*
+ * Children handed over by CarlaPipeServer::stopPipeServerAsync(), already asked to quit.
+ * Each one gets SIGTERM halfway to its deadline and SIGKILL at it, exits are seen through pidfds.
+ * The thread only runs while there are children left.
+ */
+class PipeChildReaper : public CarlaThread
+{
+public:
+    PipeChildReaper() noexcept
+        : CarlaThread("PipeChildReaper"),
+          fLock(),
+          fRunning(false),
+          fChildCount(0)
     {
-        const char* const msg(_readline());
+        carla_zeroStructs(fChildren, kMaxChildren);
+    }
 
-        if (msg == nullptr)
-            break;
+    ~PipeChildReaper() override
+    {
+        // the process is going away, children still pending do not get to wait for their deadlines
+        signalThreadShouldExit();
 
-        if (locale == nullptr && ! onlyOnce)
         {
-            locale = carla_strdup_safe(::setlocale(LC_NUMERIC, nullptr));
-            ::setlocale(LC_NUMERIC, "C");
+            const CarlaMutexLocker cml(fLock);
+
+            for (uint32_t i=0; i < fChildCount; ++i)
+                signalPidFd(fChildren[i].pidfd, fChildren[i].pid, SIGKILL);
         }
 
-        pData->isReading = true;
+        stopThread(-1);
 
-        try {
-            msgReceived(msg);
-        } CARLA_SAFE_EXCEPTION("msgReceived");
+        const CarlaMutexLocker cml(fLock);
 
-        pData->isReading = false;
+        for (uint32_t i=0; i < fChildCount; ++i)
+        {
+            const Child& child(fChildren[i]);
 
-        delete[] msg;
+            hasPidExited(child.pidfd, child.pid);
 
-        if (onlyOnce)
-            break;
-    }
+            if (child.pidfd >= 0)
+            {
+                try { ::close(child.pidfd); } CARLA_SAFE_EXCEPTION("close(pidfd)");
+            }
+        }
 
-    if (locale != nullptr)
-    {
-        ::setlocale(LC_NUMERIC, locale);
-        delete[] locale;
+        fChildCount = 0;
     }
-}
-
-// -------------------------------------------------------------------
 
-void CarlaPipeCommon::lockPipe() const noexcept
-{
-    pData->writeLock.lock();
-}
+    /*
+     * Take over @a pid and its @a pidfd (if any).
+     * Returns false if there is no room left, the caller must wait for the child itself then.
+     */
+    bool addChild(const pid_t pid, const int pidfd, const uint32_t timeOutMilliseconds) noexcept
+    {
+        const CarlaMutexLocker cml(fLock);
 
-bool CarlaPipeCommon::tryLockPipe() const noexcept
-{
-    return pData->writeLock.tryLock();
-}
+        if (fChildCount == kMaxChildren)
+            return false;
 
-void CarlaPipeCommon::unlockPipe() const noexcept
-{
-    pData->writeLock.unlock();
-}
+        const uint32_t now(getMillisecondCounter());
 
-CarlaMutex& CarlaPipeCommon::getPipeLock() const noexcept
-{
-    return pData->writeLock;
-}
+        Child& child(fChildren[fChildCount++]);
+        child.pid      = pid;
+        child.pidfd    = pidfd;
+        child.stage    = kStageQuit;
+        child.deadline = now + timeOutMilliseconds/2;
+        child.killTime = now + timeOutMilliseconds;
 
-// -------------------------------------------------------------------
+        if (! fRunning)
+        {
+            // the previous run might still be returning
+            stopThread(-1);
+            fRunning = startThread();
 
-bool CarlaPipeCommon::readNextLineAsBool(bool& value) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+            if (! fRunning)
+            {
+                --fChildCount;
+                return false;
+            }
+        }
 
-    if (const char* const msg = _readlineblock())
-    {
-        value = (std::strcmp(msg, "true") == 0);
-        delete[] msg;
         return true;
     }
 
-    return false;
-}
-
-bool CarlaPipeCommon::readNextLineAsByte(uint8_t& value) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
-
-    if (const char* const msg = _readlineblock())
+protected:
+    void run() override
     {
-        int tmp = std::atoi(msg);
-        delete[] msg;
+        struct pollfd pfds[kMaxChildren];
 
-        if (tmp >= 0 && tmp <= 0xFF)
+        for (;;)
         {
-            value = static_cast<uint8_t>(tmp);
-            return true;
-        }
-    }
+            uint32_t numPfds = 0;
+            uint32_t timeout = kPollInterval;
 
-    return false;
-}
+            {
+                const CarlaMutexLocker cml(fLock);
 
-bool CarlaPipeCommon::readNextLineAsInt(int32_t& value) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+                if (fChildCount == 0 || shouldThreadExit())
+                {
+                    fRunning = false;
+                    return;
+                }
 
-    if (const char* const msg = _readlineblock())
-    {
-        value = std::atoi(msg);
-        delete[] msg;
-        return true;
-    }
+                const uint32_t now(getMillisecondCounter());
 
-    return false;
-}
+                for (uint32_t i=0; i < fChildCount; ++i)
+                {
+                    const Child& child(fChildren[i]);
+
+                    if (child.pidfd >= 0)
+                    {
+                        pfds[numPfds].fd      = child.pidfd;
+                        pfds[numPfds].events  = POLLIN;
+                        pfds[numPfds].revents = 0;
+                        ++numPfds;
+                    }
+
+                    if (child.deadline <= now)
+                        timeout = 0;
+                    else if (child.deadline - now < timeout)
+                        timeout = child.deadline - now;
+                }
+            }
 
-bool CarlaPipeCommon::readNextLineAsUInt(uint32_t& value) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+            // pidfds wake us up right away, children without one are checked every interval
+            if (numPfds != 0)
+            {
+                try {
+                    ::poll(pfds, numPfds, static_cast<int>(timeout));
+                } CARLA_SAFE_EXCEPTION("poll");
+            }
+            else
+            {
+                carla_msleep(timeout);
+            }
 
-    if (const char* const msg = _readlineblock())
-    {
-        int32_t tmp = std::atoi(msg);
-        delete[] msg;
+            const CarlaMutexLocker cml(fLock);
+            const uint32_t now(getMillisecondCounter());
 
-        if (tmp >= 0)
+            for (uint32_t i=0; i < fChildCount;)
+            {
+                Child& child(fChildren[i]);
+
+                if (hasPidExited(child.pidfd, child.pid) || ! escalate(child, now))
+                {
+                    if (child.pidfd >= 0)
+                    {
+                        try { ::close(child.pidfd); } CARLA_SAFE_EXCEPTION("close(pidfd)");
+                    }
+
+                    child = fChildren[--fChildCount];
+                    continue;
+                }
+
+                ++i;
+            }
+        }
+    }
+
+private:
+    static const uint32_t kMaxChildren = 128;
+
+    // for children without a pidfd, and to pick up newly added ones
+    static const uint32_t kPollInterval = 20;
+
+    // how long to wait after SIGKILL before giving up on a child
+    static const uint32_t kKillTimeout = 2*1000;
+
+    enum Stage {
+        kStageQuit = 0,
+        kStageTerminate,
+        kStageKill
+    };
+
+    struct Child {
+        pid_t    pid;
+        int      pidfd;
+        uint32_t stage;
+        uint32_t deadline;
+        uint32_t killTime;
+    };
+
+    /*
+     * Move on to the next signal if the deadline passed.
+     * Returns false if there is nothing left to do for this child.
+     */
+    static bool escalate(Child& child, const uint32_t now) noexcept
+    {
+        if (now < child.deadline)
+            return true;
+
+        switch (child.stage)
+        {
+        case kStageQuit:
+            signalPidFd(child.pidfd, child.pid, SIGTERM);
+            child.stage    = kStageTerminate;
+            child.deadline = child.killTime;
+            return true;
+
+        case kStageTerminate:
+            carla_stderr("PipeChildReaper - process %i didn't stop, force killing", int(child.pid));
+            signalPidFd(child.pidfd, child.pid, SIGKILL);
+            child.stage    = kStageKill;
+            child.deadline = now + kKillTimeout;
+            return true;
+
+        default:
+            carla_stderr2("PipeChildReaper - process %i still running after being killed, giving up", int(child.pid));
+            return false;
+        }
+    }
+
+    CarlaMutex fLock;
+    bool       fRunning;
+    Child      fChildren[kMaxChildren];
+    uint32_t   fChildCount;
+
+    CARLA_DECLARE_NON_COPY_CLASS(PipeChildReaper)
+};
+
+static PipeChildReaper& getPipeChildReaper() noexcept
+{
+    static PipeChildReaper reaper;
+    return reaper;
+}
+#endif
+
+// -----------------------------------------------------------------------
+// zygote protocol
+
+#ifndef CARLA_OS_WIN
+/*
+ * Request sent to a zygote over its unix socket, followed by 'size' bytes of null-terminated arguments.
+ * The fds of the new client go along with the header as SCM_RIGHTS, in the same order as their numbers
+ * appear in the arguments, so the zygote can replace those with the numbers it received.
+ * The zygote replies with the int32_t pid of the new client, or -1 if it could not fork.
+ * A shared zygote does not reply, it hosts the client under 'instanceId' or closes its fds.
+ */
+struct PipeZygoteHeader {
+    uint32_t argc;
+    uint32_t size;
+    uint32_t numFds;
+    uint32_t instanceId; // 0 if not shared
+};
+
+static const uint32_t kPipeZygoteMaxArgs    = 16;
+static const uint32_t kPipeZygoteMaxArgSize = 0x4000;
+static const uint32_t kPipeZygoteMaxFds     = 8;
+
+// arguments from this one on are fd numbers, separated by ':' (pipes and shared memory)
+static const uint32_t kPipeZygoteFirstFdArg = 3;
+
+// replies read for requests of other servers are kept until taken, for this many requests
+static const uint32_t kPipeZygoteMaxPendingReplies = 64;
+
+/*
+ * Reply of a forked client kept by the server side, pid 0 once taken and kPipeZygoteAbandoned if its server gave up.
+ */
+struct PipeZygoteReply {
+    uint32_t request;
+    int32_t  pid;
+};
+
+static const int32_t kPipeZygoteAbandoned = -2;
+
+#ifdef MSG_NOSIGNAL
+static const int kPipeZygoteSendFlags = MSG_NOSIGNAL;
+#else
+static const int kPipeZygoteSendFlags = 0;
+#endif
+
+/*
+ * Send all of @a buf, with @a fds attached to the first byte.
+ */
+static inline
+bool zygoteSend(const int sock, const void* const buf, const std::size_t size,
+                const int* const fds = nullptr, const uint32_t numFds = 0) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(numFds <= kPipeZygoteMaxFds, false);
+
+    const char* const data(static_cast<const char*>(buf));
+    char control[CMSG_SPACE(sizeof(int) * kPipeZygoteMaxFds)];
+
+    for (std::size_t done = 0; done < size;)
+    {
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(data + done);
+        iov.iov_len  = size - done;
+
+        struct msghdr msg;
+        carla_zeroStruct(msg);
+        msg.msg_iov    = &iov;
+        msg.msg_iovlen = 1;
+
+        if (done == 0 && numFds != 0)
+        {
+            std::memset(control, 0, sizeof(control));
+            msg.msg_control    = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * numFds);
+
+            struct cmsghdr* const cmsg(CMSG_FIRSTHDR(&msg));
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_RIGHTS;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * numFds);
+            std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * numFds);
+        }
+
+        ssize_t ret;
+
+        try {
+            ret = ::sendmsg(sock, &msg, kPipeZygoteSendFlags);
+        } CARLA_SAFE_EXCEPTION_RETURN("sendmsg", false);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        done += static_cast<std::size_t>(ret);
+    }
+
+    return true;
+}
+
+/*
+ * Receive exactly @a size bytes, collecting the fds attached to them in @a fds.
+ * Waits forever if @a timeOutMilliseconds is 0.
+ * On failure received fds stay in @a fds, for the caller to close.
+ */
+static inline
+bool zygoteRecv(const int sock, void* const buf, const std::size_t size, const uint32_t timeOutMilliseconds,
+                int* const fds = nullptr, uint32_t* const numFds = nullptr) noexcept
+{
+    char* const data(static_cast<char*>(buf));
+    char control[CMSG_SPACE(sizeof(int) * kPipeZygoteMaxFds)];
+    const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);
+
+    for (std::size_t done = 0; done < size;)
+    {
+        if (timeOutMilliseconds != 0)
+        {
+            const uint32_t now(getMillisecondCounter());
+
+            if (now >= timeoutEnd)
+                return false;
+
+            struct pollfd pfd;
+            pfd.fd      = sock;
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+
+            int ret;
+
+            try {
+                ret = ::poll(&pfd, 1, static_cast<int>(timeoutEnd - now));
+            } CARLA_SAFE_EXCEPTION_RETURN("poll", false);
+
+            if (ret < 0 && errno != EINTR)
+                return false;
+            if (ret <= 0)
+                continue;
+        }
+
+        struct iovec iov;
+        iov.iov_base = data + done;
+        iov.iov_len  = size - done;
+
+        struct msghdr msg;
+        carla_zeroStruct(msg);
+        msg.msg_iov    = &iov;
+        msg.msg_iovlen = 1;
+
+        if (fds != nullptr)
+        {
+            msg.msg_control    = control;
+            msg.msg_controllen = sizeof(control);
+        }
+
+        ssize_t ret;
+
+        try {
+            ret = ::recvmsg(sock, &msg, 0);
+        } CARLA_SAFE_EXCEPTION_RETURN("recvmsg", false);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        if (fds != nullptr)
+        {
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                    continue;
+
+                const int* const cfds(reinterpret_cast<const int*>(CMSG_DATA(cmsg)));
+                const std::size_t count((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+                for (std::size_t i=0; i < count; ++i)
+                {
+                    if (*numFds < kPipeZygoteMaxFds)
+                        fds[(*numFds)++] = cfds[i];
+                    else
+                        ::close(cfds[i]);
+                }
+            }
+
+            if (msg.msg_flags & MSG_CTRUNC)
+                return false;
+        }
+
+        // the other side is gone
+        if (ret == 0)
+            return false;
+
+        done += static_cast<std::size_t>(ret);
+    }
+
+    return true;
+}
+#endif
+
+// -----------------------------------------------------------------------
+// binary protocol
+
+/*
+ * Fixed-size header of every message sent in binary mode.
+ * Both ends run on the same machine, so fields use native byte order and the value is a raw IEEE float.
+ */
+struct PipeBinaryHeader {
+    uint32_t opcode;
+    uint32_t index;
+    float    value;
+    uint32_t size; // number of payload bytes following this header
+};
+
+enum PipeBinaryOpcode {
+    kPipeBinaryOpText    = 1, // payload contains the '\n' terminated lines of a regular message
+    kPipeBinaryOpControl = 2, // "control" message, using index and value, no payload
+    kPipeBinaryOpAtom    = 3  // "atom" message, using index, payload is the raw atom
+};
+
+// biggest payload accepted in a message, anything larger is treated as corrupt data
+static const uint32_t kPipeBinaryMaxPayloadSize = 0x4000000;
+
+// -----------------------------------------------------------------------
+// message opcodes
+
+#ifdef CARLA_PROPER_CPP11_SUPPORT
+# define CARLA_PIPE_CONSTEXPR constexpr
+#else
+# define CARLA_PIPE_CONSTEXPR
+#endif
+
+/*
+ * Protocol keyword of a message opcode, stored in the slot given by pipeMsgHash().
+ */
+struct PipeMsgKeyword {
+    const char* name;
+    std::size_t size;
+    CarlaPipeCommon::MsgOpcode opcode;
+};
+
+static const uint kPipeMsgHashSize = 32;
+
+/*
+ * Perfect hash of the protocol keywords, picked so that each one gets its own slot.
+ * Adding a keyword may require changing the factors, the table below is checked at build time.
+ */
+static inline CARLA_PIPE_CONSTEXPR
+uint pipeMsgHash(const char* const msg, const std::size_t size) noexcept
+{
+    return static_cast<uint>(size + static_cast<uchar>(msg[0]) * 7U + static_cast<uchar>(msg[size-1]) * 2U) % kPipeMsgHashSize;
+}
+
+#define PIPE_MSG(name, opcode) { name, sizeof(name) - 1, CarlaPipeCommon::opcode }
+#define PIPE_MSG_NONE          { nullptr, 0, CarlaPipeCommon::kPipeMsgUnknown }
+
+static CARLA_PIPE_CONSTEXPR const PipeMsgKeyword kPipeMsgTable[kPipeMsgHashSize] = {
+    /*  0 */ PIPE_MSG("midiprogram", kPipeMsgMidiProgram),
+    /*  1 */ PIPE_MSG_NONE,
+    /*  2 */ PIPE_MSG("uiOptions", kPipeMsgUiOptions),
+    /*  3 */ PIPE_MSG("quit", kPipeMsgQuit),
+    /*  4 */ PIPE_MSG("uiTitle", kPipeMsgUiTitle),
+    /*  5 */ PIPE_MSG("atom", kPipeMsgAtom),
+    /*  6 */ PIPE_MSG("hide", kPipeMsgHide),
+    /*  7 */ PIPE_MSG_NONE,
+    /*  8 */ PIPE_MSG("configure", kPipeMsgConfigure),
+    /*  9 */ PIPE_MSG_NONE,
+    /* 10 */ PIPE_MSG_NONE,
+    /* 11 */ PIPE_MSG_NONE,
+    /* 12 */ PIPE_MSG("error", kPipeMsgError),
+    /* 13 */ PIPE_MSG_NONE,
+    /* 14 */ PIPE_MSG_NONE,
+    /* 15 */ PIPE_MSG_NONE,
+    /* 16 */ PIPE_MSG("note", kPipeMsgNote),
+    /* 17 */ PIPE_MSG("program", kPipeMsgProgram),
+    /* 18 */ PIPE_MSG_NONE,
+    /* 19 */ PIPE_MSG("size", kPipeMsgSize),
+    /* 20 */ PIPE_MSG("control", kPipeMsgControl),
+    /* 21 */ PIPE_MSG("focus", kPipeMsgFocus),
+    /* 22 */ PIPE_MSG_NONE,
+    /* 23 */ PIPE_MSG("show", kPipeMsgShow),
+    /* 24 */ PIPE_MSG("exiting", kPipeMsgExiting),
+    /* 25 */ PIPE_MSG_NONE,
+    /* 26 */ PIPE_MSG_NONE,
+    /* 27 */ PIPE_MSG_NONE,
+    /* 28 */ PIPE_MSG_NONE,
+    /* 29 */ PIPE_MSG_NONE,
+    /* 30 */ PIPE_MSG_NONE,
+    /* 31 */ PIPE_MSG("urid", kPipeMsgUrid),
+};
+
+#undef PIPE_MSG
+#undef PIPE_MSG_NONE
+
+/*
+ * Keyword of @a opcode, null if unknown. Not hashed, only used when a handler declines its message.
+ */
+static inline
+const char* getPipeMsgKeyword(const CarlaPipeCommon::MsgOpcode opcode) noexcept
+{
+    for (uint i=0; i < kPipeMsgHashSize; ++i)
+    {
+        if (kPipeMsgTable[i].name != nullptr && kPipeMsgTable[i].opcode == opcode)
+            return kPipeMsgTable[i].name;
+    }
+
+    return nullptr;
+}
+
+#ifdef CARLA_PROPER_CPP11_SUPPORT
+/*
+ * Check that every keyword is stored in its hash slot, and count them to make sure none is missing.
+ */
+static constexpr bool isPipeMsgTableInOrder(const uint slot) noexcept
+{
+    return slot == kPipeMsgHashSize
+        || ((kPipeMsgTable[slot].name == nullptr || pipeMsgHash(kPipeMsgTable[slot].name, kPipeMsgTable[slot].size) == slot)
+            && isPipeMsgTableInOrder(slot + 1));
+}
+
+static constexpr uint countPipeMsgTable(const uint slot) noexcept
+{
+    return slot == kPipeMsgHashSize ? 0 : (kPipeMsgTable[slot].name != nullptr ? 1 : 0) + countPipeMsgTable(slot + 1);
+}
+
+static_assert(isPipeMsgTableInOrder(0), "pipe message keyword stored outside its hash slot");
+static_assert(countPipeMsgTable(0) == CarlaPipeCommon::kPipeMsgCount - 1, "pipe message opcode without keyword");
+#endif
+
+#undef CARLA_PIPE_CONSTEXPR
+
+// -----------------------------------------------------------------------
+// runtime statistics helpers
+
+/*
+ * Counters have a single writer at a time, other threads only read them.
+ * Relaxed atomic stores keep those reads well-defined while costing the same as a plain store.
+ */
+// only 1 in this many writes is timed, must be a power of 2
+static const uint32_t kPipeStatsWriteSampling = 32;
+
+static inline
+void pipeStatsAdd(uint64_t& counter, const uint64_t value) noexcept
+{
+    __atomic_store_n(&counter, counter + value, __ATOMIC_RELAXED);
+}
+
+static inline
+void pipeStatsMax(uint64_t& counter, const uint64_t value) noexcept
+{
+    if (value > counter)
+        __atomic_store_n(&counter, value, __ATOMIC_RELAXED);
+}
+
+static inline
+void pipeStatsHistogram(uint64_t* const histogram, const uint64_t time) noexcept
+{
+    uint bucket = (time != 0) ? 64 - static_cast<uint>(__builtin_clzll(time)) : 0;
+
+    if (bucket >= CarlaPipeCommon::kPipeStatsHistogramSize)
+        bucket = CarlaPipeCommon::kPipeStatsHistogramSize - 1;
+
+    pipeStatsAdd(histogram[bucket], 1);
+}
+
+#ifdef DEBUG
+// -----------------------------------------------------------------------
+// write lock ownership checks
+
+/*
+ * Unique per thread, used to check who holds the write lock without another mutex operation.
+ */
+static inline
+uintptr_t getCurrentThreadTag() noexcept
+{
+    static __thread char tag;
+    return reinterpret_cast<uintptr_t>(&tag);
+}
+#endif
+
+// -----------------------------------------------------------------------
+// growable byte buffer, used to assemble outgoing data
+
+struct PipeWriteBuffer {
+    char*       data;
+    std::size_t size;
+    std::size_t used;
+
+    PipeWriteBuffer() noexcept
+        : data(nullptr),
+          size(0),
+          used(0) {}
+
+    ~PipeWriteBuffer() noexcept
+    {
+        if (data != nullptr)
+            std::free(data);
+    }
+
+    bool append(const void* const buf, const std::size_t bufSize) noexcept
+    {
+        char* const dst(reserve(bufSize));
+
+        if (dst == nullptr)
+            return false;
+
+        std::memcpy(dst, buf, bufSize);
+        return true;
+    }
+
+    /*
+     * Make room for 'bufSize' more bytes and mark them as used, returning where they start.
+     */
+    char* reserve(const std::size_t bufSize) noexcept
+    {
+        if (used + bufSize > size)
+        {
+            std::size_t newSize = (size != 0) ? size : 0x1000;
+
+            for (; newSize < used + bufSize;)
+                newSize *= 2;
+
+            char* const newData((char*)std::realloc(data, newSize));
+            CARLA_SAFE_ASSERT_RETURN(newData != nullptr, nullptr);
+
+            data = newData;
+            size = newSize;
+        }
+
+        char* const ret(data + used);
+        used += bufSize;
+        return ret;
+    }
+
+    void clear() noexcept
+    {
+        used = 0;
+    }
+
+    CARLA_DECLARE_NON_COPY_STRUCT(PipeWriteBuffer)
+};
+
+// -----------------------------------------------------------------------
+// non-blocking send backlog
+
+// requested kernel buffer size for each pipe, bigger ones count against the per-user pipe limits
+static const int kPipeBufferSize = 0x40000;
+
+/*
+ * How a message may be treated while it waits in the send backlog.
+ * Partially written data can never be dropped, so it is considered critical.
+ */
+enum PipeMessageKind {
+    kPipeMessageNormal = 0,
+    kPipeMessageControl,
+    kPipeMessageCritical,
+    kPipeMessageDead // replaced by a newer control message, skipped when writing
+};
+
+struct PipeBacklogEntry {
+    std::size_t offset;
+    std::size_t size;
+    uint32_t    kind;
+    uint32_t    index;
+};
+
+// replaced messages compacted away once they are this many and more than half of the backlog
+static const std::size_t kBacklogCompactMinDead = 64;
+
+// -----------------------------------------------------------------------
+// shared memory transport
+
+static const uint32_t kPipeSharedRingSize = 0x40000; // must be a power of 2
+
+#ifdef CARLA_OS_LINUX
+/*
+ * Sleep while the shared memory word at 'addr' still has 'value', until woken or the timeout is reached.
+ */
+static inline
+void pipeFutexWait(uint32_t* const addr, const uint32_t value, const uint32_t timeOutMilliseconds) noexcept
+{
+    struct timespec timeout;
+    timeout.tv_sec  = static_cast<time_t>(timeOutMilliseconds / 1000);
+    timeout.tv_nsec = static_cast<long>(timeOutMilliseconds % 1000) * 1000000;
+
+    try {
+        ::syscall(SYS_futex, addr, FUTEX_WAIT, value, &timeout, nullptr, 0);
+    } CARLA_SAFE_EXCEPTION("futex wait");
+}
+
+static inline
+void pipeFutexWake(uint32_t* const addr) noexcept
+{
+    try {
+        ::syscall(SYS_futex, addr, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    } CARLA_SAFE_EXCEPTION("futex wake");
+}
+#endif
+
+/*
+ * Single-producer/single-consumer byte ring placed in shared memory.
+ * Positions are free-running counters, each one only ever written by its owner side.
+ */
+struct PipeSharedRing {
+    uint32_t head;          // written by the producer
+    uint32_t writerWaiting; // room the producer is (about to be) sleeping for, on a futex at tail
+    char     pad1[56];
+    uint32_t tail;          // written by the consumer
+    uint32_t readerWaiting; // consumer is (about to be) sleeping on the ring's eventfd
+    char     pad2[56];
+    uint8_t  data[kPipeSharedRingSize];
+};
+
+/*
+ * Layout of the shared memory, ring 0 is written by the server and ring 1 by the client.
+ */
+struct PipeSharedData {
+    PipeSharedRing rings[2];
+};
+
+/*
+ * Message data transport over memfd-backed rings, with eventfd wakeups for a waiting reader and futex wakeups
+ * for a writer waiting on a full ring.
+ * The pipes are still used for the first-message handshake and to know if the other side is alive.
+ */
+struct PipeSharedMemory {
+    PipeSharedData* data;
+    PipeSharedRing* recvRing;
+    PipeSharedRing* sendRing;
+
+    // memfd is only kept open by the server until the client is started
+    int memFd;
+    int events[2]; // signaled when rings[i] gets data while its reader waits
+    int recvEvent;
+    int sendEvent;
+
+    // message data goes through the rings, enabled after the handshake
+    bool active;
+
+    PipeSharedMemory() noexcept
+        : data(nullptr),
+          recvRing(nullptr),
+          sendRing(nullptr),
+          memFd(-1),
+          recvEvent(-1),
+          sendEvent(-1),
+          active(false)
+    {
+        events[0] = events[1] = -1;
+    }
+
+    ~PipeSharedMemory() noexcept
+    {
+        clear();
+    }
+
+    /*
+     * Create the shared memory and events, used by the server before starting the client.
+     * They are close-on-exec, only the client started with getFds() in its inherit list keeps them.
+     */
+    bool create() noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(data == nullptr, false);
+
+#if defined(CARLA_OS_LINUX) && defined(__NR_memfd_create)
+        try {
+            memFd = static_cast<int>(::syscall(__NR_memfd_create, "carla-pipe", MFD_CLOEXEC));
+        } CARLA_SAFE_EXCEPTION_RETURN("memfd_create", false);
+
+        if (memFd < 0 || ::ftruncate(memFd, sizeof(PipeSharedData)) != 0 || ! map())
+        {
+            carla_stderr("PipeSharedMemory::create() - failed to create shared memory, using pipes instead");
+            clear();
+            return false;
+        }
+
+        events[0] = ::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        events[1] = ::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+
+        if (events[0] < 0 || events[1] < 0)
+        {
+            carla_stderr("PipeSharedMemory::create() - failed to create events, using pipes instead");
+            clear();
+            return false;
+        }
+
+        setupRings(true);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /*
+     * Attach to the shared memory created by the server, as described by the client's argument.
+     */
+    bool attach(const char* const arg) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(data == nullptr, false);
+        CARLA_SAFE_ASSERT_RETURN(arg != nullptr && arg[0] != '\0', false);
+
+#ifdef CARLA_OS_LINUX
+        if (std::sscanf(arg, "%i:%i:%i", &memFd, &events[0], &events[1]) != 3 || memFd < 0 || events[0] < 0 || events[1] < 0)
+        {
+            carla_stderr2("PipeSharedMemory::attach() - invalid argument '%s'", arg);
+            memFd = events[0] = events[1] = -1;
+            return false;
+        }
+
+        struct stat st;
+
+        if (::fstat(memFd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(PipeSharedData)) || ! map())
+        {
+            carla_stderr2("PipeSharedMemory::attach() - failed to map shared memory");
+            clear();
+            return false;
+        }
+
+        // the mapping stays valid without the fd
+        closeMemFd();
+        setupRings(false);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /*
+     * Write the argument that lets the client attach to this shared memory.
+     */
+    void getArgument(char* const buf, const std::size_t size) const noexcept
+    {
+        std::snprintf(buf, size, "%i:%i:%i", memFd, events[0], events[1]);
+    }
+
+    /*
+     * The fds passed to the client by getArgument(), returns their count.
+     */
+    uint32_t getFds(int fds[3]) const noexcept
+    {
+        fds[0] = memFd;
+        fds[1] = events[0];
+        fds[2] = events[1];
+        return 3;
+    }
+
+    void closeMemFd() noexcept
+    {
+        if (memFd < 0)
+            return;
+
+        try { ::close(memFd); } CARLA_SAFE_EXCEPTION("close(memFd)");
+        memFd = -1;
+    }
+
+    void clear() noexcept
+    {
+        active = false;
+        recvRing = sendRing = nullptr;
+        recvEvent = sendEvent = -1;
+
+#ifndef CARLA_OS_WIN
+        if (data != nullptr)
+        {
+            try { ::munmap(data, sizeof(PipeSharedData)); } CARLA_SAFE_EXCEPTION("munmap");
+            data = nullptr;
+        }
+
+        for (int i=0; i<2; ++i)
+        {
+            if (events[i] < 0)
+                continue;
+
+            try { ::close(events[i]); } CARLA_SAFE_EXCEPTION("close(event)");
+            events[i] = -1;
+        }
+
+        closeMemFd();
+#endif
+    }
+
+    /*
+     * Read as much as currently available from the receive ring, returns the number of bytes read.
+     */
+    std::size_t read(void* const buf, const std::size_t size) noexcept
+    {
+        const uint32_t tail(recvRing->tail);
+        const uint32_t head(__atomic_load_n(&recvRing->head, __ATOMIC_ACQUIRE));
+        uint32_t avail(head - tail);
+
+        if (avail == 0)
+            return 0;
+
+        CARLA_SAFE_ASSERT_RETURN(avail <= kPipeSharedRingSize, 0);
+
+        if (avail > size)
+            avail = static_cast<uint32_t>(size);
+
+        const uint32_t offset(tail & (kPipeSharedRingSize-1));
+        const uint32_t firstPart((avail < kPipeSharedRingSize - offset) ? avail : kPipeSharedRingSize - offset);
+
+        std::memcpy(buf, recvRing->data + offset, firstPart);
+
+        if (firstPart < avail)
+            std::memcpy((uint8_t*)buf + firstPart, recvRing->data, avail - firstPart);
+
+        // pairs with the writer's writerWaiting store and tail check in waitForSpace()
+        __atomic_store_n(&recvRing->tail, tail + avail, __ATOMIC_SEQ_CST);
+
+#ifdef CARLA_OS_LINUX
+        const uint32_t wanted(__atomic_load_n(&recvRing->writerWaiting, __ATOMIC_SEQ_CST));
+
+        if (wanted != 0 && kPipeSharedRingSize - (head - tail - avail) >= wanted)
+            pipeFutexWake(&recvRing->tail);
+#endif
+
+        return avail;
+    }
+
+    /*
+     * Write as much of 'buf' as currently fits into the send ring, returns the number of bytes written.
+     */
+    std::size_t writeSome(const void* const buf, const std::size_t size) noexcept
+    {
+        const uint32_t head(sendRing->head);
+        const uint32_t space(kPipeSharedRingSize - (head - __atomic_load_n(&sendRing->tail, __ATOMIC_ACQUIRE)));
+
+        if (space == 0 || size == 0)
+            return 0;
+
+        const uint32_t count((size < space) ? static_cast<uint32_t>(size) : space);
+        const uint32_t offset(head & (kPipeSharedRingSize-1));
+        const uint32_t firstPart((count < kPipeSharedRingSize - offset) ? count : kPipeSharedRingSize - offset);
+
+        std::memcpy(sendRing->data + offset, buf, firstPart);
+
+        if (firstPart < count)
+            std::memcpy(sendRing->data, (const uint8_t*)buf + firstPart, count - firstPart);
+
+        // pairs with the reader's readerWaiting store and head check in wait()
+        __atomic_store_n(&sendRing->head, head + count, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&sendRing->readerWaiting, __ATOMIC_SEQ_CST) != 0)
+            signalReader();
+
+        return count;
+    }
+
+    /*
+     * Write all of 'buf' into the send ring, waiting for the reader to make room if needed.
+     * A message that fits in the ring is only started once it fits as a whole, so giving up never leaves part of it
+     * in the ring. Bigger ones are written in chunks and, once started, finished unless 'peerPipe' is broken.
+     */
+    bool write(const void* const buf, std::size_t size, const int peerPipe) noexcept
+    {
+        const uint8_t* bytes((const uint8_t*)buf);
+
+        for (const uint32_t timeoutEnd(getMillisecondCounter() + 2*1000); getSendSpace() < getSpaceNeeded(size);)
+        {
+            const uint32_t now(getMillisecondCounter());
+
+            if (now >= timeoutEnd)
+            {
+                carla_stderr2("PipeSharedMemory::write() - ring is full and reader is not responding, dropping message");
+                return false;
+            }
+
+            waitForSpace(getSpaceNeeded(size), timeoutEnd - now);
+        }
+
+        for (;;)
+        {
+            const std::size_t count(writeSome(bytes, size));
+
+            bytes += count;
+            size  -= count;
+
+            if (size == 0)
+                return true;
+
+#ifndef CARLA_OS_WIN
+            if (count == 0 && isPipeBroken(peerPipe))
+            {
+                carla_stderr2("PipeSharedMemory::write() - reader is gone, message is incomplete");
+                return false;
+            }
+#else
+            (void)peerPipe;
+#endif
+
+            waitForSpace(getSpaceNeeded(size), 50);
+        }
+    }
+
+    /*
+     * Sleep until the send ring has room for 'size' bytes, or the timeout is reached.
+     * The reader wakes us once it frees enough room, see read().
+     */
+    void waitForSpace(const uint32_t size, const uint32_t timeOutMilliseconds) noexcept
+    {
+#ifdef CARLA_OS_LINUX
+        __atomic_store_n(&sendRing->writerWaiting, size, __ATOMIC_SEQ_CST);
+
+        const uint32_t tail(__atomic_load_n(&sendRing->tail, __ATOMIC_SEQ_CST));
+
+        if (kPipeSharedRingSize - (sendRing->head - tail) < size)
+            pipeFutexWait(&sendRing->tail, tail, timeOutMilliseconds);
+
+        __atomic_store_n(&sendRing->writerWaiting, 0, __ATOMIC_SEQ_CST);
+#else
+        (void)size;
+        carla_msleep(timeOutMilliseconds < 1 ? timeOutMilliseconds : 1);
+#endif
+    }
+
+    /*
+     * Sleep until the receive ring has data, or the timeout is reached.
+     */
+    void wait(const uint32_t timeOutMilliseconds) noexcept
+    {
+#ifdef CARLA_OS_LINUX
+        if (prepareWait())
+        {
+            struct pollfd pfd;
+            pfd.fd      = recvEvent;
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+
+            try {
+                ::poll(&pfd, 1, static_cast<int>(timeOutMilliseconds));
+            } CARLA_SAFE_EXCEPTION("poll");
+        }
+
+        finishWait();
+#else
+        carla_msleep(timeOutMilliseconds);
+#endif
+    }
+
+    /*
+     * Tell the writer we are about to sleep on the receive event, so it signals it.
+     * Returns false if the receive ring has data already and there is no need to.
+     */
+    bool prepareWait() noexcept
+    {
+#ifdef CARLA_OS_LINUX
+        __atomic_store_n(&recvRing->readerWaiting, 1, __ATOMIC_SEQ_CST);
+
+        return __atomic_load_n(&recvRing->head, __ATOMIC_SEQ_CST) == recvRing->tail;
+#else
+        return false;
+#endif
+    }
+
+    void finishWait() noexcept
+    {
+#ifdef CARLA_OS_LINUX
+        __atomic_store_n(&recvRing->readerWaiting, 0, __ATOMIC_SEQ_CST);
+
+        // reset the event, it is non-blocking so this never waits
+        uint64_t value;
+        try {
+            if (::read(recvEvent, &value, sizeof(value))) {}
+        } CARLA_SAFE_EXCEPTION("read(recvEvent)");
+#endif
+    }
+
+    int getRecvEvent() const noexcept
+    {
+        return recvEvent;
+    }
+
+private:
+    uint32_t getSendSpace() const noexcept
+    {
+        return kPipeSharedRingSize - (sendRing->head - __atomic_load_n(&sendRing->tail, __ATOMIC_ACQUIRE));
+    }
+
+    static uint32_t getSpaceNeeded(const std::size_t size) noexcept
+    {
+        return (size < kPipeSharedRingSize) ? static_cast<uint32_t>(size) : kPipeSharedRingSize;
+    }
+
+    bool map() noexcept
+    {
+#ifndef CARLA_OS_WIN
+        void* ptr;
+
+        try {
+            ptr = ::mmap(nullptr, sizeof(PipeSharedData), PROT_READ|PROT_WRITE, MAP_SHARED, memFd, 0);
+        } CARLA_SAFE_EXCEPTION_RETURN("mmap", false);
+
+        if (ptr == MAP_FAILED)
+            return false;
+
+        data = (PipeSharedData*)ptr;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void setupRings(const bool isServer) noexcept
+    {
+        recvRing  = &data->rings[isServer ? 1 : 0];
+        sendRing  = &data->rings[isServer ? 0 : 1];
+        recvEvent = events[isServer ? 1 : 0];
+        sendEvent = events[isServer ? 0 : 1];
+    }
+
+    void signalReader() const noexcept
+    {
+#ifdef CARLA_OS_LINUX
+        const uint64_t value = 1;
+
+        try {
+            if (::write(sendEvent, &value, sizeof(value))) {}
+        } CARLA_SAFE_EXCEPTION("write(sendEvent)");
+#endif
+    }
+
+    CARLA_DECLARE_NON_COPY_STRUCT(PipeSharedMemory)
+};
+
+// -----------------------------------------------------------------------
+
+struct CarlaPipeCommon::PrivateData {
+    // pipes
+#ifdef CARLA_OS_WIN
+    PROCESS_INFORMATION processInfo;
+    HANDLE cancelEvent;
+    HANDLE pipeRecv;
+    HANDLE pipeSend;
+    HANDLE startRecv;
+    HANDLE startSend;
+#else
+    pid_t pid;
+    int pidfd; // server only, -1 if not supported
+    int pipeRecv;
+    int pipeSend;
+    int startRecv;
+    int startSend;
+#endif
+
+    // server only, pipes move from startRecv/startSend to pipeRecv/pipeSend once the client's first line arrives
+    bool starting;
+    PipeHandshake handshake;
+
+    // read functions must only be called in context of idlePipe()
+    bool isReading;
+
+    // message handlers by opcode, and opcode of the last line read when known without looking it up
+    CarlaPipeCommon::MsgHandler msgHandlers[CarlaPipeCommon::kPipeMsgCount];
+    CarlaPipeCommon::MsgOpcode lineOpcode;
+
+    // binary protocol, requested (client) or accepted (server) during handshake
+    bool binaryModeAllowed;
+    bool binaryMode;
+
+    // binary protocol read state: lines left to hand out for a control message and end of the current text payload
+    uint     binaryControlLines;
+    uint32_t binaryControlIndex;
+    float    binaryControlValue;
+    char     binaryLineBuf[0x1f+1];
+    std::size_t binaryTextEnd;
+
+    // same for atom messages, the last "line" being the raw atom that follows in the receive buffer
+    uint     binaryAtomLines;
+    uint32_t binaryAtomIndex;
+    uint32_t binaryAtomSize;
+
+    // atoms received in text mode get decoded here
+    PipeWriteBuffer atomBuf;
+
+    // message being assembled until flushMessages(), written with a single call.
+    // in binary mode it starts with the header of its text message.
+    PipeWriteBuffer msgBuf;
+
+    // shared memory transport, created by the server and attached to by the client
+    bool shmAllowed;
+    PipeSharedMemory shm;
+
+    // server only, clients are forked by this zygote instead of spawned while it runs
+    CarlaPipeZygote* zygote;
+
+    // server only, non-zero while the client is hosted by a shared zygote, pid is the zygote's then
+    uint32_t instanceId;
+
+    // server only, non-zero while the zygote did not tell the pid of the client it forked
+    uint32_t zygoteRequest;
+
+    // output buffer mode, everything written is collected in sendBuf until drained
+    bool outputBuffered;
+    PipeWriteBuffer sendBuf;
+    uint32_t sendBufTime; // time when sendBuf went from empty to non-empty
+
+    // non-blocking send, data the other side could not take yet waits in a bounded backlog.
+    // bytes in [backlogWritten, backlog.used) are pending, split in messages by backlogEntries from backlogEntryPos.
+    bool nonBlockingSend;
+    uint backlogPolicy;
+    std::size_t backlogMaxSize;
+    PipeWriteBuffer backlog;
+    PipeWriteBuffer backlogEntries;
+    std::size_t backlogWritten;
+    std::size_t backlogEntryPos;
+    std::size_t backlogDeadCount; // replaced messages from backlogEntryPos on
+
+    // kind of the message being written, used by the backlog policies
+    uint32_t msgKind;
+    uint32_t msgIndex;
+
+    // output counters
+    CarlaPipeCommon::OutputStats outputStats;
+
+    // runtime counters, see pipeStatsAdd() for the threading rules
+    CarlaPipeCommon::PipeStats stats;
+
+    // periodic dump of the runtime counters, enabled by the MODGUI_PIPE_STATS env var
+    uint32_t writeTimeSample;
+    uint32_t statsDumpInterval; // in milliseconds, 0 if disabled
+    uint32_t statsNextDump;
+    FILE*    statsDumpFile;
+
+    // common write lock, never taken in single writer mode
+    CarlaMutex writeLock;
+    bool singleWriter;
+#ifdef DEBUG
+    // thread holding the write lock, and in single writer mode the only thread allowed to write
+    uintptr_t writeOwner;
+    uintptr_t singleWriterThread;
+#endif
+
+    // receive buffer for _readline(), filled in large blocks and split into lines in place.
+    // bytes in [recvBufStart, recvBufEnd) are pending, [recvBufStart, recvBufScan) are known not to contain '\n'.
+    char*       recvBuf;
+    std::size_t recvBufSize;
+    std::size_t recvBufStart;
+    std::size_t recvBufScan;
+    std::size_t recvBufEnd;
+
+    PrivateData() noexcept
+#ifdef CARLA_OS_WIN
+        : processInfo(),
+          cancelEvent(INVALID_HANDLE_VALUE),
+#else
+        : pid(-1),
+          pidfd(-1),
+#endif
+          pipeRecv(INVALID_PIPE_VALUE),
+          pipeSend(INVALID_PIPE_VALUE),
+          startRecv(INVALID_PIPE_VALUE),
+          startSend(INVALID_PIPE_VALUE),
+          starting(false),
+          handshake(),
+          isReading(false),
+          lineOpcode(CarlaPipeCommon::kPipeMsgUnknown),
+          binaryModeAllowed(false),
+          binaryMode(false),
+          binaryControlLines(0),
+          binaryControlIndex(0),
+          binaryControlValue(0.0f),
+          binaryLineBuf(),
+          binaryTextEnd(0),
+          binaryAtomLines(0),
+          binaryAtomIndex(0),
+          binaryAtomSize(0),
+          atomBuf(),
+          msgBuf(),
+          shmAllowed(false),
+          shm(),
+          zygote(nullptr),
+          instanceId(0),
+          zygoteRequest(0),
+          outputBuffered(false),
+          sendBuf(),
+          sendBufTime(0),
+          nonBlockingSend(false),
+          backlogPolicy(0),
+          backlogMaxSize(0),
+          backlog(),
+          backlogEntries(),
+          backlogWritten(0),
+          backlogEntryPos(0),
+          backlogDeadCount(0),
+          msgKind(kPipeMessageNormal),
+          msgIndex(0),
+          outputStats(),
+          stats(),
+          writeTimeSample(0),
+          statsDumpInterval(0),
+          statsNextDump(0),
+          statsDumpFile(stderr),
+          writeLock(),
+          singleWriter(false),
+#ifdef DEBUG
+          writeOwner(0),
+          singleWriterThread(0),
+#endif
+          recvBuf(nullptr),
+          recvBufSize(0),
+          recvBufStart(0),
+          recvBufScan(0),
+          recvBufEnd(0)
+    {
+        carla_zeroStruct(outputStats);
+        carla_zeroStruct(stats);
+
+        for (uint i=0; i < CarlaPipeCommon::kPipeMsgCount; ++i)
+            msgHandlers[i] = nullptr;
+
+        if (const char* const interval = std::getenv("MODGUI_PIPE_STATS"))
+        {
+            statsDumpInterval = static_cast<uint32_t>(std::atof(interval) * 1000.0);
+
+            if (const char* const filename = std::getenv("MODGUI_PIPE_STATS_FILE"))
+            {
+                if (FILE* const file = std::fopen(filename, "a"))
+                    statsDumpFile = file;
+                else
+                    carla_stderr2("CarlaPipeCommon - cannot open stats file '%s', using stderr", filename);
+            }
+        }
+
+#ifdef CARLA_OS_WIN
+        carla_zeroStruct(processInfo);
+        processInfo.hProcess = INVALID_HANDLE_VALUE;
+        processInfo.hThread  = INVALID_HANDLE_VALUE;
+
+        try {
+            cancelEvent = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        } CARLA_SAFE_EXCEPTION("CreateEvent");
+#endif
+    }
+
+    ~PrivateData() noexcept
+    {
+        if (statsDumpFile != stderr)
+        {
+            std::fclose(statsDumpFile);
+            statsDumpFile = stderr;
+        }
+
+#ifdef CARLA_OS_WIN
+        if (cancelEvent != INVALID_HANDLE_VALUE)
+        {
+            ::CloseHandle(cancelEvent);
+            cancelEvent = INVALID_HANDLE_VALUE;
+        }
+#endif
+
+        if (recvBuf != nullptr)
+        {
+            std::free(recvBuf);
+            recvBuf = nullptr;
+        }
+    }
+
+    /*
+     * Take the write lock, keeping track of the time spent waiting if another thread holds it.
+     * Does nothing in single writer mode, other than the ownership checks of debug builds.
+     */
+    void lockWrite() noexcept
+    {
+        if (singleWriter)
+        {
+#ifdef DEBUG
+            checkSingleWriter();
+#endif
+        }
+        else if (! writeLock.tryLock())
+        {
+            const uint64_t start(getMicrosecondCounter());
+            writeLock.lock();
+            const uint64_t waited(getMicrosecondCounter() - start);
+
+            pipeStatsAdd(stats.lockWaits, 1);
+            pipeStatsAdd(stats.lockWaitTimeTotal, waited);
+            pipeStatsHistogram(stats.lockWaitTime, waited);
+        }
+
+#ifdef DEBUG
+        setWriteOwner();
+#endif
+    }
+
+    bool tryLockWrite() noexcept
+    {
+        if (singleWriter)
+        {
+#ifdef DEBUG
+            checkSingleWriter();
+#endif
+        }
+        else if (! writeLock.tryLock())
+        {
+            return false;
+        }
+
+#ifdef DEBUG
+        setWriteOwner();
+#endif
+        return true;
+    }
+
+    void unlockWrite() noexcept
+    {
+#ifdef DEBUG
+        CARLA_SAFE_ASSERT(isWriteOwner());
+        __atomic_store_n(&writeOwner, 0, __ATOMIC_RELAXED);
+#endif
+
+        if (! singleWriter)
+            writeLock.unlock();
+    }
+
+#ifdef DEBUG
+    /*
+     * Check if the calling thread holds the write lock.
+     * Atomic only so that checks from other threads are well-defined, the owner is only set and cleared by itself.
+     */
+    bool isWriteOwner() const noexcept
+    {
+        return __atomic_load_n(&writeOwner, __ATOMIC_RELAXED) == getCurrentThreadTag();
+    }
+
+    void setWriteOwner() noexcept
+    {
+        // the mutex is not recursive, only single writer mode gets here while already locked
+        CARLA_SAFE_ASSERT(__atomic_load_n(&writeOwner, __ATOMIC_RELAXED) == 0);
+        __atomic_store_n(&writeOwner, getCurrentThreadTag(), __ATOMIC_RELAXED);
+    }
+
+    /*
+     * The first thread to write owns the pipe in single writer mode, any other one is a bug.
+     */
+    void checkSingleWriter() noexcept
+    {
+        const uintptr_t thread(getCurrentThreadTag());
+        uintptr_t expected = 0;
+
+        if (__atomic_compare_exchange_n(&singleWriterThread, &expected, thread, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+
+        if (expected != thread)
+            carla_safe_assert("singleWriterThread == getCurrentThreadTag()", __FILE__, __LINE__);
+    }
+#endif
+
+    /*
+     * Discard any pending received data, used when the pipes are (re)opened or closed.
+     */
+    void clearRecvBuffer() noexcept
+    {
+        recvBufStart = recvBufScan = recvBufEnd = 0;
+        binaryTextEnd = 0;
+        binaryAtomLines = 0;
+    }
+
+    /*
+     * Server only, the client's first line arrived: the pipes become usable and the client is told the protocol to use.
+     */
+    void finishStart(const uint features) noexcept
+    {
+        pipeRecv  = startRecv;
+        pipeSend  = startSend;
+        startRecv = startSend = INVALID_PIPE_VALUE;
+        starting  = false;
+        clearRecvBuffer();
+
+        // tell the client which protocol to use from now on
+        if (features & kPipeFeatureBinary)
+        {
+            binaryMode = binaryModeAllowed;
+            writeRaw(binaryMode ? "binary\n" : "text\n", binaryMode ? 7 : 5);
+        }
+        else
+        {
+            binaryMode = false;
+        }
+
+        // all data after the handshake goes through shared memory, if the client attached to it
+        if ((features & kPipeFeatureSharedMemory) != 0 && shm.data != nullptr)
+            shm.active = true;
+        else
+            shm.clear();
+
+#ifndef CARLA_OS_WIN
+        // only after the handshake, so its reply always goes out complete
+        if (nonBlockingSend)
+        {
+            int ret = -1;
+
+            try {
+                ret = ::fcntl(pipeSend, F_SETFL, ::fcntl(pipeSend, F_GETFL) | O_NONBLOCK);
+            } CARLA_SAFE_EXCEPTION("fcntl(pipeSend, O_NONBLOCK)");
+            CARLA_SAFE_ASSERT(ret != -1);
+        }
+#endif
+
+        carla_stdout("ALL OK!");
+    }
+
+    /*
+     * Server only, the client failed to start or did not answer in time, kill it and close its pipes.
+     */
+    void abortStart() noexcept
+    {
+#ifdef CARLA_OS_WIN
+        if (TerminateProcess(processInfo.hProcess, 0) != FALSE)
+        {
+            // wait for process to stop
+            waitForProcessToStop(processInfo, 2*1000);
+        }
+
+        // clear processInfo
+        try { CloseHandle(processInfo.hThread);  } CARLA_SAFE_EXCEPTION("CloseHandle(processInfo.hThread)");
+        try { CloseHandle(processInfo.hProcess); } CARLA_SAFE_EXCEPTION("CloseHandle(processInfo.hProcess)");
+        carla_zeroStruct(processInfo);
+        processInfo.hProcess = INVALID_HANDLE_VALUE;
+        processInfo.hThread  = INVALID_HANDLE_VALUE;
+#else
+        // a shared zygote stays, closing our pipes is enough for it to drop the client
+        if (pid != -1 && instanceId == 0 && ::kill(pid, SIGKILL) != -1)
+        {
+            // wait for killing to take place
+            waitForChildToStop(pid, 2*1000, false);
+        }
+        pid = -1;
+        instanceId = 0;
+        closePidFd();
+#endif
+
+        closeStartPipes();
+        shm.clear();
+    }
+
+#ifndef CARLA_OS_WIN
+    void closePidFd() noexcept
+    {
+        if (pidfd == -1)
+            return;
+
+        try { ::close(pidfd); } CARLA_SAFE_EXCEPTION("close(pidfd)");
+        pidfd = -1;
+    }
+#endif
+
+    void closeStartPipes() noexcept
+    {
+        starting = false;
+#ifndef CARLA_OS_WIN
+        zygoteRequest = 0;
+#endif
+
+#ifdef CARLA_OS_WIN
+        if (startRecv != INVALID_PIPE_VALUE) {
+            try { ::CloseHandle(startRecv); } CARLA_SAFE_EXCEPTION("CloseHandle(startRecv)");
+        }
+        if (startSend != INVALID_PIPE_VALUE) {
+            try { ::CloseHandle(startSend); } CARLA_SAFE_EXCEPTION("CloseHandle(startSend)");
+        }
+#else
+        if (startRecv != INVALID_PIPE_VALUE) {
+            try { ::close(startRecv); } CARLA_SAFE_EXCEPTION("close(startRecv)");
+        }
+        if (startSend != INVALID_PIPE_VALUE) {
+            try { ::close(startSend); } CARLA_SAFE_EXCEPTION("close(startSend)");
+        }
+#endif
+        startRecv = startSend = INVALID_PIPE_VALUE;
+    }
+
+    /*
+     * Terminate the received line that ends at 'lineEnd' and mark it as consumed.
+     * Returns the start of the line.
+     */
+    const char* takeLine(char* const lineEnd) noexcept
+    {
+        char* const lineStart(recvBuf + recvBufStart);
+        const std::size_t lineSize(static_cast<std::size_t>(lineEnd - lineStart));
+
+        pipeStatsMax(stats.maxLineLength, lineSize);
+
+        *lineEnd = '\0';
+
+        recvBufStart = recvBufScan = static_cast<std::size_t>(lineEnd - recvBuf) + 1;
+
+        if (recvBufStart == recvBufEnd)
+            clearRecvBuffer();
+
+        for (char* c = lineStart; (c = (char*)std::memchr(c, '\r', lineSize - static_cast<std::size_t>(c - lineStart))) != nullptr; ++c)
+            *c = '\n';
+
+        return lineStart;
+    }
+
+    /*
+     * Get the next full line received in text mode, if any.
+     */
+    bool nextTextLine(const char*& line) noexcept
+    {
+        if (recvBufScan == recvBufEnd)
+            return false;
+
+        if (char* const lineEnd = (char*)std::memchr(recvBuf + recvBufScan, '\n', recvBufEnd - recvBufScan))
+        {
+            line = takeLine(lineEnd);
+            return true;
+        }
+
+        recvBufScan = recvBufEnd;
+        return false;
+    }
+
+    /*
+     * Check if the next line can be taken from the receive buffer without reading more.
+     * A partial message does not count, so waiting for the rest of it does not spin.
+     */
+    bool hasReceivedLine() const noexcept
+    {
+        if (! binaryMode)
+            return recvBufScan != recvBufEnd;
+
+        if (binaryControlLines != 0 || binaryAtomLines != 0 || binaryTextEnd != 0)
+            return true;
+
+        if (recvBufEnd - recvBufStart < sizeof(PipeBinaryHeader))
+            return false;
+
+        PipeBinaryHeader header;
+        std::memcpy(&header, recvBuf + recvBufStart, sizeof(PipeBinaryHeader));
+
+        if (header.size > kPipeBinaryMaxPayloadSize)
+            return true;
+
+        switch (header.opcode)
+        {
+        case kPipeBinaryOpText:
+        case kPipeBinaryOpAtom:
+            return recvBufEnd - recvBufStart >= sizeof(PipeBinaryHeader) + header.size;
+        default:
+            // control messages, or invalid data that the next read discards
+            return true;
+        }
+    }
+
+    /*
+     * Get the next line received in binary mode, if any.
+     * Control messages are handed out as the same 3 lines the text protocol uses.
+     */
+    bool nextBinaryLine(const char*& line) noexcept
+    {
+        switch (binaryControlLines)
+        {
+        case 3:
+            binaryControlLines = 2;
+            lineOpcode = CarlaPipeCommon::kPipeMsgControl;
+            line = "control";
+            return true;
+        case 2:
+            binaryControlLines = 1;
+            uintToChars(binaryLineBuf, binaryControlIndex);
+            line = binaryLineBuf;
+            return true;
+        case 1:
+            binaryControlLines = 0;
+            floatToChars(binaryLineBuf, binaryControlValue);
+            line = binaryLineBuf;
+            return true;
+        }
+
+        // header lines of an atom message
+        switch (binaryAtomLines)
+        {
+        case 4:
+            binaryAtomLines = 3;
+            lineOpcode = CarlaPipeCommon::kPipeMsgAtom;
+            line = "atom";
+            return true;
+        case 3:
+            binaryAtomLines = 2;
+            uintToChars(binaryLineBuf, binaryAtomIndex);
+            line = binaryLineBuf;
+            return true;
+        case 2:
+            binaryAtomLines = 1;
+            uintToChars(binaryLineBuf, binaryAtomSize);
+            line = binaryLineBuf;
+            return true;
+        case 1:
+            // only readNextLineAsAtom() can take the raw atom
+            carla_stderr2("CarlaPipeCommon - binary atom read as a line, skipping it");
+            takeBinaryAtom();
+            line = "";
+            return true;
+        }
+
+        // lines of the current text message
+        if (binaryTextEnd != 0)
+        {
+            if (char* const lineEnd = (char*)std::memchr(recvBuf + recvBufStart, '\n', binaryTextEnd - recvBufStart))
+            {
+                line = takeLine(lineEnd);
+
+                if (recvBufStart == binaryTextEnd)
+                    binaryTextEnd = 0;
+
+                return true;
+            }
+
+            carla_stderr2("CarlaPipeCommon - binary text message is not terminated, ignoring it");
+            recvBufStart = recvBufScan = binaryTextEnd;
+            binaryTextEnd = 0;
+        }
+
+        // start of a new message
+        PipeBinaryHeader header;
+
+        if (recvBufEnd - recvBufStart < sizeof(PipeBinaryHeader))
+            return false;
+
+        std::memcpy(&header, recvBuf + recvBufStart, sizeof(PipeBinaryHeader));
+
+        // waiting for such a payload would grow the receive buffer without limit
+        if (header.size > kPipeBinaryMaxPayloadSize)
+        {
+            carla_stderr2("CarlaPipeCommon - binary message size %u is too big, discarding received data", header.size);
+            clearRecvBuffer();
+            return false;
+        }
+
+        switch (header.opcode)
+        {
+        case kPipeBinaryOpControl:
+            recvBufStart = recvBufScan = recvBufStart + sizeof(PipeBinaryHeader);
+            binaryControlLines = 3;
+            binaryControlIndex = header.index;
+            binaryControlValue = header.value;
+            break;
+
+        case kPipeBinaryOpText:
+            if (recvBufEnd - recvBufStart < sizeof(PipeBinaryHeader) + header.size)
+                return false;
+            recvBufStart  = recvBufScan = recvBufStart + sizeof(PipeBinaryHeader);
+            binaryTextEnd = recvBufStart + header.size;
+            break;
+
+        case kPipeBinaryOpAtom:
+            if (recvBufEnd - recvBufStart < sizeof(PipeBinaryHeader) + header.size)
+                return false;
+            recvBufStart    = recvBufScan = recvBufStart + sizeof(PipeBinaryHeader);
+            binaryAtomLines = 4;
+            binaryAtomIndex = header.index;
+            binaryAtomSize  = header.size;
+            break;
+
+        default:
+            carla_stderr2("CarlaPipeCommon - invalid binary opcode %u, discarding received data", header.opcode);
+            clearRecvBuffer();
+            return false;
+        }
+
+        if (recvBufStart == recvBufEnd)
+            clearRecvBuffer();
+
+        return nextBinaryLine(line);
+    }
+
+    /*
+     * Take the raw atom of the current binary atom message from the receive buffer.
+     * The atom is used in place, only moved back over its consumed header when not 8-byte aligned.
+     * Returns null if the atom size does not match the payload.
+     */
+    LV2_Atom* takeBinaryAtom() noexcept
+    {
+        char* atomData(recvBuf + recvBufStart);
+        const std::size_t size(binaryAtomSize);
+
+        binaryAtomLines = 0;
+        recvBufStart = recvBufScan = recvBufStart + size;
+
+        if (const std::size_t misalignment = reinterpret_cast<uintptr_t>(atomData) % 8)
+        {
+            std::memmove(atomData - misalignment, atomData, size);
+            atomData -= misalignment;
+        }
+
+        LV2_Atom* const atom((LV2_Atom*)atomData);
+
+        CARLA_SAFE_ASSERT_RETURN(size >= sizeof(LV2_Atom), nullptr);
+        CARLA_SAFE_ASSERT_RETURN(lv2_atom_total_size(atom) == size, nullptr);
+
+        return atom;
+    }
+
+    /*
+     * Decode a base64 atom line received in text mode into atomBuf.
+     * Returns null if the line is not valid or the atom size does not match.
+     */
+    LV2_Atom* decodeAtom(const char* const line) noexcept
+    {
+        const std::size_t lineSize(std::strlen(line));
+        const std::size_t maxSize(carla_base64DecodedMaxSize(lineSize));
+
+        atomBuf.clear();
+        char* const atomData(atomBuf.reserve(maxSize));
+        CARLA_SAFE_ASSERT_RETURN(atomData != nullptr, nullptr);
+
+        std::size_t size = 0;
+        CARLA_SAFE_ASSERT_RETURN(carla_base64Decode(line, lineSize, atomData, maxSize, size), nullptr);
+
+        LV2_Atom* const atom((LV2_Atom*)atomData);
+
+        CARLA_SAFE_ASSERT_RETURN(size >= sizeof(LV2_Atom), nullptr);
+        CARLA_SAFE_ASSERT_RETURN(lv2_atom_total_size(atom) == size, nullptr);
+
+        return atom;
+    }
+
+    /*
+     * Make room for at least kRecvBufMinFree bytes after recvBufEnd.
+     * Pending data is moved to the front of the buffer first, the buffer only grows (doubling) if that is not enough.
+     */
+    bool prepareRecvBuffer() noexcept
+    {
+        static const std::size_t kRecvBufInitialSize = 0x4000;
+        static const std::size_t kRecvBufMinFree     = 0x1000;
+
+        if (recvBufSize - recvBufEnd >= kRecvBufMinFree)
+            return true;
+
+        if (recvBufStart != 0)
+        {
+            const std::size_t pending(recvBufEnd - recvBufStart);
+
+            std::memmove(recvBuf, recvBuf + recvBufStart, pending);
+
+            recvBufScan -= recvBufStart;
+            recvBufEnd   = pending;
+
+            if (binaryTextEnd != 0)
+                binaryTextEnd -= recvBufStart;
+
+            recvBufStart = 0;
+
+            if (recvBufSize - recvBufEnd >= kRecvBufMinFree)
+                return true;
+        }
+
+        const std::size_t newSize((recvBufSize != 0) ? recvBufSize*2 : kRecvBufInitialSize);
+
+        char* const newBuf((char*)std::realloc(recvBuf, newSize));
+        CARLA_SAFE_ASSERT_RETURN(newBuf != nullptr, false);
+
+        recvBuf     = newBuf;
+        recvBufSize = newSize;
+        return true;
+    }
+
+    /*
+     * Read as much as currently available into the receive buffer.
+     * Returns false if there was nothing to read.
+     */
+    bool readMore() noexcept
+    {
+        if (! prepareRecvBuffer())
+            return false;
+
+        ssize_t ret;
+
+        if (shm.active)
+        {
+            ret = static_cast<ssize_t>(shm.read(recvBuf + recvBufEnd, recvBufSize - recvBufEnd));
+        }
+        else
+        {
+            pipeStatsAdd(stats.readSyscalls, 1);
+
+            try {
+#ifdef CARLA_OS_WIN
+                ret = ::ReadFileNonBlock(pipeRecv, cancelEvent, recvBuf + recvBufEnd, recvBufSize - recvBufEnd);
+#else
+                ret = ::read(pipeRecv, recvBuf + recvBufEnd, recvBufSize - recvBufEnd);
+#endif
+            } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::readMore() - read", false);
+
+#ifndef CARLA_OS_WIN
+            if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                pipeStatsAdd(stats.readEagains, 1);
+#endif
+        }
+
+        if (ret <= 0)
+            return false;
+
+        pipeStatsAdd(stats.bytesIn, static_cast<uint64_t>(ret));
+        recvBufEnd += static_cast<std::size_t>(ret);
+        return true;
+    }
+
+    /*
+     * Sleep until more data can be read, or the timeout is reached.
+     * Returns false if no more data will arrive because the other side closed its end.
+     */
+    bool waitForData(const uint32_t timeOutMilliseconds) noexcept
+    {
+        if (shm.active)
+        {
+            shm.wait(timeOutMilliseconds);
+            return true;
+        }
+
+#ifdef CARLA_OS_WIN
+        carla_msleep(timeOutMilliseconds < 5 ? timeOutMilliseconds : 5);
+        return true;
+#else
+        return waitForPipeData(pipeRecv, timeOutMilliseconds);
+#endif
+    }
+
+    /*
+     * Get the descriptor to poll() for more data, see CarlaPipeCommon::preparePipeWait().
+     */
+    int prepareWait() noexcept
+    {
+        if (hasReceivedLine())
+            return -1;
+
+        if (shm.active)
+            return shm.prepareWait() ? shm.getRecvEvent() : -1;
+
+#ifdef CARLA_OS_WIN
+        return -1;
+#else
+        return pipeRecv;
+#endif
+    }
+
+    void finishWait() noexcept
+    {
+        if (shm.active)
+            shm.finishWait();
+    }
+
+    /*
+     * Write data to the other side, or to the output buffer when in that mode.
+     */
+    bool writeBytes(const void* const buf, const std::size_t size) noexcept
+    {
+        pipeStatsAdd(stats.messagesOut, 1);
+
+        // while there is a backlog messages are queued one by one, so the policies can apply to each.
+        // the output buffer is always empty at this point, see drainSendBuf().
+        if (! outputBuffered || (nonBlockingSend && ! flushBacklog()))
+            return writeRaw(buf, size);
+
+        if (sendBuf.used == 0)
+            sendBufTime = getMillisecondCounter();
+
+        return sendBuf.append(buf, size);
+    }
+
+    /*
+     * Write everything in the output buffer using a single write.
+     */
+    bool drainSendBuf() noexcept
+    {
+        if (sendBuf.used == 0)
+            return true;
+
+        ++outputStats.flushes;
+
+        // the buffer mixes all kinds of messages, so it can not be dropped as a whole.
+        // it is only used while there is no backlog, see writeBytes().
+        const uint32_t kind(msgKind);
+        msgKind = kPipeMessageCritical;
+
+        const bool ret(writeRaw(sendBuf.data, sendBuf.used));
+        sendBuf.clear();
+
+        msgKind = kind;
+        return ret;
+    }
+
+    /*
+     * Write raw data to the pipe, or to shared memory if active.
+     */
+    bool writeRaw(const void* const buf, const std::size_t size) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(pipeSend != INVALID_PIPE_VALUE, false);
+
+        outputStats.bytes += size;
+
+        if (nonBlockingSend)
+            return writeOrQueue(buf, size);
+
+        const uint64_t start(startWrite());
+
+        if (shm.active)
+        {
+            const bool ok(shm.write(buf, size, pipeSend));
+            finishWrite(start, ok ? size : 0);
+            return ok;
+        }
+
+        ++outputStats.syscalls;
+        pipeStatsAdd(stats.writeSyscalls, 1);
+
+        ssize_t ret;
+
+        try {
+#ifdef CARLA_OS_WIN
+            //ret = ::WriteFileBlock(pipeSend, buf, size);
+            ret = ::WriteFileNonBlock(pipeSend, cancelEvent, buf, size);
+#else
+            ret = ::write(pipeSend, buf, size);
+#endif
+        } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::writeRaw", false);
+
+        finishWrite(start, ret > 0 ? static_cast<std::size_t>(ret) : 0);
+        return (ret == static_cast<ssize_t>(size));
+    }
+
+    /*
+     * Get the start time of a write, for the write time histogram.
+     * Reading the clock costs about as much as a small write to shared memory, so only some writes are timed.
+     * Returns 0 if this one is not.
+     */
+    uint64_t startWrite() noexcept
+    {
+        if ((++writeTimeSample & (kPipeStatsWriteSampling - 1)) != 0)
+            return 0;
+
+        return getMicrosecondCounter();
+    }
+
+    /*
+     * Account for a write to the other side, @a start is the value from startWrite().
+     */
+    void finishWrite(const uint64_t start, const std::size_t written) noexcept
+    {
+        pipeStatsAdd(stats.bytesOut, written);
+
+        if (start != 0)
+            pipeStatsHistogram(stats.writeTime, getMicrosecondCounter() - start);
+    }
+
+    /*
+     * Append message data to the message being assembled.
+     */
+    bool appendMsg(const char* const msg, const std::size_t size) noexcept
+    {
+        if (binaryMode && msgBuf.used == 0)
+        {
+            const PipeBinaryHeader header = { kPipeBinaryOpText, 0, 0.0f, 0 };
+
+            if (! msgBuf.append(&header, sizeof(PipeBinaryHeader)))
+                return false;
+        }
+
+        return msgBuf.append(msg, size);
+    }
+
+    /*
+     * Send the message assembled so far, if any, as a single write.
+     */
+    bool sendMsgBuf() noexcept
+    {
+        if (msgBuf.used == 0)
+            return true;
+
+        if (binaryMode)
+        {
+            CARLA_SAFE_ASSERT_RETURN(msgBuf.used > sizeof(PipeBinaryHeader), false);
+
+            if (msgBuf.used - sizeof(PipeBinaryHeader) > kPipeBinaryMaxPayloadSize)
+            {
+                carla_stderr2("CarlaPipeCommon - message of " P_SIZE " bytes is too big, dropping it",
+                              msgBuf.used - sizeof(PipeBinaryHeader));
+                msgBuf.clear();
+                msgKind = kPipeMessageNormal;
+                return false;
+            }
+
+            PipeBinaryHeader header;
+            header.opcode = kPipeBinaryOpText;
+            header.index  = 0;
+            header.value  = 0.0f;
+            header.size   = static_cast<uint32_t>(msgBuf.used - sizeof(PipeBinaryHeader));
+            std::memcpy(msgBuf.data, &header, sizeof(PipeBinaryHeader));
+        }
+
+        const bool ret(writeBytes(msgBuf.data, msgBuf.used));
+        msgBuf.clear();
+        msgKind = kPipeMessageNormal;
+        return ret;
+    }
+
+    // -------------------------------------------------------------------
+    // non-blocking send
+
+    /*
+     * Write as much as possible without blocking.
+     * Returns the number of bytes written, or -1 if the other side is gone.
+     */
+    ssize_t writeSome(const void* const buf, const std::size_t size) noexcept
+    {
+        const uint64_t start(startWrite());
+
+        if (shm.active)
+        {
+            const std::size_t written(shm.writeSome(buf, size));
+            finishWrite(start, written);
+            return static_cast<ssize_t>(written);
+        }
+
+        ++outputStats.syscalls;
+        pipeStatsAdd(stats.writeSyscalls, 1);
+
+        ssize_t ret;
+
+        try {
+#ifdef CARLA_OS_WIN
+            ret = ::WriteFileNonBlock(pipeSend, cancelEvent, buf, size);
+#else
+            ret = ::write(pipeSend, buf, size);
+#endif
+        } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::writeSome", -1);
+
+        finishWrite(start, ret > 0 ? static_cast<std::size_t>(ret) : 0);
+
+#ifndef CARLA_OS_WIN
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            pipeStatsAdd(stats.writeEagains, 1);
+            return 0;
+        }
+#endif
+
+        return ret;
+    }
+
+    /*
+     * Sleep until the other side might be able to take more data, or the timeout is reached.
+     */
+    void waitForWritable(const uint32_t timeOutMilliseconds) noexcept
+    {
+#ifndef CARLA_OS_WIN
+        if (! shm.active)
+        {
+            struct pollfd pfd;
+            pfd.fd      = pipeSend;
+            pfd.events  = POLLOUT;
+            pfd.revents = 0;
+
+            try {
+                ::poll(&pfd, 1, static_cast<int>(timeOutMilliseconds));
+            } CARLA_SAFE_EXCEPTION("poll");
+            return;
+        }
+
+        shm.waitForSpace(1, timeOutMilliseconds);
+#else
+        carla_msleep(timeOutMilliseconds < 1 ? timeOutMilliseconds : 1);
+#endif
+    }
+
+#ifndef CARLA_OS_WIN
+    /*
+     * Wait for the client to close its end of the pipes, discarding anything it still sends.
+     * Used for clients hosted by a shared zygote, which is not expected to exit.
+     */
+    void waitForClientToClose(const uint32_t timeOutMilliseconds) noexcept
+    {
+        // still starting, closing the pipes is enough for it to go
+        if (pipeRecv == INVALID_PIPE_VALUE)
+            return;
+
+        char buf[0x1000];
+
+        for (const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);;)
+        {
+            const uint32_t now(getMillisecondCounter());
+
+            if (now >= timeoutEnd)
+            {
+                carla_stderr("waitForClientToClose() - timed out");
+                return;
+            }
+
+            if (! waitForPipeData(pipeRecv, timeoutEnd - now))
+                return;
+
+            ssize_t ret;
+
+            try {
+                ret = ::read(pipeRecv, buf, sizeof(buf));
+            } CARLA_SAFE_EXCEPTION_RETURN("read",);
+
+            if (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                return;
+        }
+    }
+#endif
+
+    bool hasBacklog() const noexcept
+    {
+        return backlogWritten != backlog.used;
+    }
+
+    PipeBacklogEntry* getBacklogEntries() const noexcept
+    {
+        return (PipeBacklogEntry*)backlogEntries.data;
+    }
+
+    std::size_t getBacklogEntryCount() const noexcept
+    {
+        return backlogEntries.used / sizeof(PipeBacklogEntry);
+    }
+
+    void clearBacklog() noexcept
+    {
+        backlog.clear();
+        backlogEntries.clear();
+        backlogWritten = 0;
+        backlogEntryPos = 0;
+        backlogDeadCount = 0;
+        outputStats.backlogSize = 0;
+    }
+
+    /*
+     * Write as much of the backlog as the other side takes.
+     * Returns true if the backlog is empty afterwards.
+     */
+    bool flushBacklog() noexcept
+    {
+        if (! hasBacklog())
+            return true;
+
+        PipeBacklogEntry* const entries(getBacklogEntries());
+        const std::size_t entryCount(getBacklogEntryCount());
+
+        for (; backlogEntryPos < entryCount;)
+        {
+            // skip replaced messages, then write the run of messages after them in one go
+            if (entries[backlogEntryPos].kind == kPipeMessageDead)
+            {
+                backlogWritten = entries[backlogEntryPos].offset + entries[backlogEntryPos].size;
+                ++backlogEntryPos;
+                --backlogDeadCount;
+                continue;
+            }
+
+            std::size_t runEnd(backlogEntryPos);
+
+            for (; runEnd < entryCount && entries[runEnd].kind != kPipeMessageDead; ++runEnd) {}
+
+            const std::size_t endOffset(entries[runEnd-1].offset + entries[runEnd-1].size);
+            const ssize_t ret(writeSome(backlog.data + backlogWritten, endOffset - backlogWritten));
+
+            if (ret < 0)
+            {
+                clearBacklog();
+                return false;
+            }
+
+            backlogWritten += static_cast<std::size_t>(ret);
+
+            for (; backlogEntryPos < runEnd && entries[backlogEntryPos].offset + entries[backlogEntryPos].size <= backlogWritten;)
+                ++backlogEntryPos;
+
+            if (backlogWritten != endOffset)
+            {
+                outputStats.backlogSize = backlog.used - backlogWritten;
+                return false;
+            }
+        }
+
+        clearBacklog();
+        return true;
+    }
+
+    /*
+     * Remove written and replaced messages from the backlog, making room for new ones.
+     */
+    void compactBacklog() noexcept
+    {
+        PipeBacklogEntry* const entries(getBacklogEntries());
+        const std::size_t entryCount(getBacklogEntryCount());
+
+        std::size_t newUsed(0), newCount(0);
+
+        for (std::size_t i=backlogEntryPos; i < entryCount; ++i)
+        {
+            PipeBacklogEntry entry(entries[i]);
+
+            if (entry.kind == kPipeMessageDead)
+                continue;
+
+            // the first message might be partially written already
+            if (entry.offset < backlogWritten)
+            {
+                entry.size  -= backlogWritten - entry.offset;
+                entry.offset = backlogWritten;
+            }
+
+            std::memmove(backlog.data + newUsed, backlog.data + entry.offset, entry.size);
+            entry.offset = newUsed;
+            newUsed += entry.size;
+            entries[newCount++] = entry;
+        }
+
+        backlog.used = newUsed;
+        backlogEntries.used = newCount * sizeof(PipeBacklogEntry);
+        backlogWritten = 0;
+        backlogEntryPos = 0;
+        backlogDeadCount = 0;
+    }
+
+    /*
+     * Add a message to the backlog, applying the overflow policies for its kind.
+     */
+    bool queueMessage(const void* const buf, const std::size_t size, const uint32_t kind) noexcept
+    {
+        if (kind == kPipeMessageControl && (backlogPolicy & CarlaPipeCommon::kSendBacklogCoalesceControls) != 0)
+        {
+            PipeBacklogEntry* const entries(getBacklogEntries());
+            const std::size_t entryCount(getBacklogEntryCount());
+
+            for (std::size_t i=backlogEntryPos; i < entryCount; ++i)
+            {
+                PipeBacklogEntry& entry(entries[i]);
+
+                if (entry.kind != kPipeMessageControl || entry.index != msgIndex || entry.offset < backlogWritten)
+                    continue;
+
+                entry.kind = kPipeMessageDead;
+                ++outputStats.coalesced;
+                ++backlogDeadCount;
+                break;
+            }
+
+            // a stalled reader leaves replaced messages piling up, keep them from slowing down the search above
+            if (backlogDeadCount >= kBacklogCompactMinDead && backlogDeadCount * 2 > entryCount - backlogEntryPos)
+                compactBacklog();
+        }
+
+        if (kind != kPipeMessageCritical && backlog.used - backlogWritten + size > backlogMaxSize)
+        {
+            compactBacklog();
+
+            // a single message bigger than the backlog still goes in, once it is empty
+            for (; hasBacklog() && backlog.used + size > backlogMaxSize;)
+            {
+                if ((backlogPolicy & CarlaPipeCommon::kSendBacklogDropOnOverflow) != 0)
+                {
+                    ++outputStats.dropped;
+                    return true;
+                }
+
+                // wait for the other side, like a blocking write would
+                waitForWritable(50);
+
+                if (! flushBacklog() && ! hasBacklog())
+                    return false;
+
+                compactBacklog();
+            }
+        }
+        else if (backlog.used + size > backlogMaxSize)
+        {
+            compactBacklog();
+        }
+
+        const PipeBacklogEntry entry = { backlog.used, size, kind, msgIndex };
+
+        if (! backlog.append(buf, size))
+            return false;
+        if (! backlogEntries.append(&entry, sizeof(PipeBacklogEntry)))
+            return false;
+
+        outputStats.backlogSize = backlog.used - backlogWritten;
+
+        if (outputStats.backlogSize > outputStats.backlogPeak)
+            outputStats.backlogPeak = outputStats.backlogSize;
+
+        return true;
+    }
+
+    /*
+     * Write without blocking, queueing whatever the other side can not take yet.
+     */
+    bool writeOrQueue(const void* const buf, const std::size_t size) noexcept
+    {
+        if (! flushBacklog())
+        {
+            if (! hasBacklog())
+                return false;
+
+            return queueMessage(buf, size, msgKind);
+        }
+
+        const ssize_t ret(writeSome(buf, size));
+
+        if (ret < 0)
+            return false;
+        if (static_cast<std::size_t>(ret) == size)
+            return true;
+
+        // the rest of a partially written message must go out as-is
+        return queueMessage((const uint8_t*)buf + ret, size - static_cast<std::size_t>(ret),
+                            ret == 0 ? msgKind : static_cast<uint32_t>(kPipeMessageCritical));
+    }
+
+    /*
+     * Scoped write lock, like CarlaMutexLocker but going through lockWrite().
+     */
+    struct WriteLocker {
+        WriteLocker(PrivateData* const data) noexcept
+            : pData(data)
+        {
+            pData->lockWrite();
+        }
+
+        ~WriteLocker() noexcept
+        {
+            pData->unlockWrite();
+        }
+
+    private:
+        PrivateData* const pData;
+
+        CARLA_DECLARE_NON_COPY_STRUCT(WriteLocker)
+    };
+
+    CARLA_DECLARE_NON_COPY_STRUCT(PrivateData)
+};
+
+// -----------------------------------------------------------------------
+
+CarlaPipeCommon::CarlaPipeCommon() noexcept
+    : pData(new PrivateData())
+{
+    carla_debug("CarlaPipeCommon::CarlaPipeCommon()");
+}
+
+CarlaPipeCommon::~CarlaPipeCommon() /*noexcept*/
+{
+    carla_debug("CarlaPipeCommon::~CarlaPipeCommon()");
+
+    delete pData;
+}
+
+// -------------------------------------------------------------------
+
+CarlaPipeCommon::MsgOpcode CarlaPipeCommon::getMsgOpcode(const char* const msg) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(msg != nullptr, kPipeMsgUnknown);
+
+    const std::size_t size(std::strlen(msg));
+
+    if (size == 0)
+        return kPipeMsgUnknown;
+
+    // empty slots have a size of 0, so they never match
+    const PipeMsgKeyword& keyword(kPipeMsgTable[pipeMsgHash(msg, size)]);
+
+    if (keyword.size != size || std::memcmp(keyword.name, msg, size) != 0)
+        return kPipeMsgUnknown;
+
+    return keyword.opcode;
+}
+
+bool CarlaPipeCommon::msgReceived(const char* const) noexcept
+{
+    return false;
+}
+
+void CarlaPipeCommon::setMsgHandler(const MsgOpcode opcode, const MsgHandler handler) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(opcode > kPipeMsgUnknown && opcode < kPipeMsgCount,);
+
+    pData->msgHandlers[opcode] = handler;
+}
+
+// -------------------------------------------------------------------
+
+bool CarlaPipeCommon::isPipeRunning() const noexcept
+{
+    return (pData->pipeRecv != INVALID_PIPE_VALUE && pData->pipeSend != INVALID_PIPE_VALUE);
+}
+
+void CarlaPipeCommon::setPipeBinaryModeAllowed(const bool allowed) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(! isPipeRunning(),);
+
+    pData->binaryModeAllowed = allowed;
+}
+
+bool CarlaPipeCommon::isPipeInBinaryMode() const noexcept
+{
+    return pData->binaryMode;
+}
+
+void CarlaPipeCommon::setPipeSharedMemoryAllowed(const bool allowed) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(! isPipeRunning(),);
+
+    pData->shmAllowed = allowed;
+}
+
+bool CarlaPipeCommon::isPipeUsingSharedMemory() const noexcept
+{
+    return pData->shm.active;
+}
+
+void CarlaPipeCommon::setPipeOutputBuffered(const bool buffered) noexcept
+{
+    const PrivateData::WriteLocker cml(pData);
+
+    if (pData->outputBuffered && ! buffered && pData->pipeSend != INVALID_PIPE_VALUE)
+        pData->drainSendBuf();
+
+    pData->outputBuffered = buffered;
+}
+
+void CarlaPipeCommon::getPipeOutputStats(OutputStats& stats) const noexcept
+{
+    const PrivateData::WriteLocker cml(pData);
+
+    stats = pData->outputStats;
+}
+
+void CarlaPipeCommon::getPipeStats(PipeStats& stats) const noexcept
+{
+    const uint64_t* const src = (const uint64_t*)&pData->stats;
+    uint64_t* const dst = (uint64_t*)&stats;
+
+    for (std::size_t i = 0; i < sizeof(PipeStats) / sizeof(uint64_t); ++i)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+static void dumpPipeStatsHistogram(FILE* const file, const char* const name, const uint64_t* const histogram) noexcept
+{
+    std::fprintf(file, " %s=", name);
+
+    for (uint i = 0; i < CarlaPipeCommon::kPipeStatsHistogramSize; ++i)
+        std::fprintf(file, i == 0 ? P_UINT64 : "," P_UINT64, histogram[i]);
+}
+
+void CarlaPipeCommon::dumpPipeStats(FILE* const file) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(file != nullptr,);
+
+    PipeStats stats;
+    getPipeStats(stats);
+
+#ifdef CARLA_OS_WIN
+    const ulong pid = ::GetCurrentProcessId();
+#else
+    const ulong pid = static_cast<ulong>(::getpid());
+#endif
+
+    std::fprintf(file, "carla-pipe pid=%lu pipe=%p"
+                 " msgs_in=" P_UINT64 " msgs_out=" P_UINT64 " bytes_in=" P_UINT64 " bytes_out=" P_UINT64
+                 " read_syscalls=" P_UINT64 " write_syscalls=" P_UINT64
+                 " read_eagain=" P_UINT64 " write_eagain=" P_UINT64 " read_timeouts=" P_UINT64
+                 " lock_waits=" P_UINT64 " lock_wait_us=" P_UINT64 " max_line=" P_UINT64,
+                 pid, (const void*)this,
+                 stats.messagesIn, stats.messagesOut, stats.bytesIn, stats.bytesOut,
+                 stats.readSyscalls, stats.writeSyscalls,
+                 stats.readEagains, stats.writeEagains, stats.readTimeouts,
+                 stats.lockWaits, stats.lockWaitTimeTotal, stats.maxLineLength);
+
+    dumpPipeStatsHistogram(file, "read_us_log2", stats.readTime);
+    dumpPipeStatsHistogram(file, "write_us_log2", stats.writeTime);
+    dumpPipeStatsHistogram(file, "lock_wait_us_log2", stats.lockWaitTime);
+
+    std::fputc('\n', file);
+    std::fflush(file);
+}
+
+void CarlaPipeCommon::setPipeSingleWriter(const bool singleWriter) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(! isPipeRunning(),);
+
+    pData->singleWriter = singleWriter;
+#ifdef DEBUG
+    pData->singleWriterThread = 0;
+#endif
+}
+
+void CarlaPipeCommon::setPipeNonBlockingSend(const bool nonBlocking, const std::size_t maxBacklogSize, const uint policy) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(! isPipeRunning(),);
+
+#ifndef CARLA_OS_WIN
+    pData->nonBlockingSend = nonBlocking;
+    pData->backlogMaxSize  = maxBacklogSize;
+    pData->backlogPolicy   = policy;
+#else
+    // pipes are always written in blocking mode here
+    (void)nonBlocking;
+    (void)maxBacklogSize;
+    (void)policy;
+#endif
+}
+
+bool CarlaPipeCommon::waitForPipeMessages(const uint32_t timeOutMilliseconds) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->pipeRecv != INVALID_PIPE_VALUE, false);
+
+    // lines already received but not handled yet
+    if (pData->hasReceivedLine())
+        return true;
+
+    return pData->waitForData(timeOutMilliseconds);
+}
+
+int CarlaPipeCommon::preparePipeWait() const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->pipeRecv != INVALID_PIPE_VALUE, -1);
+
+    return pData->prepareWait();
+}
+
+void CarlaPipeCommon::finishPipeWait() const noexcept
+{
+    pData->finishWait();
+}
+
+void CarlaPipeCommon::idlePipe(const bool onlyOnce) noexcept
+{
+    const CarlaTraceScope cts("idlePipe");
+
+    // numbers are parsed without the current locale, so there is no need to switch it here
+    for (;;)
+    {
+        pData->lineOpcode = kPipeMsgUnknown;
+
+        const char* const msg(_readline(false));
+
+        if (msg == nullptr)
+            break;
+
+        pData->isReading = true;
+        pipeStatsAdd(pData->stats.messagesIn, 1);
+
+        // binary messages already know their opcode, text ones are looked up by keyword
+        const MsgOpcode opcode(pData->lineOpcode != kPipeMsgUnknown ? pData->lineOpcode : getMsgOpcode(msg));
+        const MsgHandler handler(pData->msgHandlers[opcode]);
+
+        carla_trace_begin("msgReceived");
+
+        // a declining handler might have read lines, moving the receive buffer 'msg' points into
+        try {
+            if (handler == nullptr)
+                msgReceived(msg);
+            else if (! (this->*handler)())
+                msgReceived(getPipeMsgKeyword(opcode));
+        } CARLA_SAFE_EXCEPTION("msgReceived");
+
+        carla_trace_end("msgReceived");
+
+        pData->isReading = false;
+
+        if (onlyOnce)
+            break;
+    }
+
+    if (pData->statsDumpInterval != 0)
+    {
+        const uint32_t now(getMillisecondCounter());
+
+        if (now >= pData->statsNextDump)
+        {
+            if (pData->statsNextDump != 0)
+                dumpPipeStats(pData->statsDumpFile);
+
+            pData->statsNextDump = now + pData->statsDumpInterval;
+        }
+    }
+}
+
+// -------------------------------------------------------------------
+
+void CarlaPipeCommon::lockPipe() const noexcept
+{
+    pData->lockWrite();
+}
+
+bool CarlaPipeCommon::tryLockPipe() const noexcept
+{
+    return pData->tryLockWrite();
+}
+
+void CarlaPipeCommon::unlockPipe() const noexcept
+{
+    pData->unlockWrite();
+}
+
+CarlaMutex& CarlaPipeCommon::getPipeLock() const noexcept
+{
+    return pData->writeLock;
+}
+
+// -------------------------------------------------------------------
+
+bool CarlaPipeCommon::readNextLineAsBool(bool& value) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+
+    if (const char* const msg = _readlineblock(false))
+    {
+        value = (std::strcmp(msg, "true") == 0);
+        return true;
+    }
+
+    return false;
+}
+
+bool CarlaPipeCommon::readNextLineAsByte(uint8_t& value) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+
+    if (const char* const msg = _readlineblock(false))
+    {
+        uint64_t tmp;
+
+        if (charsToUInt(msg, tmp) && tmp <= 0xFF)
+        {
+            value = static_cast<uint8_t>(tmp);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CarlaPipeCommon::readNextLineAsInt(int32_t& value) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+
+    if (pData->binaryControlLines == 2)
+    {
+        pData->binaryControlLines = 1;
+        value = static_cast<int32_t>(pData->binaryControlIndex);
+        return true;
+    }
+
+    if (const char* const msg = _readlineblock(false))
+    {
+        int64_t tmp;
+
+        if (charsToInt(msg, tmp) && tmp >= INT32_MIN && tmp <= INT32_MAX)
+        {
+            value = static_cast<int32_t>(tmp);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CarlaPipeCommon::readNextLineAsUInt(uint32_t& value) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+
+    // binary control message, no need to go through text
+    if (pData->binaryControlLines == 2)
+    {
+        pData->binaryControlLines = 1;
+        value = pData->binaryControlIndex;
+        return true;
+    }
+
+    if (const char* const msg = _readlineblock(false))
+    {
+        uint64_t tmp;
+
+        if (charsToUInt(msg, tmp) && tmp <= UINT32_MAX)
         {
             value = static_cast<uint32_t>(tmp);
             return true;
@@ -685,11 +3936,15 @@ bool CarlaPipeCommon::readNextLineAsLong(int64_t& value) const noexcept
 {
     CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
 
-    if (const char* const msg = _readlineblock())
+    if (const char* const msg = _readlineblock(false))
     {
-        value = std::atol(msg);
-        delete[] msg;
-        return true;
+        int64_t tmp;
+
+        if (charsToInt(msg, tmp))
+        {
+            value = tmp;
+            return true;
+        }
     }
 
     return false;
@@ -699,14 +3954,13 @@ bool CarlaPipeCommon::readNextLineAsULong(uint64_t& value) const noexcept
 {
     CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
 
-    if (const char* const msg = _readlineblock())
+    if (const char* const msg = _readlineblock(false))
     {
-        int64_t tmp = std::atol(msg);
-        delete[] msg;
+        uint64_t tmp;
 
-        if (tmp >= 0)
+        if (charsToUInt(msg, tmp))
         {
-            value = static_cast<uint64_t>(tmp);
+            value = tmp;
             return true;
         }
     }
@@ -718,13 +3972,25 @@ bool CarlaPipeCommon::readNextLineAsFloat(float& value) const noexcept
 {
     CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
 
-    if (const char* const msg = _readlineblock())
+    // binary control message, no need to go through text
+    if (pData->binaryControlLines == 1)
     {
-        value = static_cast<float>(std::atof(msg));
-        delete[] msg;
+        pData->binaryControlLines = 0;
+        value = pData->binaryControlValue;
         return true;
     }
 
+    if (const char* const msg = _readlineblock(false))
+    {
+        double tmp;
+
+        if (charsToDouble(msg, tmp))
+        {
+            value = static_cast<float>(tmp);
+            return true;
+        }
+    }
+
     return false;
 }
 
@@ -732,21 +3998,37 @@ bool CarlaPipeCommon::readNextLineAsDouble(double& value) const noexcept
 {
     CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
 
-    if (const char* const msg = _readlineblock())
+    if (pData->binaryControlLines == 1)
     {
-        value = std::atof(msg);
-        delete[] msg;
+        pData->binaryControlLines = 0;
+        value = pData->binaryControlValue;
         return true;
     }
 
+    if (const char* const msg = _readlineblock(false))
+    {
+        double tmp;
+
+        if (charsToDouble(msg, tmp))
+        {
+            value = tmp;
+            return true;
+        }
+    }
+
     return false;
 }
 
 bool CarlaPipeCommon::readNextLineAsString(const char*& value) const noexcept
+{
+    return readNextLineAsString(value, true);
+}
+
+bool CarlaPipeCommon::readNextLineAsString(const char*& value, const bool allocateString) const noexcept
 {
     CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
 
-    if (const char* const msg = _readlineblock())
+    if (const char* const msg = _readlineblock(allocateString))
     {
         value = msg;
         return true;
@@ -755,6 +4037,36 @@ bool CarlaPipeCommon::readNextLineAsString(const char*& value) const noexcept
     return false;
 }
 
+bool CarlaPipeCommon::readNextLineAsAtom(LV2_Atom*& atom) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+
+    if (pData->binaryAtomLines == 1)
+    {
+        atom = pData->takeBinaryAtom();
+        return (atom != nullptr);
+    }
+
+    if (const char* const msg = _readlineblock(false))
+    {
+        atom = pData->decodeAtom(msg);
+        return (atom != nullptr);
+    }
+
+    return false;
+}
+
+bool CarlaPipeCommon::readNextLineAsBase64(void* const buffer, const std::size_t bufferSize, std::size_t& size) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(pData->isReading, false);
+    CARLA_SAFE_ASSERT_RETURN(buffer != nullptr, false);
+
+    if (const char* const msg = _readlineblock(false))
+        return carla_base64Decode(msg, std::strlen(msg), buffer, bufferSize, size);
+
+    return false;
+}
+
 // -------------------------------------------------------------------
 // must be locked before calling
 
@@ -784,326 +4096,758 @@ bool CarlaPipeCommon::writeAndFixMessage(const char* const msg) const noexcept
 
     const std::size_t size(std::strlen(msg));
 
-    char fixedMsg[size+2];
+    if (size == 0)
+        return _writeMsgBuffer("\n", 1);
+
+    // append as-is, then fix the copy in place
+    if (! _writeMsgBuffer(msg, size))
+        return false;
+
+    char* const fixedMsg(pData->msgBuf.data + pData->msgBuf.used - size);
+
+    for (char* c = fixedMsg; (c = (char*)std::memchr(c, '\n', size - static_cast<std::size_t>(c - fixedMsg))) != nullptr; ++c)
+        *c = '\r';
+
+    if (fixedMsg[size-1] == '\r')
+    {
+        fixedMsg[size-1] = '\n';
+        return true;
+    }
+
+    return _writeMsgBuffer("\n", 1);
+}
+
+bool CarlaPipeCommon::flushMessages() const noexcept
+{
+#ifdef DEBUG
+    CARLA_SAFE_ASSERT_RETURN(pData->isWriteOwner(), false);
+#endif
+
+    CARLA_SAFE_ASSERT_RETURN(pData->pipeSend != INVALID_PIPE_VALUE, false);
+
+    if (! pData->sendMsgBuf())
+        return false;
+
+    if (pData->outputBuffered)
+    {
+        static const std::size_t kSendBufDrainSize = 0x4000;
+        static const uint32_t    kSendBufDrainAge  = 10; // ms
+
+        if (pData->sendBuf.used < kSendBufDrainSize && getMillisecondCounter() - pData->sendBufTime < kSendBufDrainAge)
+            return true;
+
+        return pData->drainSendBuf();
+    }
+
+    // everything was written already, there is nothing to sync for pipes or shared memory
+    ++pData->outputStats.flushes;
+
+#ifdef CARLA_OS_WIN
+    if (! pData->shm.active)
+    {
+        try {
+            return (::FlushFileBuffers(pData->pipeSend) != FALSE);
+        } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::flushMessages", false);
+    }
+#endif
+
+    return true;
+}
+
+bool CarlaPipeCommon::drainMessages() const noexcept
+{
+    const PrivateData::WriteLocker cml(pData);
+
+    if (pData->pipeSend == INVALID_PIPE_VALUE)
+        return false;
+
+    if (! pData->sendMsgBuf())
+        return false;
+
+    if (! pData->drainSendBuf())
+        return false;
+
+    pData->flushBacklog();
+    return true;
+}
+
+// -------------------------------------------------------------------
+
+void CarlaPipeCommon::writeErrorMessage(const char* const error) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(error != nullptr && error[0] != '\0',);
+
+    const PrivateData::WriteLocker cml(pData);
+    _writeMsgBuffer("error\n", 6);
+    writeAndFixMessage(error);
+    flushMessages();
+}
 
-    if (size > 0)
+void CarlaPipeCommon::writeControlMessage(const uint32_t index, const float value) const noexcept
+{
+    if (pData->binaryMode)
     {
-        std::strcpy(fixedMsg, msg);
+        const PipeBinaryHeader header = { kPipeBinaryOpControl, index, value, 0 };
 
-        for (std::size_t i=0; i<size; ++i)
+        const PrivateData::WriteLocker cml(pData);
+
+        // keep ordering in case someone left a message unflushed
+        if (pData->sendMsgBuf())
         {
-            if (fixedMsg[i] == '\n')
-                fixedMsg[i] = '\r';
+            pData->msgKind  = kPipeMessageControl;
+            pData->msgIndex = index;
+            pData->writeBytes(&header, sizeof(PipeBinaryHeader));
+            pData->msgKind  = kPipeMessageNormal;
         }
 
-        if (fixedMsg[size-1] == '\r')
+        flushMessages();
+        return;
+    }
+
+    PipeMessageBuilder msg;
+    msg.addLine("control", 7);
+    msg.addUIntLine(index);
+    msg.addFloatLine(value);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    _writeMsgBuffer(msg.buf, msg.size());
+
+    pData->msgKind  = kPipeMessageControl;
+    pData->msgIndex = index;
+    flushMessages();
+}
+
+void CarlaPipeCommon::writeConfigureMessage(const char* const key, const char* const value) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(key != nullptr && key[0] != '\0',);
+    CARLA_SAFE_ASSERT_RETURN(value != nullptr,);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    _writeMsgBuffer("configure\n", 10);
+
+    {
+        writeAndFixMessage(key);
+        writeAndFixMessage(value);
+    }
+
+    flushMessages();
+}
+
+void CarlaPipeCommon::writeProgramMessage(const uint32_t index) const noexcept
+{
+    PipeMessageBuilder msg;
+    msg.addLine("program", 7);
+    msg.addUIntLine(index);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    _writeMsgBuffer(msg.buf, msg.size());
+
+    flushMessages();
+}
+
+void CarlaPipeCommon::writeMidiProgramMessage(const uint32_t bank, const uint32_t program) const noexcept
+{
+    PipeMessageBuilder msg;
+    msg.addLine("midiprogram", 11);
+    msg.addUIntLine(bank);
+    msg.addUIntLine(program);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    _writeMsgBuffer(msg.buf, msg.size());
+
+    flushMessages();
+}
+
+void CarlaPipeCommon::writeMidiNoteMessage(const bool onOff, const uint8_t channel, const uint8_t note, const uint8_t velocity) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(channel < MAX_MIDI_CHANNELS,);
+    CARLA_SAFE_ASSERT_RETURN(note < MAX_MIDI_NOTE,);
+    CARLA_SAFE_ASSERT_RETURN(velocity < MAX_MIDI_VALUE,);
+
+    PipeMessageBuilder msg;
+    msg.addLine("note", 4);
+    msg.addLine(bool2str(onOff), onOff ? 4 : 5);
+    msg.addUIntLine(channel);
+    msg.addUIntLine(note);
+    msg.addUIntLine(velocity);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    _writeMsgBuffer(msg.buf, msg.size());
+
+    flushMessages();
+}
+
+void CarlaPipeCommon::writeLv2AtomMessage(const uint32_t index, const LV2_Atom* const atom) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(atom != nullptr,);
+
+    const uint32_t atomTotalSize(lv2_atom_total_size(atom));
+
+    if (pData->binaryMode)
+    {
+        if (atomTotalSize > kPipeBinaryMaxPayloadSize)
         {
-            fixedMsg[size-1] = '\n';
-            fixedMsg[size  ] = '\0';
-            fixedMsg[size+1] = '\0';
+            carla_stderr2("CarlaPipeCommon - atom of %u bytes is too big, dropping it", atomTotalSize);
+            return;
         }
-        else
+
+        const PipeBinaryHeader header = { kPipeBinaryOpAtom, index, 0.0f, atomTotalSize };
+
+        const PrivateData::WriteLocker cml(pData);
+
+        // keep ordering in case someone left a message unflushed, then send header and atom with a single write
+        if (pData->sendMsgBuf() && pData->msgBuf.append(&header, sizeof(PipeBinaryHeader))
+                                && pData->msgBuf.append(atom, atomTotalSize))
         {
-            fixedMsg[size  ] = '\n';
-            fixedMsg[size+1] = '\0';
+            pData->writeBytes(pData->msgBuf.data, pData->msgBuf.used);
         }
+
+        pData->msgBuf.clear();
+        flushMessages();
+        return;
     }
-    else
+
+    PipeMessageBuilder msg;
+    msg.addLine("atom", 4);
+    msg.addUIntLine(index);
+    msg.addUIntLine(atomTotalSize);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    if (! _writeMsgBuffer(msg.buf, msg.size()))
+        return;
+
+    // encode straight into the message, base64 never needs fixing
+    if (char* const base64atom = pData->msgBuf.reserve(carla_base64EncodedSize(atomTotalSize) + 1))
     {
-        fixedMsg[0] = '\n';
-        fixedMsg[1] = '\0';
+        const std::size_t base64Size(carla_base64Encode(atom, atomTotalSize, base64atom));
+        base64atom[base64Size] = '\n';
     }
 
-    return _writeMsgBuffer(fixedMsg, size+1);
+    flushMessages();
 }
 
-bool CarlaPipeCommon::flushMessages() const noexcept
+void CarlaPipeCommon::writeLv2UridMessage(const uint32_t urid, const char* const uri) const noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(urid != 0,);
+    CARLA_SAFE_ASSERT_RETURN(uri != nullptr && uri[0] != '\0',);
+
+    PipeMessageBuilder msg;
+    msg.addLine("urid", 4);
+    msg.addUIntLine(urid);
+
+    const PrivateData::WriteLocker cml(pData);
+
+    _writeMsgBuffer(msg.buf, msg.size());
+    writeAndFixMessage(uri);
+
+    flushMessages();
+}
+
+// -------------------------------------------------------------------
+
+// internal
+const char* CarlaPipeCommon::_readline(const bool allocReturn) const noexcept
 {
-    // TESTING remove later (replace with trylock scope)
-    if (pData->writeLock.tryLock())
+    CARLA_SAFE_ASSERT_RETURN(pData->pipeRecv != INVALID_PIPE_VALUE, nullptr);
+
+    const char* line;
+
+    // check if we already have a full line in the buffer, otherwise read a new block
+    for (;;)
     {
-        carla_safe_assert("! pData->writeLock.tryLock()", __FILE__, __LINE__);
-        pData->writeLock.unlock();
-        return false;
+        if (pData->binaryMode ? pData->nextBinaryLine(line) : pData->nextTextLine(line))
+            break;
+
+        // nothing more to read, keep partial data for later
+        if (! pData->readMore())
+            return nullptr;
     }
 
-    CARLA_SAFE_ASSERT_RETURN(pData->pipeSend != INVALID_PIPE_VALUE, false);
+    // the line stays valid in our buffer until the next read
+    if (! allocReturn)
+        return line;
 
     try {
-#ifdef CARLA_OS_WIN
-        return (::FlushFileBuffers(pData->pipeSend) != FALSE);
-#else
-        return (::fsync(pData->pipeSend) == 0);
+        return carla_strdup(line);
+    } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::readline() - dup", nullptr);
+}
+
+const char* CarlaPipeCommon::_readlineblock(const bool allocReturn, const uint32_t timeOutMilliseconds) const noexcept
+{
+    const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);
+    uint64_t waitStart = 0;
+
+    for (;;)
+    {
+        if (const char* const msg = _readline(allocReturn))
+        {
+            if (waitStart != 0)
+                pipeStatsHistogram(pData->stats.readTime, getMicrosecondCounter() - waitStart);
+            return msg;
+        }
+
+        const uint32_t now(getMillisecondCounter());
+
+        if (now >= timeoutEnd)
+            break;
+
+        if (waitStart == 0)
+            waitStart = getMicrosecondCounter();
+
+        // wake up as soon as more data arrives
+        if (! pData->waitForData(timeoutEnd - now))
+        {
+            carla_stderr("readlineblock failed, pipe was closed");
+            return nullptr;
+        }
+    }
+
+    pipeStatsAdd(pData->stats.readTimeouts, 1);
+    carla_stderr("readlineblock timed out");
+    return nullptr;
+}
+
+bool CarlaPipeCommon::_writeMsgBuffer(const char* const msg, const std::size_t size) const noexcept
+{
+    const CarlaTraceScope cts("_writeMsgBuffer");
+
+#ifdef DEBUG
+    CARLA_SAFE_ASSERT_RETURN(pData->isWriteOwner(), false);
 #endif
-    } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::writeMsgBuffer", false);
+
+    CARLA_SAFE_ASSERT_RETURN(pData->pipeSend != INVALID_PIPE_VALUE, false);
+
+    // collected until flushMessages(), so each message is sent with a single write
+    return pData->appendMsg(msg, size);
 }
 
-// -------------------------------------------------------------------
+// -----------------------------------------------------------------------
+
+struct CarlaPipeZygote::PrivateData {
+#ifndef CARLA_OS_WIN
+    pid_t pid;
+    int socket;
+    bool ready;
+    bool shared;
+
+    // last instance id given to a client of a shared zygote
+    uint32_t lastInstanceId;
+
+    // forked clients are replied to in request order, replies read ahead wait here for their server
+    uint32_t lastRequest;
+    uint32_t lastReply;
+    PipeZygoteReply replies[kPipeZygoteMaxPendingReplies];
+#endif
+    CarlaString filename;
+
+    // one request at a time, servers might be started from different threads
+    CarlaMutex lock;
+
+    PrivateData() noexcept
+#ifndef CARLA_OS_WIN
+        : pid(-1),
+          socket(-1),
+          ready(false),
+          shared(false),
+          lastInstanceId(0),
+          lastRequest(0),
+          lastReply(0),
+          replies(),
+          filename(),
+#else
+        : filename(),
+#endif
+          lock() {}
+
+#ifndef CARLA_OS_WIN
+    void closeSocket() noexcept
+    {
+        if (socket == -1)
+            return;
+
+        try { ::close(socket); } CARLA_SAFE_EXCEPTION("close(socket)");
+        socket = -1;
+    }
 
-void CarlaPipeCommon::writeErrorMessage(const char* const error) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(error != nullptr && error[0] != '\0',);
+    /*
+     * The zygote sends 0 once initialized, check for it without blocking.
+     */
+    bool checkReady() noexcept
+    {
+        if (ready)
+            return true;
+        if (socket == -1)
+            return false;
 
-    const CarlaMutexLocker cml(pData->writeLock);
-    _writeMsgBuffer("error\n", 6);
-    writeAndFixMessage(error);
-    flushMessages();
-}
+        struct pollfd pfd;
+        pfd.fd      = socket;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
 
-void CarlaPipeCommon::writeControlMessage(const uint32_t index, const float value) const noexcept
-{
-    char tmpBuf[0xff+1];
-    tmpBuf[0xff] = '\0';
+        int ret;
 
-    const CarlaMutexLocker cml(pData->writeLock);
-    const ScopedLocale csl;
+        try {
+            ret = ::poll(&pfd, 1, 0);
+        } CARLA_SAFE_EXCEPTION_RETURN("poll", false);
 
-    _writeMsgBuffer("control\n", 8);
+        if (ret <= 0)
+            return false;
 
-    {
-        std::snprintf(tmpBuf, 0xff, "%i\n", index);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        int32_t msg = -1;
 
-        std::snprintf(tmpBuf, 0xff, "%f\n", value);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        if (! zygoteRecv(socket, &msg, sizeof(msg), 1000) || msg != 0)
+        {
+            carla_stderr2("CarlaPipeZygote - zygote failed to start");
+            closeSocket();
+            return false;
+        }
+
+        ready = true;
+        return true;
     }
 
-    flushMessages();
-}
+    /*
+     * Ask the zygote to fork a client for @a argv, replacing startProcess().
+     * A shared zygote hosts the client instead, @a instanceId is set to its id then.
+     * Otherwise @a request is set, the pid of the client comes later through pollReply().
+     */
+    bool forkClient(const char* const argv[], pid_t& pidinst, uint32_t& instanceId, uint32_t& request) noexcept
+    {
+        const CarlaMutexLocker cml(lock);
 
-void CarlaPipeCommon::writeConfigureMessage(const char* const key, const char* const value) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(key != nullptr && key[0] != '\0',);
-    CARLA_SAFE_ASSERT_RETURN(value != nullptr,);
+        // spawn while the zygote is still starting, it might take a while.
+        // a shared zygote takes requests from the start, otherwise each client would be a process of its own
+        if (socket == -1 || filename != argv[0] || (! shared && ! checkReady()))
+            return false;
 
-    const CarlaMutexLocker cml(pData->writeLock);
+        PipeZygoteHeader header;
+        header.argc       = 0;
+        header.size       = 0;
+        header.numFds     = 0;
+        header.instanceId = 0;
 
-    _writeMsgBuffer("configure\n", 10);
+        if (shared)
+        {
+            // skipping 0, which means not shared
+            if (++lastInstanceId == 0)
+                ++lastInstanceId;
+            header.instanceId = lastInstanceId;
+        }
 
-    {
-        writeAndFixMessage(key);
-        writeAndFixMessage(value);
-    }
+        char args[kPipeZygoteMaxArgSize];
+        int  fds[kPipeZygoteMaxFds];
 
-    flushMessages();
-}
+        for (; argv[header.argc] != nullptr; ++header.argc)
+        {
+            const char* const arg(argv[header.argc]);
+            const std::size_t argSize(std::strlen(arg) + 1);
 
-void CarlaPipeCommon::writeProgramMessage(const uint32_t index) const noexcept
-{
-    char tmpBuf[0xff+1];
-    tmpBuf[0xff] = '\0';
+            CARLA_SAFE_ASSERT_RETURN(header.argc < kPipeZygoteMaxArgs, false);
+            CARLA_SAFE_ASSERT_RETURN(header.size + argSize <= kPipeZygoteMaxArgSize, false);
 
-    const CarlaMutexLocker cml(pData->writeLock);
+            std::memcpy(args + header.size, arg, argSize);
+            header.size += static_cast<uint32_t>(argSize);
 
-    _writeMsgBuffer("program\n", 8);
+            if (header.argc < kPipeZygoteFirstFdArg)
+                continue;
 
-    {
-        std::snprintf(tmpBuf, 0xff, "%i\n", index);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
-    }
+            for (const char* fdStr = arg; fdStr != nullptr;)
+            {
+                CARLA_SAFE_ASSERT_RETURN(header.numFds < kPipeZygoteMaxFds, false);
+                fds[header.numFds++] = std::atoi(fdStr);
 
-    flushMessages();
-}
+                if ((fdStr = std::strchr(fdStr, ':')) != nullptr)
+                    ++fdStr;
+            }
+        }
 
-void CarlaPipeCommon::writeMidiProgramMessage(const uint32_t bank, const uint32_t program) const noexcept
-{
-    char tmpBuf[0xff+1];
-    tmpBuf[0xff] = '\0';
+        if (! zygoteSend(socket, &header, sizeof(header), fds, header.numFds) || ! zygoteSend(socket, args, header.size))
+        {
+            carla_stderr2("CarlaPipeZygote - failed to send request, zygote is gone");
+            closeSocket();
+            return false;
+        }
+
+        // the handshake tells if the client is up
+        if (shared)
+        {
+            pidinst    = pid;
+            instanceId = header.instanceId;
+            return true;
+        }
 
-    const CarlaMutexLocker cml(pData->writeLock);
+        // skipping 0, which means no request
+        if (++lastRequest == 0)
+            ++lastRequest;
 
-    _writeMsgBuffer("midiprogram\n", 8);
+        pidinst = -1;
+        request = lastRequest;
+        return true;
+    }
 
+    /*
+     * Check for the reply to @a request without blocking, setting @a pidinst once it arrived.
+     */
+    PipeHandshakeStatus pollReply(const uint32_t request, pid_t& pidinst) noexcept
     {
-        std::snprintf(tmpBuf, 0xff, "%i\n", bank);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        const CarlaMutexLocker cml(lock);
 
-        std::snprintf(tmpBuf, 0xff, "%i\n", program);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
-    }
+        while (static_cast<int32_t>(request - lastReply) > 0)
+        {
+            if (! readReply())
+                return socket != -1 ? kPipeHandshakePending : kPipeHandshakeFailed;
+        }
 
-    flushMessages();
-}
+        PipeZygoteReply& reply(replies[request % kPipeZygoteMaxPendingReplies]);
 
-void CarlaPipeCommon::writeMidiNoteMessage(const bool onOff, const uint8_t channel, const uint8_t note, const uint8_t velocity) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(channel < MAX_MIDI_CHANNELS,);
-    CARLA_SAFE_ASSERT_RETURN(note < MAX_MIDI_NOTE,);
-    CARLA_SAFE_ASSERT_RETURN(velocity < MAX_MIDI_VALUE,);
+        // taken too late, overwritten by newer replies
+        if (reply.request != request)
+            return kPipeHandshakeFailed;
 
-    char tmpBuf[0xff+1];
-    tmpBuf[0xff] = '\0';
+        const int32_t ret(reply.pid);
+        reply.pid = 0;
 
-    const CarlaMutexLocker cml(pData->writeLock);
+        if (ret <= 0)
+        {
+            carla_stderr2("CarlaPipeZygote - zygote failed to fork client");
+            return kPipeHandshakeFailed;
+        }
 
-    _writeMsgBuffer("note\n", 5);
+        pidinst = static_cast<pid_t>(ret);
+        return kPipeHandshakeDone;
+    }
 
+    /*
+     * The server of @a request stopped before the reply arrived, the client is killed once its pid is known.
+     */
+    void abandonRequest(const uint32_t request) noexcept
     {
-        std::snprintf(tmpBuf, 0xff, "%s\n", bool2str(onOff));
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
-
-        std::snprintf(tmpBuf, 0xff, "%i\n", channel);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        const CarlaMutexLocker cml(lock);
 
-        std::snprintf(tmpBuf, 0xff, "%i\n", note);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        PipeZygoteReply& reply(replies[request % kPipeZygoteMaxPendingReplies]);
 
-        std::snprintf(tmpBuf, 0xff, "%i\n", velocity);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        if (static_cast<int32_t>(request - lastReply) > 0)
+        {
+            killReply(reply);
+            reply.request = request;
+            reply.pid     = kPipeZygoteAbandoned;
+        }
+        else if (reply.request == request)
+        {
+            killReply(reply);
+        }
     }
 
-    flushMessages();
-}
+    /*
+     * Read one reply if available, without blocking.
+     * Returns false if there is none, or the zygote is gone.
+     */
+    bool readReply() noexcept
+    {
+        if (socket == -1)
+            return false;
 
-void CarlaPipeCommon::writeLv2AtomMessage(const uint32_t index, const LV2_Atom* const atom) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(atom != nullptr,);
+        struct pollfd pfd;
+        pfd.fd      = socket;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
 
-    char tmpBuf[0xff+1];
-    tmpBuf[0xff] = '\0';
+        int ret;
 
-    const uint32_t atomTotalSize(lv2_atom_total_size(atom));
-    CarlaString base64atom(CarlaString::asBase64(atom, atomTotalSize));
+        try {
+            ret = ::poll(&pfd, 1, 0);
+        } CARLA_SAFE_EXCEPTION_RETURN("poll", false);
 
-    const CarlaMutexLocker cml(pData->writeLock);
+        if (ret <= 0)
+            return false;
 
-    _writeMsgBuffer("atom\n", 5);
+        int32_t pidreply = -1;
 
-    {
-        std::snprintf(tmpBuf, 0xff, "%i\n", index);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        // replies are written whole, the rest of a partial one is close behind
+        if (! zygoteRecv(socket, &pidreply, sizeof(pidreply), 1000))
+        {
+            carla_stderr2("CarlaPipeZygote - zygote is gone");
+            closeSocket();
+            return false;
+        }
+
+        if (++lastReply == 0)
+            ++lastReply;
+
+        PipeZygoteReply& reply(replies[lastReply % kPipeZygoteMaxPendingReplies]);
 
-        std::snprintf(tmpBuf, 0xff, "%i\n", atomTotalSize);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        // nobody is waiting for the client if abandoned, or for the one not taken in time
+        const bool abandoned(reply.request == lastReply && reply.pid == kPipeZygoteAbandoned);
 
-        writeAndFixMessage(base64atom.buffer());
+        killReply(reply);
+        reply.request = lastReply;
+        reply.pid     = pidreply;
+
+        if (abandoned)
+            killReply(reply);
+
+        return true;
     }
 
-    flushMessages();
-}
+    static void killReply(PipeZygoteReply& reply) noexcept
+    {
+        if (reply.pid > 0)
+            ::kill(reply.pid, SIGKILL);
 
-void CarlaPipeCommon::writeLv2UridMessage(const uint32_t urid, const char* const uri) const noexcept
-{
-    CARLA_SAFE_ASSERT_RETURN(urid != 0,);
-    CARLA_SAFE_ASSERT_RETURN(uri != nullptr && uri[0] != '\0',);
+        reply.pid = 0;
+    }
 
-    char tmpBuf[0xff+1];
-    tmpBuf[0xff] = '\0';
+    /*
+     * No reply in time, the zygote is stuck. Stop it, so it does not fork the client later on.
+     */
+    void stopStuckZygote() noexcept
+    {
+        const CarlaMutexLocker cml(lock);
 
-    const CarlaMutexLocker cml(pData->writeLock);
+        if (socket == -1)
+            return;
 
-    _writeMsgBuffer("urid\n", 5);
+        carla_stderr2("CarlaPipeZygote - no reply from zygote, stopping it");
+        ::kill(pid, SIGKILL);
+        closeSocket();
+    }
 
+    int getSocket() noexcept
     {
-        std::snprintf(tmpBuf, 0xff, "%i\n", urid);
-        _writeMsgBuffer(tmpBuf, std::strlen(tmpBuf));
+        const CarlaMutexLocker cml(lock);
 
-        writeAndFixMessage(uri);
+        return socket;
     }
+#endif
 
-    flushMessages();
-}
+    CARLA_DECLARE_NON_COPY_STRUCT(PrivateData)
+};
 
-// -------------------------------------------------------------------
+// -----------------------------------------------------------------------
 
-// internal
-const char* CarlaPipeCommon::_readline() const noexcept
+CarlaPipeZygote::CarlaPipeZygote() noexcept
+    : pData(new PrivateData())
 {
-    CARLA_SAFE_ASSERT_RETURN(pData->pipeRecv != INVALID_PIPE_VALUE, nullptr);
+    carla_debug("CarlaPipeZygote::CarlaPipeZygote()");
+}
 
-    char    c;
-    char*   ptr = pData->tmpBuf;
-    ssize_t ret;
+CarlaPipeZygote::~CarlaPipeZygote() /*noexcept*/
+{
+    carla_debug("CarlaPipeZygote::~CarlaPipeZygote()");
 
-    pData->tmpStr.clear();
+    stopZygote(5*1000);
+
+    delete pData;
+}
+
+bool CarlaPipeZygote::startZygote(const char* const filename, const bool shared) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(filename != nullptr && filename[0] != '\0', false);
+    carla_debug("CarlaPipeZygote::startZygote(\"%s\", %s)", filename, bool2str(shared));
 
-    for (int i=0; i<0xff; ++i)
-    {
-        try {
 #ifdef CARLA_OS_WIN
-            //ret = ::ReadFileBlock(pData->pipeRecv, &c, 1);
-            ret = ::ReadFileNonBlock(pData->pipeRecv, pData->cancelEvent, &c, 1);
+    carla_stderr2("CarlaPipeZygote::startZygote() - not supported on this platform");
+    (void)shared;
+    return false;
 #else
-            ret = ::read(pData->pipeRecv, &c, 1);
-#endif
-        } CARLA_SAFE_EXCEPTION_BREAK("CarlaPipeCommon::readline() - read");
-
-        if (ret != 1 || c == '\n')
-            break;
+    const CarlaMutexLocker cml(pData->lock);
 
-        if (c == '\r')
-            c = '\n';
+    CARLA_SAFE_ASSERT_RETURN(pData->pid == -1, false);
+    CARLA_SAFE_ASSERT_RETURN(pData->socket == -1, false);
 
-        *ptr++ = c;
+    const CarlaTraceScope cts("startZygote");
 
-        if (i+1 == 0xff)
-        {
-            i = 0;
-            *ptr = '\0';
-            pData->tmpStr += pData->tmpBuf;
-            ptr = pData->tmpBuf;
-        }
-    }
+    int sockets[2];
 
-    if (ptr != pData->tmpBuf)
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
     {
-        *ptr = '\0';
-        pData->tmpStr += pData->tmpBuf;
+        CarlaString error(std::strerror(errno));
+        carla_stderr2("CarlaPipeZygote::startZygote() - socketpair failed: %s", error.buffer());
+        return false;
     }
-    else if (pData->tmpStr.isEmpty() && ret != 1)
+
+    // our end must not leak into any child, the zygote would never see it closed
+    try { ::fcntl(sockets[0], F_SETFD, FD_CLOEXEC); } CARLA_SAFE_EXCEPTION("fcntl(sockets[0], FD_CLOEXEC)");
+
+    char socketStr[100+1];
+    std::snprintf(socketStr, 100, "%i", sockets[1]);
+    socketStr[100] = '\0';
+
+    const char* const argv[] = { filename, shared ? "--shared" : "--zygote", socketStr, nullptr };
+
+    const bool started(startProcess(argv, pData->pid));
+
+    try { ::close(sockets[1]); } CARLA_SAFE_EXCEPTION("close(sockets[1])");
+
+    if (! started)
     {
-        // some error
-        return nullptr;
+        pData->pid = -1;
+        try { ::close(sockets[0]); } CARLA_SAFE_EXCEPTION("close(sockets[0])");
+        return false;
     }
 
-    try {
-        return pData->tmpStr.dup();
-    } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::readline() - dup", nullptr);
+    pData->socket      = sockets[0];
+    pData->ready       = false;
+    pData->shared      = shared;
+    pData->lastRequest = 0;
+    pData->lastReply   = 0;
+    carla_zeroStructs(pData->replies, kPipeZygoteMaxPendingReplies);
+    pData->filename    = filename;
+    return true;
+#endif
 }
 
-const char* CarlaPipeCommon::_readlineblock(const uint32_t timeOutMilliseconds) const noexcept
+void CarlaPipeZygote::stopZygote(const uint32_t timeOutMilliseconds) noexcept
 {
-    const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);
+    carla_debug("CarlaPipeZygote::stopZygote(%i)", timeOutMilliseconds);
 
-    for (;;)
-    {
-        if (const char* const msg = _readline())
-            return msg;
+#ifndef CARLA_OS_WIN
+    const CarlaMutexLocker cml(pData->lock);
 
-        if (getMillisecondCounter() >= timeoutEnd)
-            break;
+    // the zygote exits once its socket is closed
+    pData->closeSocket();
 
-        carla_msleep(5);
+    if (pData->pid != -1)
+    {
+        waitForChildToStopOrKillIt(pData->pid, timeOutMilliseconds);
+        pData->pid = -1;
     }
 
-    carla_stderr("readlineblock timed out");
-    return nullptr;
+    pData->filename.clear();
+#else
+    (void)timeOutMilliseconds;
+#endif
 }
 
-bool CarlaPipeCommon::_writeMsgBuffer(const char* const msg, const std::size_t size) const noexcept
+bool CarlaPipeZygote::isZygoteRunning() const noexcept
 {
-    // TESTING remove later (replace with trylock scope)
-    if (pData->writeLock.tryLock())
-    {
-        carla_safe_assert("! pData->writeLock.tryLock()", __FILE__, __LINE__);
-        pData->writeLock.unlock();
-        return false;
-    }
-
-    CARLA_SAFE_ASSERT_RETURN(pData->pipeSend != INVALID_PIPE_VALUE, false);
+#ifndef CARLA_OS_WIN
+    return (pData->socket != -1);
+#else
+    return false;
+#endif
+}
 
-    ssize_t ret;
+bool CarlaPipeZygote::isZygoteReady() noexcept
+{
+#ifndef CARLA_OS_WIN
+    const CarlaMutexLocker cml(pData->lock);
 
-    try {
-#ifdef CARLA_OS_WIN
-        //ret = ::WriteFileBlock(pData->pipeSend, msg, size);
-        ret = ::WriteFileNonBlock(pData->pipeSend, pData->cancelEvent, msg, size);
+    return pData->checkReady();
 #else
-        ret = ::write(pData->pipeSend, msg, size);
+    return false;
 #endif
-    } CARLA_SAFE_EXCEPTION_RETURN("CarlaPipeCommon::writeMsgBuffer", false);
+}
 
-     return (ret == static_cast<ssize_t>(size));
+const char* CarlaPipeZygote::getZygoteFilename() const noexcept
+{
+    return isZygoteRunning() ? pData->filename.buffer() : nullptr;
 }
 
 // -----------------------------------------------------------------------
@@ -1133,9 +4877,38 @@ uintptr_t CarlaPipeServer::getPID() const noexcept
 // -----------------------------------------------------------------------
 
 bool CarlaPipeServer::startPipeServer(const char* const filename, const char* const arg1, const char* const arg2) noexcept
+{
+    if (! startPipeServerAsync(filename, arg1, arg2))
+        return false;
+
+    const CarlaTraceScope cts("handshake");
+
+    for (;;)
+    {
+        if (! idlePipeServerStart())
+            return false;
+        if (! pData->starting)
+            return true;
+
+#ifdef CARLA_OS_WIN
+        carla_msleep(5);
+#else
+        // if the client is gone the next read returns 0 and we stop.
+        // the zygote's reply comes first, a closed zygote socket fails the next idle call
+        const uint32_t now(getMillisecondCounter());
+        const int pipe(pData->zygoteRequest != 0 ? pData->zygote->pData->getSocket() : pData->startRecv);
+
+        if (pipe != -1 && now < pData->handshake.timeoutEnd)
+            waitForPipeData(pipe, pData->handshake.timeoutEnd - now);
+#endif
+    }
+}
+
+bool CarlaPipeServer::startPipeServerAsync(const char* const filename, const char* const arg1, const char* const arg2) noexcept
 {
     CARLA_SAFE_ASSERT_RETURN(pData->pipeRecv == INVALID_PIPE_VALUE, false);
     CARLA_SAFE_ASSERT_RETURN(pData->pipeSend == INVALID_PIPE_VALUE, false);
+    CARLA_SAFE_ASSERT_RETURN(! pData->starting, false);
 #ifdef CARLA_OS_WIN
     CARLA_SAFE_ASSERT_RETURN(pData->processInfo.hThread  == INVALID_HANDLE_VALUE, false);
     CARLA_SAFE_ASSERT_RETURN(pData->processInfo.hProcess == INVALID_HANDLE_VALUE, false);
@@ -1145,9 +4918,11 @@ bool CarlaPipeServer::startPipeServer(const char* const filename, const char* co
     CARLA_SAFE_ASSERT_RETURN(filename != nullptr && filename[0] != '\0', false);
     CARLA_SAFE_ASSERT_RETURN(arg1 != nullptr, false);
     CARLA_SAFE_ASSERT_RETURN(arg2 != nullptr, false);
-    carla_debug("CarlaPipeServer::startPipeServer(\"%s\", \"%s\", \"%s\")", filename, arg1, arg2);
+    carla_debug("CarlaPipeServer::startPipeServerAsync(\"%s\", \"%s\", \"%s\")", filename, arg1, arg2);
 
-    const CarlaMutexLocker cml(pData->writeLock);
+    const CarlaTraceScope cts("startPipeServer");
+
+    const PrivateData::WriteLocker cml(pData);
 
     //----------------------------------------------------------------
     // create pipes
@@ -1229,16 +5004,28 @@ bool CarlaPipeServer::startPipeServer(const char* const filename, const char* co
         return false;
     }
 
+#ifdef F_SETPIPE_SZ
+    // bigger kernel buffers let bursts through without waiting for the other side, failing is fine
+    try { ::fcntl(pipe1[0], F_SETPIPE_SZ, kPipeBufferSize); } CARLA_SAFE_EXCEPTION("fcntl(pipe1[0], F_SETPIPE_SZ)");
+    try { ::fcntl(pipe2[0], F_SETPIPE_SZ, kPipeBufferSize); } CARLA_SAFE_EXCEPTION("fcntl(pipe2[0], F_SETPIPE_SZ)");
+#endif
+
     int pipeRecvServer = pipe1[0];
     int pipeRecvClient = pipe2[0];
     int pipeSendClient = pipe1[1];
     int pipeSendServer = pipe2[1];
 #endif
 
+    //----------------------------------------------------------------
+    // create shared memory, falls back to pipes if not possible
+
+    if (pData->shmAllowed)
+        pData->shm.create();
+
     //----------------------------------------------------------------
     // set arguments
 
-    const char* argv[8];
+    const char* argv[9];
 
     //----------------------------------------------------------------
     // argv[0] => filename
@@ -1275,9 +5062,25 @@ bool CarlaPipeServer::startPipeServer(const char* const filename, const char* co
     argv[6] = pipeSendClientStr; // pipe1[1] SEND
 
     //----------------------------------------------------------------
-    // argv[7] => null
+    // argv[7] => shared memory, if available
+
+    char shmStr[100+1];
+    shmStr[100] = '\0';
+
+    if (pData->shm.data != nullptr)
+    {
+        pData->shm.getArgument(shmStr, 100);
+        argv[7] = shmStr;
+    }
+    else
+    {
+        argv[7] = nullptr;
+    }
+
+    //----------------------------------------------------------------
+    // argv[8] => null
 
-    argv[7] = nullptr;
+    argv[8] = nullptr;
 
     //----------------------------------------------------------------
     // start process
@@ -1300,21 +5103,47 @@ bool CarlaPipeServer::startPipeServer(const char* const filename, const char* co
     CARLA_SAFE_ASSERT(pData->processInfo.hThread  != nullptr);
     CARLA_SAFE_ASSERT(pData->processInfo.hProcess != nullptr);
 #else
-    if (! startProcess(argv, pData->pid))
+    bool     started = false;
+    uint32_t zygoteRequest = 0;
+
+    if (pData->zygote != nullptr)
+    {
+        const CarlaTraceScope cts2("zygoteFork");
+        started = pData->zygote->pData->forkClient(argv, pData->pid, pData->instanceId, zygoteRequest);
+    }
+
+    if (! started)
+    {
+        int shmFds[3];
+        const uint32_t shmFdCount((pData->shm.data != nullptr) ? pData->shm.getFds(shmFds) : 0);
+
+        started = startProcess(argv, pData->pid, shmFds, shmFdCount);
+    }
+
+    if (! started)
     {
         pData->pid = -1;
+        pData->instanceId = 0;
         try { ::close(pipe1[0]); } CARLA_SAFE_EXCEPTION("close(pipe1[0])");
         try { ::close(pipe1[1]); } CARLA_SAFE_EXCEPTION("close(pipe1[1])");
         try { ::close(pipe2[0]); } CARLA_SAFE_EXCEPTION("close(pipe2[0])");
         try { ::close(pipe2[1]); } CARLA_SAFE_EXCEPTION("close(pipe2[1])");
+        pData->shm.clear();
         fail("startProcess() failed");
         return false;
     }
+
+    // lets idle code see the client exit without polling waitpid, and the reaper wait for it.
+    // a forked client's pid is not known yet, idlePipeServerStart() opens it once the zygote replies
+    if (pData->pid != -1)
+        pData->pidfd = openPidFd(pData->pid);
 #endif
 
     //----------------------------------------------------------------
     // close duplicated handles used by the client
 
+    pData->shm.closeMemFd();
+
 #ifdef CARLA_OS_WIN
     try { ::CloseHandle(pipeRecvServer); } CARLA_SAFE_EXCEPTION("CloseHandle(pipeRecvServer)");
     try { ::CloseHandle(pipeSendServer); } CARLA_SAFE_EXCEPTION("CloseHandle(pipeSendServer)");
@@ -1338,60 +5167,93 @@ bool CarlaPipeServer::startPipeServer(const char* const filename, const char* co
     }
 #endif
 
-    //----------------------------------------------------------------
-    // wait for client to say something
+    //----------------------------------------------------------------
+    // the client's first line is read by idlePipeServerStart()
+
+    pData->startRecv = pipeRecvClient;
+    pData->startSend = pipeSendClient;
+    pData->handshake.reset(kPipeHandshakeTimeout);
+    pData->starting = true;
+#ifndef CARLA_OS_WIN
+    pData->zygoteRequest = zygoteRequest;
+#endif
+
+#ifndef CARLA_OS_WIN
+    if (ret == -1)
+    {
+        pData->abortStart();
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool CarlaPipeServer::isPipeServerStarting() const noexcept
+{
+    return pData->starting;
+}
+
+bool CarlaPipeServer::idlePipeServerStart() noexcept
+{
+    const PrivateData::WriteLocker cml(pData);
+
+    if (! pData->starting)
+        return isPipeRunning();
+
+#ifndef CARLA_OS_WIN
+    // the client might be up already, but it is not ours until we know its pid
+    if (pData->zygoteRequest != 0)
+    {
+        CARLA_SAFE_ASSERT_RETURN(pData->zygote != nullptr, false);
+
+        switch (pData->zygote->pData->pollReply(pData->zygoteRequest, pData->pid))
+        {
+        case kPipeHandshakePending:
+            if (getMillisecondCounter() < pData->handshake.timeoutEnd)
+                return true;
+            pData->zygote->pData->stopStuckZygote();
+            break;
+        case kPipeHandshakeDone:
+            pData->zygoteRequest = 0;
+            pData->pidfd = openPidFd(pData->pid);
+            break;
+        case kPipeHandshakeFailed:
+            break;
+        }
+
+        if (pData->zygoteRequest != 0)
+        {
+            pData->abortStart();
+            fail("zygote failed to start client");
+            return false;
+        }
+    }
+#endif
+
+    uint features = 0x0;
 
 #ifdef CARLA_OS_WIN
     struct { HANDLE handle; HANDLE cancel; } pipe;
-    pipe.handle = pipeRecvClient;
+    pipe.handle = pData->startRecv;
     pipe.cancel = pData->cancelEvent;
-    if (             waitForClientFirstMessage(pipe, 10*1000 /* 10 secs */))
 #else
-    if (ret != -1 && waitForClientFirstMessage(pipeRecvClient, 10*1000 /* 10 secs */))
+    const int pipe(pData->startRecv);
 #endif
-    {
-        pData->pipeRecv = pipeRecvClient;
-        pData->pipeSend = pipeSendClient;
-        carla_stdout("ALL OK!");
-        return true;
-    }
-
-    //----------------------------------------------------------------
-    // failed to set non-block or get first child message, cannot continue
-
-#ifdef CARLA_OS_WIN
-    if (TerminateProcess(pData->processInfo.hProcess, 0) != FALSE)
-    {
-        // wait for process to stop
-        waitForProcessToStop(pData->processInfo, 2*1000);
-    }
 
-    // clear pData->processInfo
-    try { CloseHandle(pData->processInfo.hThread);  } CARLA_SAFE_EXCEPTION("CloseHandle(pData->processInfo.hThread)");
-    try { CloseHandle(pData->processInfo.hProcess); } CARLA_SAFE_EXCEPTION("CloseHandle(pData->processInfo.hProcess)");
-    carla_zeroStruct(pData->processInfo);
-    pData->processInfo.hProcess = INVALID_HANDLE_VALUE;
-    pData->processInfo.hThread  = INVALID_HANDLE_VALUE;
-#else
-    if (::kill(pData->pid, SIGKILL) != -1)
+    switch (readClientFirstMessage(pipe, pData->handshake, features))
     {
-        // wait for killing to take place
-        waitForChildToStop(pData->pid, 2*1000, false);
+    case kPipeHandshakePending:
+        return true;
+    case kPipeHandshakeDone:
+        pData->finishStart(features);
+        return true;
+    case kPipeHandshakeFailed:
+        break;
     }
-    pData->pid = -1;
-#endif
-
-    //----------------------------------------------------------------
-    // close pipes
-
-#ifdef CARLA_OS_WIN
-    try { ::CloseHandle(pipeRecvServer); } CARLA_SAFE_EXCEPTION("CloseHandle(pipeRecvServer)");
-    try { ::CloseHandle(pipeSendServer); } CARLA_SAFE_EXCEPTION("CloseHandle(pipeSendServer)");
-#else
-    try { ::close      (pipeRecvServer); } CARLA_SAFE_EXCEPTION("close(pipeRecvServer)");
-    try { ::close      (pipeSendServer); } CARLA_SAFE_EXCEPTION("close(pipeSendServer)");
-#endif
 
+    pData->abortStart();
+    fail("client failed to start");
     return false;
 }
 
@@ -1399,13 +5261,25 @@ void CarlaPipeServer::stopPipeServer(const uint32_t timeOutMilliseconds) noexcep
 {
     carla_debug("CarlaPipeServer::stopPipeServer(%i)", timeOutMilliseconds);
 
+    const CarlaTraceScope cts("stopPipeServer");
+
 #ifdef CARLA_OS_WIN
     if (pData->processInfo.hProcess != INVALID_HANDLE_VALUE)
     {
-        const CarlaMutexLocker cml(pData->writeLock);
+        const PrivateData::WriteLocker cml(pData);
 
         if (pData->pipeSend != INVALID_PIPE_VALUE)
+        {
             _writeMsgBuffer("quit\n", 5);
+            pData->msgKind = kPipeMessageCritical;
+            flushMessages();
+            pData->drainSendBuf();
+
+            // give the other side a chance to read everything before it is asked to stop
+            for (const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);
+                 ! pData->flushBacklog() && pData->hasBacklog() && getMillisecondCounter() < timeoutEnd;)
+                pData->waitForWritable(50);
+        }
 
         waitForProcessToStopOrKillIt(pData->processInfo, timeOutMilliseconds);
         try { CloseHandle(pData->processInfo.hThread);  } CARLA_SAFE_EXCEPTION("CloseHandle(pData->processInfo.hThread)");
@@ -1417,24 +5291,131 @@ void CarlaPipeServer::stopPipeServer(const uint32_t timeOutMilliseconds) noexcep
 #else
     if (pData->pid != -1)
     {
-        const CarlaMutexLocker cml(pData->writeLock);
+        const PrivateData::WriteLocker cml(pData);
 
         if (pData->pipeSend != INVALID_PIPE_VALUE)
+        {
             _writeMsgBuffer("quit\n", 5);
+            pData->msgKind = kPipeMessageCritical;
+            flushMessages();
+            pData->drainSendBuf();
+
+            // give the other side a chance to read everything before it is asked to stop
+            for (const uint32_t timeoutEnd(getMillisecondCounter() + timeOutMilliseconds);
+                 ! pData->flushBacklog() && pData->hasBacklog() && getMillisecondCounter() < timeoutEnd;)
+                pData->waitForWritable(50);
+        }
+
+        // a shared zygote stays, wait for it to drop our pipes instead
+        if (pData->instanceId != 0)
+            pData->waitForClientToClose(timeOutMilliseconds);
+        else
+            waitForChildToStopOrKillIt(pData->pid, timeOutMilliseconds);
 
-        waitForChildToStopOrKillIt(pData->pid, timeOutMilliseconds);
         pData->pid = -1;
+        pData->instanceId = 0;
+        pData->closePidFd();
     }
 #endif
 
     closePipeServer();
 }
 
+void CarlaPipeServer::stopPipeServerAsync(const uint32_t timeOutMilliseconds) noexcept
+{
+    carla_debug("CarlaPipeServer::stopPipeServerAsync(%i)", timeOutMilliseconds);
+
+#ifdef CARLA_OS_WIN
+    stopPipeServer(timeOutMilliseconds);
+#else
+    const CarlaTraceScope cts("stopPipeServerAsync");
+
+    if (pData->pid != -1)
+    {
+        const PrivateData::WriteLocker cml(pData);
+
+        const bool exited(hasPidExited(pData->pidfd, pData->pid));
+
+        if (! exited && pData->pipeSend != INVALID_PIPE_VALUE)
+        {
+            _writeMsgBuffer("quit\n", 5);
+            pData->msgKind = kPipeMessageCritical;
+            flushMessages();
+            pData->drainSendBuf();
+
+            // no waiting here, whatever does not fit now is dropped along with the pipe
+            pData->flushBacklog();
+        }
+
+        // a shared zygote stays and drops the client once our pipes are closed,
+        // anything else is left to the reaper, which falls back to waiting here if it is full
+        if (pData->instanceId != 0 || exited)
+        {
+            pData->closePidFd();
+        }
+        else if (getPipeChildReaper().addChild(pData->pid, pData->pidfd, timeOutMilliseconds))
+        {
+            pData->pidfd = -1;
+        }
+        else
+        {
+            waitForChildToStopOrKillIt(pData->pid, timeOutMilliseconds);
+            pData->closePidFd();
+        }
+
+        pData->pid = -1;
+        pData->instanceId = 0;
+    }
+
+    closePipeServer();
+#endif
+}
+
+bool CarlaPipeServer::hasPipeClientExited() noexcept
+{
+#ifdef CARLA_OS_WIN
+    if (pData->processInfo.hProcess == INVALID_HANDLE_VALUE)
+        return false;
+
+    try {
+        return (::WaitForSingleObject(pData->processInfo.hProcess, 0) == WAIT_OBJECT_0);
+    } CARLA_SAFE_EXCEPTION_RETURN("WaitForSingleObject", false);
+#else
+    if (pData->pid == -1)
+        return false;
+
+    if (! hasPidExited(pData->pidfd, pData->pid))
+        return false;
+
+    // reaped already, make sure the pid is not waited for or signaled again
+    pData->pid = -1;
+    pData->instanceId = 0;
+    pData->closePidFd();
+    return true;
+#endif
+}
+
 void CarlaPipeServer::closePipeServer() noexcept
 {
     carla_debug("CarlaPipeServer::closePipeServer()");
 
-    const CarlaMutexLocker cml(pData->writeLock);
+    const PrivateData::WriteLocker cml(pData);
+
+#ifndef CARLA_OS_WIN
+    // stopped while the zygote is forking the client, which then has nobody to talk to
+    if (pData->zygoteRequest != 0 && pData->zygote != nullptr)
+        pData->zygote->pData->abandonRequest(pData->zygoteRequest);
+#endif
+
+    pData->closeStartPipes();
+    pData->clearRecvBuffer();
+    pData->msgBuf.clear();
+    pData->binaryControlLines = 0;
+    pData->binaryAtomLines = 0;
+    pData->binaryMode = false;
+    pData->sendBuf.clear();
+    pData->clearBacklog();
+    pData->shm.clear();
 
     if (pData->pipeRecv != INVALID_PIPE_VALUE)
     {
@@ -1457,24 +5438,35 @@ void CarlaPipeServer::closePipeServer() noexcept
     }
 }
 
+void CarlaPipeServer::setPipeZygote(CarlaPipeZygote* const zygote) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(! isPipeRunning(),);
+    CARLA_SAFE_ASSERT_RETURN(! pData->starting,);
+
+    pData->zygote = zygote;
+}
+
 void CarlaPipeServer::writeShowMessage() const noexcept
 {
-    const CarlaMutexLocker cml(pData->writeLock);
+    const PrivateData::WriteLocker cml(pData);
     _writeMsgBuffer("show\n", 5);
+    pData->msgKind = kPipeMessageCritical;
     flushMessages();
 }
 
 void CarlaPipeServer::writeFocusMessage() const noexcept
 {
-    const CarlaMutexLocker cml(pData->writeLock);
+    const PrivateData::WriteLocker cml(pData);
     _writeMsgBuffer("focus\n", 6);
+    pData->msgKind = kPipeMessageCritical;
     flushMessages();
 }
 
 void CarlaPipeServer::writeHideMessage() const noexcept
 {
-    const CarlaMutexLocker cml(pData->writeLock);
+    const PrivateData::WriteLocker cml(pData);
     _writeMsgBuffer("show\n", 5);
+    pData->msgKind = kPipeMessageCritical;
     flushMessages();
 }
 
@@ -1499,7 +5491,7 @@ bool CarlaPipeClient::initPipeClient(const char* argv[]) noexcept
     CARLA_SAFE_ASSERT_RETURN(pData->pipeSend == INVALID_PIPE_VALUE, false);
     carla_debug("CarlaPipeClient::initPipeClient(%p)", argv);
 
-    const CarlaMutexLocker cml(pData->writeLock);
+    const PrivateData::WriteLocker cml(pData);
 
     //----------------------------------------------------------------
     // read arguments
@@ -1557,10 +5549,55 @@ bool CarlaPipeClient::initPipeClient(const char* argv[]) noexcept
 
     pData->pipeRecv = pipeRecvServer;
     pData->pipeSend = pipeSendServer;
+    pData->binaryMode = false;
+    pData->clearRecvBuffer();
 
-    writeMessage("\n", 1);
-    flushMessages();
+    //----------------------------------------------------------------
+    // attach to shared memory, if the server created it
+
+    const bool useSharedMemory(pData->shmAllowed && argv[7] != nullptr && argv[7][0] != '\0' && pData->shm.attach(argv[7]));
+
+    //----------------------------------------------------------------
+    // say hello, requesting the features we want (never buffered)
+
+    carla_trace_begin("handshake");
+
+    if (! pData->binaryModeAllowed)
+    {
+        if (useSharedMemory)
+            pData->writeRaw("shm\n", 4);
+        else
+            pData->writeRaw("\n", 1);
+    }
+    else
+    {
+        if (useSharedMemory)
+            pData->writeRaw("binary shm\n", 11);
+        else
+            pData->writeRaw("binary\n", 7);
+
+        // server replies with the protocol to use
+        if (const char* const reply = _readlineblock(false, 5*1000 /* 5 secs */))
+            pData->binaryMode = (std::strcmp(reply, kPipeBinaryHandshake) == 0);
+    }
+
+    carla_trace_end("handshake");
+
+    // everything after the handshake goes through shared memory
+    pData->shm.active = useSharedMemory;
+
+#ifndef CARLA_OS_WIN
+    if (pData->nonBlockingSend)
+    {
+        try {
+            ret = ::fcntl(pipeSendServer, F_SETFL, ::fcntl(pipeSendServer, F_GETFL) | O_NONBLOCK);
+        } CARLA_SAFE_EXCEPTION("fcntl(pipeSendServer, O_NONBLOCK)");
+        CARLA_SAFE_ASSERT(ret != -1);
+    }
+#endif
 
+    carla_debug("CarlaPipeClient::initPipeClient() - using %s protocol over %s",
+                pData->binaryMode ? "binary" : "text", useSharedMemory ? "shared memory" : "pipes");
     return true;
 }
 
@@ -1568,7 +5605,16 @@ void CarlaPipeClient::closePipeClient() noexcept
 {
     carla_debug("CarlaPipeClient::closePipeClient()");
 
-    const CarlaMutexLocker cml(pData->writeLock);
+    const PrivateData::WriteLocker cml(pData);
+
+    pData->clearRecvBuffer();
+    pData->msgBuf.clear();
+    pData->binaryControlLines = 0;
+    pData->binaryAtomLines = 0;
+    pData->binaryMode = false;
+    pData->sendBuf.clear();
+    pData->clearBacklog();
+    pData->shm.clear();
 
     if (pData->pipeRecv != INVALID_PIPE_VALUE)
     {
@@ -1593,6 +5639,272 @@ void CarlaPipeClient::closePipeClient() noexcept
 
 // -----------------------------------------------------------------------
 
+struct CarlaPipeZygoteClient::PrivateData {
+    int socket;
+
+#ifndef CARLA_OS_WIN
+    // fds of the current request, owned by the zygote until finishRequest()
+    int      fds[kPipeZygoteMaxFds];
+    uint32_t numFds;
+
+    // instance id of the current request, for shared zygotes
+    uint32_t instanceId;
+
+    // SIGCHLD is ignored, set on the first request to fork
+    bool reaping;
+
+    // arguments of the current request, with fd numbers replaced by the received ones
+    char        recvArgs[kPipeZygoteMaxArgSize];
+    char        args[kPipeZygoteMaxArgSize + kPipeZygoteMaxFds * 12];
+    const char* argv[kPipeZygoteMaxArgs + 1];
+#endif
+
+    PrivateData(const int s) noexcept
+        : socket(s)
+#ifndef CARLA_OS_WIN
+        , fds(),
+          numFds(0),
+          instanceId(0),
+          reaping(false),
+          recvArgs(),
+          args(),
+          argv()
+#endif
+    {}
+
+#ifndef CARLA_OS_WIN
+    void closeFds() noexcept
+    {
+        for (uint32_t i=0; i < numFds; ++i)
+        {
+            try { ::close(fds[i]); } CARLA_SAFE_EXCEPTION("close(fds[i])");
+        }
+
+        numFds = 0;
+    }
+
+    void closeSocket() noexcept
+    {
+        if (socket == -1)
+            return;
+
+        try { ::close(socket); } CARLA_SAFE_EXCEPTION("close(socket)");
+        socket = -1;
+    }
+
+    void reply(const int32_t pid) noexcept
+    {
+        if (socket != -1 && ! zygoteSend(socket, &pid, sizeof(pid)))
+            carla_stderr2("CarlaPipeZygoteClient - failed to send reply");
+    }
+
+    /*
+     * Split the received arguments into argv, replacing the fd numbers of the server with ours.
+     */
+    bool parseArgs(const PipeZygoteHeader& header) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(header.size > 0 && recvArgs[header.size - 1] == '\0', false);
+
+        const char* arg = recvArgs;
+        std::size_t used = 0;
+        uint32_t fdIndex = 0;
+
+        for (uint32_t i=0; i < header.argc; ++i)
+        {
+            CARLA_SAFE_ASSERT_RETURN(arg < recvArgs + header.size, false);
+
+            const std::size_t argSize(std::strlen(arg) + 1);
+            argv[i] = args + used;
+
+            if (i < kPipeZygoteFirstFdArg)
+            {
+                std::memcpy(args + used, arg, argSize);
+                used += argSize;
+                arg += argSize;
+                continue;
+            }
+
+            for (const char* fdStr = arg; fdStr != nullptr;)
+            {
+                CARLA_SAFE_ASSERT_RETURN(fdIndex < numFds, false);
+
+                const int ret(std::snprintf(args + used, sizeof(args) - used, "%i", fds[fdIndex++]));
+                CARLA_SAFE_ASSERT_RETURN(ret > 0 && used + static_cast<std::size_t>(ret) + 1 < sizeof(args), false);
+                used += static_cast<std::size_t>(ret);
+
+                if ((fdStr = std::strchr(fdStr, ':')) != nullptr)
+                {
+                    args[used++] = ':';
+                    ++fdStr;
+                }
+            }
+
+            args[used++] = '\0';
+            arg += argSize;
+        }
+
+        CARLA_SAFE_ASSERT_RETURN(fdIndex == numFds, false);
+
+        argv[header.argc] = nullptr;
+        return true;
+    }
+#endif
+
+    CARLA_DECLARE_NON_COPY_STRUCT(PrivateData)
+};
+
+// -----------------------------------------------------------------------
+
+CarlaPipeZygoteClient::CarlaPipeZygoteClient(const int socket) noexcept
+    : pData(new PrivateData(socket))
+{
+    carla_debug("CarlaPipeZygoteClient::CarlaPipeZygoteClient(%i)", socket);
+
+#ifndef CARLA_OS_WIN
+    CARLA_SAFE_ASSERT_RETURN(socket >= 0,);
+
+    try { ::fcntl(socket, F_SETFD, FD_CLOEXEC); } CARLA_SAFE_EXCEPTION("fcntl(socket, FD_CLOEXEC)");
+
+    // tell the server requests can be sent now
+    pData->reply(0);
+#endif
+}
+
+CarlaPipeZygoteClient::~CarlaPipeZygoteClient() /*noexcept*/
+{
+    carla_debug("CarlaPipeZygoteClient::~CarlaPipeZygoteClient()");
+
+#ifndef CARLA_OS_WIN
+    pData->closeFds();
+    pData->closeSocket();
+#endif
+
+    delete pData;
+}
+
+bool CarlaPipeZygoteClient::waitForRequest() noexcept
+{
+#ifndef CARLA_OS_WIN
+    pData->closeFds();
+    pData->argv[0] = nullptr;
+    pData->instanceId = 0;
+
+    for (;;)
+    {
+        if (pData->socket == -1)
+            return false;
+
+        PipeZygoteHeader header;
+
+        if (! zygoteRecv(pData->socket, &header, sizeof(header), 0, pData->fds, &pData->numFds))
+        {
+            pData->closeFds();
+            return false;
+        }
+
+        if (header.argc == 0 || header.argc > kPipeZygoteMaxArgs || header.size > kPipeZygoteMaxArgSize || header.numFds != pData->numFds)
+        {
+            carla_stderr2("CarlaPipeZygoteClient - invalid request");
+            pData->closeFds();
+            return false;
+        }
+
+        if (! zygoteRecv(pData->socket, pData->recvArgs, header.size, 0))
+        {
+            pData->closeFds();
+            return false;
+        }
+
+        if (pData->parseArgs(header))
+        {
+            // forked clients are reaped automatically, a shared zygote might have children of its own
+            if (header.instanceId == 0 && ! pData->reaping)
+            {
+                ::signal(SIGCHLD, SIG_IGN);
+                pData->reaping = true;
+            }
+
+            pData->instanceId = header.instanceId;
+            return true;
+        }
+
+        // a shared zygote is not expected to reply, the server sees the pipes closing instead
+        carla_stderr2("CarlaPipeZygoteClient - invalid request arguments");
+        if (header.instanceId == 0)
+            pData->reply(-1);
+        pData->closeFds();
+    }
+#else
+    return false;
+#endif
+}
+
+const char** CarlaPipeZygoteClient::getClientArgv() const noexcept
+{
+#ifndef CARLA_OS_WIN
+    return (pData->argv[0] != nullptr) ? pData->argv : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+uint32_t CarlaPipeZygoteClient::getClientInstanceId() const noexcept
+{
+#ifndef CARLA_OS_WIN
+    return pData->instanceId;
+#else
+    return 0;
+#endif
+}
+
+void CarlaPipeZygoteClient::setupForkedClient() noexcept
+{
+    carla_debug("CarlaPipeZygoteClient::setupForkedClient()");
+
+#ifndef CARLA_OS_WIN
+    ::signal(SIGCHLD, SIG_DFL);
+
+    pData->closeSocket();
+
+    // the fds now belong to the client
+    pData->numFds = 0;
+
+    carla_trace_forked();
+#endif
+}
+
+void CarlaPipeZygoteClient::setupHostedClient() noexcept
+{
+    carla_debug("CarlaPipeZygoteClient::setupHostedClient()");
+
+#ifndef CARLA_OS_WIN
+    CARLA_SAFE_ASSERT(pData->instanceId != 0);
+
+    // the fds now belong to the client, but must not leak into anything this process spawns
+    for (uint32_t i=0; i < pData->numFds; ++i)
+    {
+        try { ::fcntl(pData->fds[i], F_SETFD, FD_CLOEXEC); } CARLA_SAFE_EXCEPTION("fcntl(fds[i], FD_CLOEXEC)");
+    }
+
+    pData->numFds = 0;
+#endif
+}
+
+void CarlaPipeZygoteClient::finishRequest(const int pid) noexcept
+{
+    carla_debug("CarlaPipeZygoteClient::finishRequest(%i)", pid);
+
+#ifndef CARLA_OS_WIN
+    pData->reply(static_cast<int32_t>(pid));
+    pData->closeFds();
+    pData->argv[0] = nullptr;
+#else
+    (void)pid;
+#endif
+}
+
+// -----------------------------------------------------------------------
+
 ScopedEnvVar::ScopedEnvVar(const char* const key, const char* const value) noexcept
     : fKey(nullptr),
       fOrigValue(nullptr)
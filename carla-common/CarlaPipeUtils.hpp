@@ -32,6 +32,37 @@
 
 class CarlaPipeCommon
 {
+public:
+    /*!
+     * Protocol messages known to the pipe, see getMsgOpcode() and setMsgHandler().
+     */
+    enum MsgOpcode {
+        kPipeMsgUnknown = 0,
+        kPipeMsgControl,
+        kPipeMsgProgram,
+        kPipeMsgMidiProgram,
+        kPipeMsgConfigure,
+        kPipeMsgNote,
+        kPipeMsgAtom,
+        kPipeMsgUrid,
+        kPipeMsgUiOptions,
+        kPipeMsgUiTitle,
+        kPipeMsgShow,
+        kPipeMsgFocus,
+        kPipeMsgHide,
+        kPipeMsgQuit,
+        kPipeMsgSize,
+        kPipeMsgExiting,
+        kPipeMsgError,
+        kPipeMsgCount
+    };
+
+    /*!
+     * Get the opcode of message @a msg, or kPipeMsgUnknown if it is not a protocol message.
+     * This is a single lookup in a perfect hash table, whatever the number of messages.
+     */
+    static MsgOpcode getMsgOpcode(const char* const msg) noexcept;
+
 protected:
     /*!
      * Constructor.
@@ -44,11 +75,34 @@ protected:
     virtual ~CarlaPipeCommon() /*noexcept*/;
 
     /*!
-     * A message has been received (in the context of idlePipe()).
+     * A message without a handler has been received (in the context of idlePipe()).
      * If extra data is required, use any of the readNextLineAs* functions.
      * Returning true means the message has been handled and should not propagate to subclasses.
+     * By default nothing is done with it.
+     * @note: @a msg points into the pipe receive buffer and is only valid until the next read.
+     */
+    virtual bool msgReceived(const char* const msg) noexcept;
+
+    /*!
+     * Handler for the messages of one opcode, called in the context of idlePipe() like msgReceived().
+     * Returning false passes the message on to msgReceived(), as its keyword, along with the lines not read yet.
      */
-    virtual bool msgReceived(const char* const msg) noexcept = 0;
+    typedef bool (CarlaPipeCommon::*MsgHandler)();
+
+    /*!
+     * Register @a handler for messages of @a opcode, replacing the previous one, or remove it if null.
+     * Messages are dispatched through a table indexed by opcode, so adding handlers costs nothing to the others.
+     */
+    void setMsgHandler(const MsgOpcode opcode, const MsgHandler handler) noexcept;
+
+    /*!
+     * Register a member function of a subclass as handler for messages of @a opcode.
+     */
+    template <class T>
+    void setMsgHandler(const MsgOpcode opcode, bool (T::*const handler)()) noexcept
+    {
+        setMsgHandler(opcode, static_cast<MsgHandler>(handler));
+    }
 
     /*!
      * An error has occurred during the current requested operation.
@@ -67,13 +121,181 @@ public:
     bool isPipeRunning() const noexcept;
 
     /*!
-     * Check the pipe for new messages and send them to msgReceived().
+     * Check the pipe for new messages and send them to their handler, or msgReceived() if they have none.
      */
     void idlePipe(const bool onlyOnce = false) noexcept;
 
+    /*!
+     * Block until new messages might be available, or the timeout is reached.
+     * Returns false if the pipe is not running or the other side closed it.
+     * Meant for a dedicated thread that calls idlePipe() afterwards.
+     */
+    bool waitForPipeMessages(const uint32_t timeOutMilliseconds) const noexcept;
+
+    /*!
+     * Get ready to wait for new messages together with other pipes, in a single poll() for input.
+     * Returns the file descriptor to poll, or -1 if messages might be available already and idlePipe() should be called.
+     * Always call finishPipeWait() afterwards. Not supported on Windows, where this always returns -1.
+     */
+    int preparePipeWait() const noexcept;
+
+    /*!
+     * Finish a wait started with preparePipeWait().
+     */
+    void finishPipeWait() const noexcept;
+
+    // -------------------------------------------------------------------
+    // binary protocol
+
+    /*!
+     * Allow using the binary protocol instead of text.
+     * A client will request it and a server will accept it during the first-message handshake.
+     * Must be called before the pipe is started, the text protocol is used if the other side does not agree.
+     */
+    void setPipeBinaryModeAllowed(const bool allowed) noexcept;
+
+    /*!
+     * Check if the pipe is using the binary protocol.
+     * Messages are read and written the same way in both modes, but the binary protocol
+     * sends each message as a single length-prefixed block and control values as raw floats.
+     */
+    bool isPipeInBinaryMode() const noexcept;
+
+    // -------------------------------------------------------------------
+    // shared memory transport
+
+    /*!
+     * Allow sending message data through shared memory ring buffers instead of the pipes (Linux only).
+     * A server creates the shared memory and passes it to the client as an extra argument,
+     * a client attaches to it if present. The pipes are still used for the first-message handshake.
+     * Must be called before the pipe is started, pipes are used if the other side does not agree.
+     * A blocking write to a full ring waits up to 2 seconds for the reader on the calling thread,
+     * see setPipeNonBlockingSend() to keep what does not fit in a backlog instead.
+     */
+    void setPipeSharedMemoryAllowed(const bool allowed) noexcept;
+
+    /*!
+     * Check if message data is going through shared memory.
+     */
+    bool isPipeUsingSharedMemory() const noexcept;
+
+    // -------------------------------------------------------------------
+    // output buffer
+
+    /*!
+     * Counters for data written to the other side.
+     * A flush is one flushMessages() call without output buffer, or one write of the output buffer.
+     * The backlog ones are only used with non-blocking send, sizes are in bytes.
+     */
+    struct OutputStats {
+        uint64_t flushes;
+        uint64_t bytes;
+        uint64_t syscalls;
+        uint64_t backlogSize;
+        uint64_t backlogPeak;
+        uint64_t coalesced;
+        uint64_t dropped;
+    };
+
+    /*!
+     * Collect written messages in a user-space buffer instead of writing each one right away.
+     * The buffer is written in one go by drainMessages(), or by flushMessages() once it is
+     * too big or its oldest data is too old. Message order is kept either way.
+     */
+    void setPipeOutputBuffered(const bool buffered) noexcept;
+
+    /*!
+     * Write out everything collected in the output buffer and retry the send backlog.
+     * Must be called regularly when using an output buffer or non-blocking send, typically once per idle.
+     * Takes the write lock internally.
+     */
+    bool drainMessages() const noexcept;
+
+    /*!
+     * Get the output counters.
+     */
+    void getPipeOutputStats(OutputStats& stats) const noexcept;
+
+    // -------------------------------------------------------------------
+    // runtime statistics
+
+    /*!
+     * Number of buckets in the PipeStats histograms.
+     */
+    static const uint kPipeStatsHistogramSize = 16;
+
+    /*!
+     * Runtime counters of a pipe, see getPipeStats().
+     * "In" is what came from the other side, "out" what was written to it, times are in microseconds.
+     * Histogram bucket N counts durations below 2^N microseconds, the last bucket also counts everything longer.
+     * @a readTime is the time _readlineblock() waited for data, @a writeTime the time of writes to the pipe
+     * or shared memory (sampled, 1 in 32 writes is timed) and @a lockWaitTime the time spent blocked on the
+     * write lock while another thread held it.
+     */
+    struct PipeStats {
+        uint64_t messagesIn;
+        uint64_t messagesOut;
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+        uint64_t readSyscalls;
+        uint64_t writeSyscalls;
+        uint64_t readEagains;
+        uint64_t writeEagains;
+        uint64_t readTimeouts;
+        uint64_t lockWaits;
+        uint64_t lockWaitTimeTotal;
+        uint64_t maxLineLength;
+        uint64_t readTime[kPipeStatsHistogramSize];
+        uint64_t writeTime[kPipeStatsHistogramSize];
+        uint64_t lockWaitTime[kPipeStatsHistogramSize];
+    };
+
+    /*!
+     * Get the runtime counters.
+     * Can be called from any thread, counters updated at the same time might be slightly out of sync.
+     */
+    void getPipeStats(PipeStats& stats) const noexcept;
+
+    /*!
+     * Write the runtime counters to @a file as a single line of key=value pairs.
+     * This also happens periodically from idlePipe() when the MODGUI_PIPE_STATS env var is set to an
+     * interval in seconds, to stderr or to the file named by MODGUI_PIPE_STATS_FILE.
+     */
+    void dumpPipeStats(FILE* const file) const noexcept;
+
+    // -------------------------------------------------------------------
+    // non-blocking send
+
+    /*!
+     * What to do with messages while the other side is not reading fast enough.
+     * Show, hide, focus and quit messages are never dropped.
+     */
+    enum SendBacklogPolicy {
+        /*! A control message replaces a pending one for the same index. */
+        kSendBacklogCoalesceControls = 1 << 0,
+        /*! Messages that do not fit the backlog are dropped, instead of waiting for the other side. */
+        kSendBacklogDropOnOverflow = 1 << 1
+    };
+
+    /*!
+     * Never block when writing, keeping whatever the other side cannot take yet in a backlog.
+     * The backlog is retried on every write and by drainMessages(), and holds up to @a maxBacklogSize bytes.
+     * Must be called before starting the pipe. Has no effect on Windows.
+     */
+    void setPipeNonBlockingSend(const bool nonBlocking,
+                                const std::size_t maxBacklogSize = 0x40000,
+                                const uint policy = kSendBacklogCoalesceControls|kSendBacklogDropOnOverflow) noexcept;
+
     // -------------------------------------------------------------------
     // write lock
 
+    /*!
+     * Skip the write mutex entirely, for pipes that are only ever written and started or stopped by a single thread.
+     * Debug builds check that this holds, and that writes always happen while the pipe is locked.
+     * Must be called before starting the pipe.
+     */
+    void setPipeSingleWriter(const bool singleWriter) noexcept;
+
     /*!
      * Lock the pipe write mutex.
      */
@@ -92,11 +314,12 @@ public:
 
     /*!
      * Get the pipe write lock.
+     * Not taken in single writer mode, and locking it directly bypasses the debug ownership checks.
      */
     CarlaMutex& getPipeLock() const noexcept;
 
     // -------------------------------------------------------------------
-    // read lines, must only be called in the context of msgReceived()
+    // read lines, must only be called in the context of a message handler or msgReceived()
 
     /*!
      * Read the next line as a boolean.
@@ -144,6 +367,26 @@ public:
      */
     bool readNextLineAsString(const char*& value) const noexcept;
 
+    /*!
+     * Read the next line as a string, optionally without allocating it.
+     * @note: if @a allocateString is true @a value must be deleted if valid,
+     *        otherwise it points into the pipe receive buffer and is only valid until the next read.
+     */
+    bool readNextLineAsString(const char*& value, const bool allocateString) const noexcept;
+
+    /*!
+     * Read the atom of an "atom" message, after its index and size lines.
+     * In binary mode the atom is used in place from the receive buffer, otherwise it gets decoded from base64.
+     * The atom may be modified and stays valid until the next read.
+     */
+    bool readNextLineAsAtom(LV2_Atom*& atom) const noexcept;
+
+    /*!
+     * Read the next line as base64 data, decoding it straight into @a buffer.
+     * @a size gets the decoded size. Fails if the line is not valid base64 or does not fit.
+     */
+    bool readNextLineAsBase64(void* const buffer, const std::size_t bufferSize, std::size_t& size) const noexcept;
+
     // -------------------------------------------------------------------
     // write messages, must be locked before calling
 
@@ -165,7 +408,9 @@ public:
     bool writeAndFixMessage(const char* const msg) const noexcept;
 
     /*!
-     * Flush all messages currently in cache.
+     * Finish the messages written so far.
+     * Without output buffer they are already written, with it they are only written
+     * if the buffer needs to be drained.
      */
     bool flushMessages() const noexcept;
 
@@ -221,10 +466,10 @@ protected:
     // -------------------------------------------------------------------
 
     /*! @internal */
-    const char* _readline() const noexcept;
+    const char* _readline(const bool allocReturn) const noexcept;
 
     /*! @internal */
-    const char* _readlineblock(const uint32_t timeOutMilliseconds = 50) const noexcept;
+    const char* _readlineblock(const bool allocReturn, const uint32_t timeOutMilliseconds = 50) const noexcept;
 
     /*! @internal */
     bool _writeMsgBuffer(const char* const msg, const std::size_t size) const noexcept;
@@ -232,6 +477,8 @@ protected:
     CARLA_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CarlaPipeCommon)
 };
 
+class CarlaPipeZygote;
+
 // -----------------------------------------------------------------------
 // CarlaPipeServer class
 
@@ -257,21 +504,66 @@ public:
 
     /*!
      * Start the pipe server using @a filename with 2 arguments.
+     * Blocks until the client answers, for up to 10 seconds.
      * @see fail()
      */
     bool startPipeServer(const char* const filename, const char* const arg1, const char* const arg2) noexcept;
 
+    /*!
+     * Start the pipe server using @a filename with 2 arguments, without waiting for the client to answer.
+     * Call idlePipeServerStart() until isPipeServerStarting() returns false, the pipe is running from then on.
+     * Returns false if the client process could not be started.
+     * @see fail()
+     */
+    bool startPipeServerAsync(const char* const filename, const char* const arg1, const char* const arg2) noexcept;
+
+    /*!
+     * Check if the client started by startPipeServerAsync() did not answer yet.
+     */
+    bool isPipeServerStarting() const noexcept;
+
+    /*!
+     * Check for the answer of the client started by startPipeServerAsync(), without blocking.
+     * Returns false if the client failed to start or did not answer within 10 seconds, it is then killed.
+     */
+    bool idlePipeServerStart() noexcept;
+
     /*!
      * Stop the pipe server.
      * This will send a quit message to the client, wait for it to close for @a timeOutMilliseconds, and close the pipes.
      */
     void stopPipeServer(const uint32_t timeOutMilliseconds) noexcept;
 
+    /*!
+     * Stop the pipe server without waiting for the child process.
+     * This sends the quit message and closes the pipes right away, the child is then left to a background reaper
+     * which sends SIGTERM halfway through @a timeOutMilliseconds and SIGKILL once it is over.
+     */
+    void stopPipeServerAsync(const uint32_t timeOutMilliseconds) noexcept;
+
+    /*!
+     * Check if the child process has exited, without blocking.
+     * Uses a pidfd where available, so this is cheap enough to call on every idle.
+     * Once this returns true the child is gone, stopping the pipe server only closes the pipes.
+     */
+    bool hasPipeClientExited() noexcept;
+
     /*!
      * Close the pipes without waiting for the child process to terminate.
      */
     void closePipeServer() noexcept;
 
+    /*!
+     * Start clients through @a zygote while it is running, instead of spawning a new process.
+     * Falls back to spawning if the zygote is not running or not ready yet.
+     * The zygote's reply is polled by idlePipeServerStart() along with the handshake, a failed fork fails the start.
+     * With a shared zygote the client is hosted in its process, stopPipeServer() then only waits for it to drop the pipes.
+     * The zygote must be for the same filename, and outlive calls to startPipeServer().
+     * Pass null to always spawn.
+     * @note: Unsupported on Windows
+     */
+    void setPipeZygote(CarlaPipeZygote* const zygote) noexcept;
+
     // -------------------------------------------------------------------
     // write prepared messages, no lock or flush needed (done internally)
 
@@ -311,7 +603,7 @@ public:
 
     /*!
      * Initialize the pipes used by a server.
-     * @a argv must match the arguments set the by server.
+     * @a argv must match the arguments set the by server, including the null terminator.
      */
     bool initPipeClient(const char* argv[]) noexcept;
 
@@ -323,6 +615,139 @@ public:
     CARLA_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CarlaPipeClient)
 };
 
+// -----------------------------------------------------------------------
+// CarlaPipeZygote class
+
+/*!
+ * A long-lived, pre-initialized client process, which forks a new client for each CarlaPipeServer::startPipeServer().
+ * This skips the startup of the client program (interpreter, libraries, etc) for every client but the first.
+ *
+ * The zygote process is started as "filename --zygote <socket>" and must use CarlaPipeZygoteClient to take requests.
+ * Clients forked from it are not children of the server process, the zygote takes care of reaping them.
+ *
+ * A shared zygote, started as "filename --shared <socket>", hosts all clients in its own process instead of forking.
+ * Each client still gets its own pipes, requests carry an instance id the zygote uses to tell them apart.
+ * The server does not wait for a reply then, a client the zygote cannot host fails its handshake instead.
+ * @note: Unsupported on Windows
+ */
+class CarlaPipeZygote
+{
+public:
+    /*!
+     * Constructor.
+     */
+    CarlaPipeZygote() noexcept;
+
+    /*!
+     * Destructor, stops the zygote if running.
+     */
+    ~CarlaPipeZygote() /*noexcept*/;
+
+    /*!
+     * Start the zygote process using @a filename, as a shared zygote if @a shared is true.
+     */
+    bool startZygote(const char* const filename, const bool shared = false) noexcept;
+
+    /*!
+     * Stop the zygote process, waiting up to @a timeOutMilliseconds for it to exit.
+     * Clients already forked from it keep running, clients hosted by a shared zygote are gone.
+     */
+    void stopZygote(const uint32_t timeOutMilliseconds) noexcept;
+
+    /*!
+     * Check if the zygote process is running.
+     */
+    bool isZygoteRunning() const noexcept;
+
+    /*!
+     * Check if the zygote finished its initialization, without blocking.
+     * Until then clients are spawned instead, except for a shared zygote which gets the requests queued.
+     */
+    bool isZygoteReady() noexcept;
+
+    /*!
+     * Get the filename the zygote was started with, or null if not running.
+     */
+    const char* getZygoteFilename() const noexcept;
+
+    // -------------------------------------------------------------------
+
+private:
+    struct PrivateData;
+    PrivateData* const pData;
+
+    friend class CarlaPipeServer;
+
+    CARLA_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CarlaPipeZygote)
+};
+
+// -----------------------------------------------------------------------
+// CarlaPipeZygoteClient class
+
+/*!
+ * The zygote side of CarlaPipeZygote.
+ * Each request carries the arguments and pipes for a new client, which the zygote process must fork.
+ * In the forked client call setupForkedClient() and then use getClientArgv() for CarlaPipeClient::initPipeClient(),
+ * in the zygote call finishRequest() with the pid of the new client.
+ * A shared zygote calls setupHostedClient() instead of forking, and does not call finishRequest().
+ * The first request to fork makes the zygote process reap its children automatically.
+ * @note: Unsupported on Windows
+ */
+class CarlaPipeZygoteClient
+{
+public:
+    /*!
+     * Constructor, taking the socket number given in the zygote arguments.
+     * Create it once the zygote process is initialized, the server does not send requests before.
+     */
+    CarlaPipeZygoteClient(const int socket) noexcept;
+
+    /*!
+     * Destructor.
+     */
+    ~CarlaPipeZygoteClient() /*noexcept*/;
+
+    /*!
+     * Wait for the next request.
+     * Returns false when the server process stopped the zygote or is gone.
+     */
+    bool waitForRequest() noexcept;
+
+    /*!
+     * Get the arguments of the new client, valid until the next request.
+     */
+    const char** getClientArgv() const noexcept;
+
+    /*!
+     * Get the instance id of the new client, or 0 if the zygote is not shared.
+     */
+    uint32_t getClientInstanceId() const noexcept;
+
+    /*!
+     * Prepare the forked client, closing the zygote connection.
+     */
+    void setupForkedClient() noexcept;
+
+    /*!
+     * Keep the pipes of the new client open in this process, for a shared zygote.
+     * The arguments stay valid until the next request.
+     */
+    void setupHostedClient() noexcept;
+
+    /*!
+     * Finish the current request after forking, reporting @a pid to the server (-1 if fork failed).
+     */
+    void finishRequest(const int pid) noexcept;
+
+    // -------------------------------------------------------------------
+
+private:
+    struct PrivateData;
+    PrivateData* const pData;
+
+    CARLA_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CarlaPipeZygoteClient)
+};
+
 // -----------------------------------------------------------------------
 // ScopedEnvVar class
 
@@ -18,6 +18,7 @@
 #ifndef CARLA_STRING_HPP_INCLUDED
 #define CARLA_STRING_HPP_INCLUDED
 
+#include "CarlaBase64Utils.hpp"
 #include "CarlaJuceUtils.hpp"
 #include "CarlaMathUtils.hpp"
 
@@ -34,15 +35,19 @@ public:
      * Empty string.
      */
     explicit CarlaString() noexcept
-        : fBuffer(_null()),
-          fBufferLen(0) {}
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline() {}
 
     /*
      * Simple character.
      */
     explicit CarlaString(const char c) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char ch[2];
         ch[0] = c;
@@ -55,8 +60,10 @@ public:
      * Simple char string.
      */
     explicit CarlaString(char* const strBuf) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         _dup(strBuf);
     }
@@ -65,8 +72,10 @@ public:
      * Simple const char string.
      */
     explicit CarlaString(const char* const strBuf) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         _dup(strBuf);
     }
@@ -75,8 +84,10 @@ public:
      * Integer.
      */
     explicit CarlaString(const int value) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, "%d", value);
@@ -89,8 +100,10 @@ public:
      * Unsigned integer, possibly in hexadecimal.
      */
     explicit CarlaString(const unsigned int value, const bool hexadecimal = false) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, hexadecimal ? "0x%x" : "%u", value);
@@ -103,8 +116,10 @@ public:
      * Long integer.
      */
     explicit CarlaString(const long value) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, "%ld", value);
@@ -117,8 +132,10 @@ public:
      * Long unsigned integer, possibly hexadecimal.
      */
     explicit CarlaString(const unsigned long value, const bool hexadecimal = false) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, hexadecimal ? "0x%lx" : "%lu", value);
@@ -131,8 +148,10 @@ public:
      * Long long integer.
      */
     explicit CarlaString(const long long value) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, "%lld", value);
@@ -145,8 +164,10 @@ public:
      * Long long unsigned integer, possibly hexadecimal.
      */
     explicit CarlaString(const unsigned long long value, const bool hexadecimal = false) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, hexadecimal ? "0x%llx" : "%llu", value);
@@ -159,8 +180,10 @@ public:
      * Single-precision floating point number.
      */
     explicit CarlaString(const float value) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, "%f", value);
@@ -173,8 +196,10 @@ public:
      * Double-precision floating point number.
      */
     explicit CarlaString(const double value) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
         char strBuf[0xff+1];
         std::snprintf(strBuf, 0xff, "%g", value);
@@ -190,12 +215,28 @@ public:
      * Create string from another string.
      */
     CarlaString(const CarlaString& str) noexcept
-        : fBuffer(_null()),
-          fBufferLen(0)
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
     {
-        _dup(str.fBuffer);
+        _dup(str.fBuffer, str.fBufferLen);
     }
 
+#ifdef CARLA_PROPER_CPP11_SUPPORT
+    /*
+     * Take over the contents of another string, leaving it empty.
+     */
+    CarlaString(CarlaString&& str) noexcept
+        : fBuffer(fBufferInline),
+          fBufferLen(0),
+          fBufferAlloc(0),
+          fBufferInline()
+    {
+        _move(str);
+    }
+#endif
+
     // -------------------------------------------------------------------
     // destructor
 
@@ -206,13 +247,12 @@ public:
     {
         CARLA_SAFE_ASSERT_RETURN(fBuffer != nullptr,);
 
-        if (fBuffer == _null())
-            return;
-
-        std::free(fBuffer);
+        if (fBuffer != fBufferInline)
+            std::free(fBuffer);
 
-        fBuffer    = nullptr;
-        fBufferLen = 0;
+        fBuffer      = nullptr;
+        fBufferLen   = 0;
+        fBufferAlloc = 0;
     }
 
     // -------------------------------------------------------------------
@@ -257,7 +297,7 @@ public:
             CarlaString tmp1(fBuffer), tmp2(strBuf);
 
             // memory allocation failed or empty string(s)
-            if (tmp1.fBuffer == _null() || tmp2.fBuffer == _null())
+            if (tmp1.isEmpty() || tmp2.isEmpty())
                 return false;
 
             tmp1.toLower();
@@ -463,6 +503,86 @@ public:
         truncate(0);
     }
 
+    /*
+     * Make room for a string of 'size' characters, so appending up to that size does not allocate.
+     * Returns false if memory allocation failed.
+     */
+    bool reserve(const std::size_t size) noexcept
+    {
+        return _reserve(size, false);
+    }
+
+    /*
+     * Append 'size' characters of 'strBuf'.
+     * The buffer grows geometrically, so building a string with many appends allocates only a few times.
+     */
+    CarlaString& append(const char* strBuf, const std::size_t size) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(strBuf != nullptr || size == 0, *this);
+
+        if (size == 0)
+            return *this;
+
+        // appending (part of) ourselves, the buffer may move
+        const bool isSelf(strBuf >= fBuffer && strBuf <= fBuffer + fBufferLen);
+        const std::size_t selfOffset(isSelf ? static_cast<std::size_t>(strBuf - fBuffer) : 0);
+
+        if (! _reserve(fBufferLen + size, true))
+            return *this;
+
+        if (isSelf)
+            strBuf = fBuffer + selfOffset;
+
+        std::memmove(fBuffer + fBufferLen, strBuf, size);
+        fBufferLen += size;
+        fBuffer[fBufferLen] = '\0';
+
+        return *this;
+    }
+
+    /*
+     * Append printf-style formatted text.
+     * Formats directly into the free space of the buffer, growing it once if needed.
+     */
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    CarlaString& appendFormat(const char* const format, ...) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(format != nullptr, *this);
+
+        const std::size_t available(_capacity() - fBufferLen);
+
+        va_list args;
+        va_start(args, format);
+        const int ret(std::vsnprintf(fBuffer + fBufferLen, available, format, args));
+        va_end(args);
+
+        if (ret < 0)
+        {
+            fBuffer[fBufferLen] = '\0';
+            return *this;
+        }
+
+        const std::size_t size(static_cast<std::size_t>(ret));
+
+        if (size >= available)
+        {
+            if (! _reserve(fBufferLen + size, true))
+            {
+                fBuffer[fBufferLen] = '\0';
+                return *this;
+            }
+
+            va_start(args, format);
+            std::vsnprintf(fBuffer + fBufferLen, size + 1, format, args);
+            va_end(args);
+        }
+
+        fBufferLen += size;
+        return *this;
+    }
+
     /*
      * Replace all occurrences of character 'before' with character 'after'.
      */
@@ -575,77 +695,20 @@ public:
     }
 
     // -------------------------------------------------------------------
-    // base64 stuff, based on http://www.adp-gmbh.ch/cpp/common/base64.html
-    // Copyright (C) 2004-2008 René Nyffenegger
+    // base64 stuff
 
     static CarlaString asBase64(const void* const data, const std::size_t dataSize)
     {
-        static const char* const kBase64Chars =
-            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-            "abcdefghijklmnopqrstuvwxyz"
-            "0123456789+/";
-
-        const std::size_t kTmpBufSize = carla_nextPowerOf2(static_cast<uint32_t>(dataSize/3));
-
-        const uchar* bytesToEncode((const uchar*)data);
-
-        uint i=0, j=0;
-        uint charArray3[3], charArray4[4];
-
-        char strBuf[kTmpBufSize+1];
-        strBuf[kTmpBufSize] = '\0';
-        std::size_t strBufIndex = 0;
-
         CarlaString ret;
 
-        for (std::size_t s=0; s<dataSize; ++s)
-        {
-            charArray3[i++] = *(bytesToEncode++);
-
-            if (i == 3)
-            {
-                charArray4[0] =  (charArray3[0] & 0xfc) >> 2;
-                charArray4[1] = ((charArray3[0] & 0x03) << 4) + ((charArray3[1] & 0xf0) >> 4);
-                charArray4[2] = ((charArray3[1] & 0x0f) << 2) + ((charArray3[2] & 0xc0) >> 6);
-                charArray4[3] =   charArray3[2] & 0x3f;
-
-                for (i=0; i<4; ++i)
-                    strBuf[strBufIndex++] = kBase64Chars[charArray4[i]];
-
-                if (strBufIndex >= kTmpBufSize-7)
-                {
-                    strBuf[strBufIndex] = '\0';
-                    strBufIndex = 0;
-                    ret += strBuf;
-                }
-
-                i = 0;
-            }
-        }
-
-        if (i != 0)
-        {
-            for (j=i; j<3; ++j)
-              charArray3[j] = '\0';
-
-            charArray4[0] =  (charArray3[0] & 0xfc) >> 2;
-            charArray4[1] = ((charArray3[0] & 0x03) << 4) + ((charArray3[1] & 0xf0) >> 4);
-            charArray4[2] = ((charArray3[1] & 0x0f) << 2) + ((charArray3[2] & 0xc0) >> 6);
-            charArray4[3] =   charArray3[2] & 0x3f;
-
-            for (j=0; j<4 && i<3 && j<i+1; ++j)
-                strBuf[strBufIndex++] = kBase64Chars[charArray4[j]];
+        if (dataSize == 0)
+            return ret;
 
-            for (; i++ < 3;)
-                strBuf[strBufIndex++] = '=';
-        }
-
-        if (strBufIndex != 0)
-        {
-            strBuf[strBufIndex] = '\0';
-            ret += strBuf;
-        }
+        CARLA_SAFE_ASSERT_RETURN(ret.reserve(carla_base64EncodedSize(dataSize)), ret);
 
+        // encoded in place, without intermediate copies
+        ret.fBufferLen = carla_base64Encode(data, dataSize, ret.fBuffer);
+        ret.fBuffer[ret.fBufferLen] = '\0';
         return ret;
     }
 
@@ -710,43 +773,46 @@ public:
 
     CarlaString& operator=(const CarlaString& str) noexcept
     {
-        _dup(str.fBuffer);
+        _dup(str.fBuffer, str.fBufferLen);
 
         return *this;
     }
 
+#ifdef CARLA_PROPER_CPP11_SUPPORT
+    CarlaString& operator=(CarlaString&& str) noexcept
+    {
+        if (&str != this)
+        {
+            _dup(nullptr);
+            _move(str);
+        }
+
+        return *this;
+    }
+#endif
+
     CarlaString& operator+=(const char* const strBuf) noexcept
     {
         if (strBuf == nullptr)
             return *this;
 
-        const std::size_t newBufSize = fBufferLen + std::strlen(strBuf) + 1;
-        char              newBuf[newBufSize];
-
-        std::strcpy(newBuf, fBuffer);
-        std::strcat(newBuf, strBuf);
-
-        _dup(newBuf, newBufSize-1);
-
-        return *this;
+        return append(strBuf, std::strlen(strBuf));
     }
 
     CarlaString& operator+=(const CarlaString& str) noexcept
     {
-        return operator+=(str.fBuffer);
+        return append(str.fBuffer, str.fBufferLen);
     }
 
     CarlaString operator+(const char* const strBuf) noexcept
     {
-        const std::size_t newBufSize = fBufferLen + ((strBuf != nullptr) ? std::strlen(strBuf) : 0) + 1;
-        char              newBuf[newBufSize];
-
-        std::strcpy(newBuf, fBuffer);
+        const std::size_t strBufLen((strBuf != nullptr) ? std::strlen(strBuf) : 0);
 
-        if (strBuf != nullptr)
-            std::strcat(newBuf, strBuf);
-
-        return CarlaString(newBuf);
+        CarlaString ret;
+        ret.reserve(fBufferLen + strBufLen);
+        ret.append(fBuffer, fBufferLen);
+        ret.append(strBuf, strBufLen);
+        return ret;
     }
 
     CarlaString operator+(const CarlaString& str) noexcept
@@ -757,65 +823,137 @@ public:
     // -------------------------------------------------------------------
 
 private:
-    char*       fBuffer;    // the actual string buffer
-    std::size_t fBufferLen; // string length
+    // strings up to this size (including the terminating null) are kept inline, without allocating
+    static const std::size_t kInlineSize = 24;
+
+    char*       fBuffer;       // the actual string buffer, either fBufferInline or allocated
+    std::size_t fBufferLen;    // string length
+    std::size_t fBufferAlloc;  // size of the allocated buffer, 0 when using fBufferInline
+    char        fBufferInline[kInlineSize];
 
     /*
-     * Static null string.
-     * Prevents allocation for new and/or empty strings.
+     * Size of the current buffer, including space for the terminating null.
      */
-    static char* _null() noexcept
+    std::size_t _capacity() const noexcept
     {
-        static char sNull = '\0';
-        return &sNull;
+        if (fBufferAlloc != 0)
+            return fBufferAlloc;
+
+        return kInlineSize;
     }
 
     /*
      * Helper function.
-     * Called whenever the string needs to be allocated.
+     * Makes sure the buffer can hold 'size' characters plus the terminating null.
+     * Contents are kept, 'geometric' grows to at least twice the current size, for repeated appends.
+     * The buffer is never shrunk.
+     */
+    bool _reserve(const std::size_t size, const bool geometric) noexcept
+    {
+        const std::size_t capacity(_capacity());
+
+        if (size < capacity)
+            return true;
+
+        std::size_t newAlloc = size + 1;
+
+        if (geometric && newAlloc < capacity * 2)
+            newAlloc = capacity * 2;
+
+        char* newBuf;
+
+        if (fBuffer != fBufferInline)
+        {
+            newBuf = (char*)std::realloc(fBuffer, newAlloc);
+        }
+        else
+        {
+            newBuf = (char*)std::malloc(newAlloc);
+
+            if (newBuf != nullptr)
+                std::memcpy(newBuf, fBufferInline, fBufferLen + 1);
+        }
+
+        CARLA_SAFE_ASSERT_RETURN(newBuf != nullptr, false);
+
+        fBuffer      = newBuf;
+        fBufferAlloc = newAlloc;
+        return true;
+    }
+
+    /*
+     * Helper function.
+     * Take over the contents of 'str', which must not be this string, and leave it empty.
+     * The current buffer must be the inline one.
+     */
+    void _move(CarlaString& str) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(fBuffer == fBufferInline,);
+
+        if (str.fBuffer != str.fBufferInline)
+        {
+            fBuffer      = str.fBuffer;
+            fBufferAlloc = str.fBufferAlloc;
+        }
+        else
+        {
+            std::memcpy(fBufferInline, str.fBufferInline, str.fBufferLen + 1);
+        }
+
+        fBufferLen = str.fBufferLen;
+
+        str.fBuffer      = str.fBufferInline;
+        str.fBufferLen   = 0;
+        str.fBufferAlloc = 0;
+        str.fBufferInline[0] = '\0';
+    }
+
+    /*
+     * Helper function.
+     * Called whenever the string contents are replaced.
      *
      * Notes:
-     * - Allocates string only if 'strBuf' is not null and new string contents are different
-     * - If 'strBuf' is null, 'size' must be 0
+     * - Allocates only if 'strBuf' does not fit in the current buffer, which is reused otherwise
+     * - 'strBuf' may point into this string
+     * - If 'strBuf' is null, 'size' must be 0, the string is emptied and its allocated buffer released
      */
     void _dup(const char* const strBuf, const std::size_t size = 0) noexcept
     {
         if (strBuf != nullptr)
         {
-            // don't recreate string if contents match
-            if (std::strcmp(fBuffer, strBuf) == 0)
-                return;
-
-            if (fBuffer != _null())
-                std::free(fBuffer);
+            const std::size_t strBufLen((size > 0) ? size : std::strlen(strBuf));
 
-            fBufferLen = (size > 0) ? size : std::strlen(strBuf);
-            fBuffer    = (char*)std::malloc(fBufferLen+1);
+            // don't touch the string if contents match
+            if (strBufLen == fBufferLen && std::memcmp(fBuffer, strBuf, strBufLen) == 0)
+                return;
 
-            if (fBuffer == nullptr)
+            // 'strBuf' cannot be part of this string if it does not fit, so the old contents can go
+            if (strBufLen >= _capacity())
             {
-                fBuffer    = _null();
-                fBufferLen = 0;
-                return;
-            }
+                _dup(nullptr);
 
-            std::strcpy(fBuffer, strBuf);
+                if (! _reserve(strBufLen, false))
+                    return;
+            }
 
+            std::memmove(fBuffer, strBuf, strBufLen);
+            fBufferLen = strBufLen;
             fBuffer[fBufferLen] = '\0';
         }
         else
         {
             CARLA_SAFE_ASSERT(size == 0);
 
-            // don't recreate null string
-            if (fBuffer == _null())
-                return;
-
-            CARLA_SAFE_ASSERT(fBuffer != nullptr);
-            std::free(fBuffer);
+            if (fBuffer != fBufferInline)
+            {
+                CARLA_SAFE_ASSERT(fBuffer != nullptr);
+                std::free(fBuffer);
+            }
 
-            fBuffer    = _null();
-            fBufferLen = 0;
+            fBuffer      = fBufferInline;
+            fBufferLen   = 0;
+            fBufferAlloc = 0;
+            fBufferInline[0] = '\0';
         }
     }
 
@@ -827,27 +965,25 @@ private:
 static inline
 CarlaString operator+(const CarlaString& strBefore, const char* const strBufAfter) noexcept
 {
-    const char* const strBufBefore = strBefore.buffer();
-    const std::size_t newBufSize   = strBefore.length() + ((strBufAfter != nullptr) ? std::strlen(strBufAfter) : 0) + 1;
-    char newBuf[newBufSize];
+    const std::size_t strBufAfterLen((strBufAfter != nullptr) ? std::strlen(strBufAfter) : 0);
 
-    std::strcpy(newBuf, strBufBefore);
-    std::strcat(newBuf, strBufAfter);
-
-    return CarlaString(newBuf);
+    CarlaString ret;
+    ret.reserve(strBefore.length() + strBufAfterLen);
+    ret.append(strBefore.buffer(), strBefore.length());
+    ret.append(strBufAfter, strBufAfterLen);
+    return ret;
 }
 
 static inline
 CarlaString operator+(const char* const strBufBefore, const CarlaString& strAfter) noexcept
 {
-    const char* const strBufAfter = strAfter.buffer();
-    const std::size_t newBufSize  = ((strBufBefore != nullptr) ? std::strlen(strBufBefore) : 0) + strAfter.length() + 1;
-    char newBuf[newBufSize];
-
-    std::strcpy(newBuf, strBufBefore);
-    std::strcat(newBuf, strBufAfter);
+    const std::size_t strBufBeforeLen((strBufBefore != nullptr) ? std::strlen(strBufBefore) : 0);
 
-    return CarlaString(newBuf);
+    CarlaString ret;
+    ret.reserve(strBufBeforeLen + strAfter.length());
+    ret.append(strBufBefore, strBufBeforeLen);
+    ret.append(strAfter.buffer(), strAfter.length());
+    return ret;
 }
 
 // -----------------------------------------------------------------------
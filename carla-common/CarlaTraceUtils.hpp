@@ -0,0 +1,505 @@
+/*
+ * Carla trace utils
+ * Copyright (C) 2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the doc/GPL.txt file.
+ */
+
+#ifndef CARLA_TRACE_UTILS_HPP_INCLUDED
+#define CARLA_TRACE_UTILS_HPP_INCLUDED
+
+#include "CarlaUtils.hpp"
+
+/*
+ * In-process tracing of begin/end events, written as Chrome trace JSON (also loaded by Perfetto).
+ *
+ * Tracing is enabled by setting the MODGUI_TRACE env var to a filename.
+ * Every thread records into its own ring buffer, without locks, keeping the last kCarlaTraceRingSize events.
+ * The rings are written to the file on SIGUSR2 (only the events since the previous dump) and when the
+ * process exits or the library is unloaded.
+ *
+ * The env var is inherited by child processes, which append to the same file.
+ * Timestamps come from the system-wide monotonic clock and each event has the pid of its process,
+ * so host and UI timelines line up when the file is loaded.
+ * The file uses the JSON array format, where the closing ']' is optional.
+ *
+ * When the env var is not set the cost of an event is a single branch.
+ */
+
+#ifndef CARLA_OS_WIN
+# include <cerrno>
+# include <ctime>
+# include <fcntl.h>
+# include <pthread.h>
+# include <signal.h>
+# ifdef CARLA_OS_LINUX
+#  include <sys/syscall.h>
+# endif
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#ifndef CARLA_OS_WIN
+
+// number of events kept per thread, must be a power of 2
+static const uint32_t kCarlaTraceRingSize = 0x4000;
+
+// maximum number of names registered through carla_trace_intern()
+static const uint kCarlaTraceMaxInternedNames = 256;
+
+struct CarlaTraceEvent {
+    uint64_t time; // in nanoseconds
+    const char* name;
+    char phase;    // 'B' or 'E'
+};
+
+struct CarlaTraceRing {
+    CarlaTraceRing* next;
+    long tid;
+    uint32_t written; // only written by the owner thread
+    uint32_t dumped;  // only written while holding the dump flag
+    CarlaTraceEvent events[kCarlaTraceRingSize];
+};
+
+static bool            gCarlaTraceEnabled = false;
+static int             gCarlaTraceDumping = 0;
+static bool            gCarlaTraceNamed   = false;
+static CarlaTraceRing* gCarlaTraceRings   = nullptr;
+static char            gCarlaTraceFilename[1024];
+
+static __thread CarlaTraceRing* tCarlaTraceRing = nullptr;
+
+static const char*     gCarlaTraceNames[kCarlaTraceMaxInternedNames];
+static pthread_mutex_t gCarlaTraceNamesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// --------------------------------------------------------------------------------------------------------------------
+// recording
+
+static inline
+uint64_t carla_trace_time() noexcept
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return static_cast<uint64_t>(t.tv_sec) * 1000000000ULL + static_cast<uint64_t>(t.tv_nsec);
+}
+
+static inline
+long carla_trace_tid() noexcept
+{
+#ifdef CARLA_OS_LINUX
+    return static_cast<long>(::syscall(SYS_gettid));
+#else
+    return static_cast<long>(reinterpret_cast<uintptr_t>(::pthread_self()));
+#endif
+}
+
+/*
+ * Create the ring of the current thread and add it to the global list.
+ * Rings are never freed, a dump might still be reading them after their thread is gone.
+ */
+static inline
+CarlaTraceRing* carla_trace_new_ring() noexcept
+{
+    CarlaTraceRing* const ring((CarlaTraceRing*)std::calloc(1, sizeof(CarlaTraceRing)));
+    CARLA_SAFE_ASSERT_RETURN(ring != nullptr, nullptr);
+
+    ring->tid = carla_trace_tid();
+    ring->next = __atomic_load_n(&gCarlaTraceRings, __ATOMIC_RELAXED);
+
+    while (! __atomic_compare_exchange_n(&gCarlaTraceRings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+
+    tCarlaTraceRing = ring;
+    return ring;
+}
+
+/*
+ * Record an event for the current thread.
+ * @a name must stay valid until the process exits, use carla_trace_intern() for names that do not.
+ */
+static inline
+void carla_trace_event(const char* const name, const char phase) noexcept
+{
+    if (__builtin_expect(! gCarlaTraceEnabled, 1))
+        return;
+
+    CarlaTraceRing* ring(tCarlaTraceRing);
+
+    if (ring == nullptr && (ring = carla_trace_new_ring()) == nullptr)
+        return;
+
+    const uint32_t pos(ring->written);
+    CarlaTraceEvent& event(ring->events[pos & (kCarlaTraceRingSize - 1)]);
+    event.time  = carla_trace_time();
+    event.name  = name;
+    event.phase = phase;
+
+    __atomic_store_n(&ring->written, pos + 1, __ATOMIC_RELEASE);
+}
+
+static inline
+void carla_trace_begin(const char* const name) noexcept
+{
+    carla_trace_event(name, 'B');
+}
+
+static inline
+void carla_trace_end(const char* const name) noexcept
+{
+    carla_trace_event(name, 'E');
+}
+
+/*
+ * Get a copy of @a name that stays valid until the process exits, for names coming from scripts.
+ * Each distinct name is copied only once, but there can be at most kCarlaTraceMaxInternedNames of them.
+ */
+static inline
+const char* carla_trace_intern(const char* const name) noexcept
+{
+    CARLA_SAFE_ASSERT_RETURN(name != nullptr, "(null)");
+
+    const char* ret = "(too many names)";
+
+    pthread_mutex_lock(&gCarlaTraceNamesMutex);
+
+    for (uint i=0; i < kCarlaTraceMaxInternedNames; ++i)
+    {
+        if (gCarlaTraceNames[i] == nullptr)
+        {
+            gCarlaTraceNames[i] = carla_strdup_safe(name);
+
+            if (gCarlaTraceNames[i] != nullptr)
+                ret = gCarlaTraceNames[i];
+            break;
+        }
+
+        if (std::strcmp(gCarlaTraceNames[i], name) == 0)
+        {
+            ret = gCarlaTraceNames[i];
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&gCarlaTraceNamesMutex);
+    return ret;
+}
+
+/*
+ * Call in a process forked without exec, so it does not write the events of its parent again.
+ * Only the calling thread survives a fork, its ring now belongs to a new tid.
+ */
+static inline
+void carla_trace_forked() noexcept
+{
+    if (! gCarlaTraceEnabled)
+        return;
+
+    gCarlaTraceNamed = false;
+    __atomic_store_n(&gCarlaTraceDumping, 0, __ATOMIC_RELEASE);
+
+    for (CarlaTraceRing* ring = __atomic_load_n(&gCarlaTraceRings, __ATOMIC_ACQUIRE); ring != nullptr; ring = ring->next)
+        ring->dumped = ring->written;
+
+    if (tCarlaTraceRing != nullptr)
+        tCarlaTraceRing->tid = carla_trace_tid();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// dumping, only uses async-signal-safe calls
+
+struct CarlaTraceWriter {
+    int fd;
+    std::size_t used;
+    char buffer[0x2000];
+
+    CarlaTraceWriter(const int f) noexcept
+        : fd(f),
+          used(0) {}
+
+    ~CarlaTraceWriter() noexcept
+    {
+        flush();
+    }
+
+    void flush() noexcept
+    {
+        for (std::size_t written = 0; written < used;)
+        {
+            const ssize_t ret(::write(fd, buffer + written, used - written));
+
+            if (ret <= 0 && errno != EINTR)
+                break;
+            if (ret > 0)
+                written += static_cast<std::size_t>(ret);
+        }
+
+        used = 0;
+    }
+
+    void str(const char* s) noexcept
+    {
+        for (; *s != '\0'; ++s)
+            chr(*s);
+    }
+
+    // names are written as-is, except for the characters that would break the JSON string
+    void name(const char* s) noexcept
+    {
+        for (; *s != '\0'; ++s)
+            chr((*s == '"' || *s == '\\' || static_cast<uint8_t>(*s) < 0x20) ? '_' : *s);
+    }
+
+    void num(uint64_t value, const uint minDigits = 1) noexcept
+    {
+        char digits[20];
+        uint count = 0;
+
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0 || count < minDigits);
+
+        while (count != 0)
+            chr(digits[--count]);
+    }
+
+    void chr(const char c) noexcept
+    {
+        if (used == sizeof(buffer))
+            flush();
+
+        buffer[used++] = c;
+    }
+
+    // metadata event naming the process after its executable, or what carla_set_process_name() gave it
+    void processName(const uint64_t pid) noexcept
+    {
+        char comm[64];
+        ssize_t commSize = -1;
+
+#ifdef CARLA_OS_LINUX
+        const int commFd(::open("/proc/self/comm", O_RDONLY));
+
+        if (commFd >= 0)
+        {
+            commSize = ::read(commFd, comm, sizeof(comm) - 1);
+            ::close(commFd);
+        }
+#endif
+        if (commSize <= 0)
+        {
+            std::strcpy(comm, "process");
+            commSize = 7;
+        }
+        else if (comm[commSize - 1] == '\n')
+        {
+            --commSize;
+        }
+        comm[commSize] = '\0';
+
+        str("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+        num(pid);
+        str(",\"args\":{\"name\":\"");
+        name(comm);
+        str(" (");
+        num(pid);
+        str(")\"}},\n");
+    }
+
+    CARLA_DECLARE_NON_COPY_STRUCT(CarlaTraceWriter)
+};
+
+/*
+ * Append the events recorded since the previous dump to the trace file.
+ * Does nothing if a dump is already running, or tracing is disabled.
+ */
+static inline
+void carla_trace_dump() noexcept
+{
+    if (! gCarlaTraceEnabled)
+        return;
+    if (__atomic_exchange_n(&gCarlaTraceDumping, 1, __ATOMIC_ACQUIRE) != 0)
+        return;
+
+    bool pending = false;
+
+    for (CarlaTraceRing* ring = __atomic_load_n(&gCarlaTraceRings, __ATOMIC_ACQUIRE); ring != nullptr; ring = ring->next)
+    {
+        if (__atomic_load_n(&ring->written, __ATOMIC_ACQUIRE) != ring->dumped)
+        {
+            pending = true;
+            break;
+        }
+    }
+
+    if (! pending)
+    {
+        __atomic_store_n(&gCarlaTraceDumping, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    const int savedErrno(errno);
+
+    // the first process to dump creates the file and starts the JSON array
+    int fd(::open(gCarlaTraceFilename, O_WRONLY|O_CREAT|O_EXCL|O_APPEND, 0644));
+    const bool created(fd >= 0);
+
+    if (! created)
+        fd = ::open(gCarlaTraceFilename, O_WRONLY|O_APPEND);
+
+    if (fd >= 0)
+    {
+        const uint64_t pid(static_cast<uint64_t>(::getpid()));
+
+        {
+            CarlaTraceWriter w(fd);
+
+            if (created)
+                w.str("[\n");
+
+            if (! gCarlaTraceNamed)
+            {
+                w.processName(pid);
+                gCarlaTraceNamed = true;
+            }
+
+            for (CarlaTraceRing* ring = __atomic_load_n(&gCarlaTraceRings, __ATOMIC_ACQUIRE); ring != nullptr; ring = ring->next)
+            {
+                const uint32_t end(__atomic_load_n(&ring->written, __ATOMIC_ACQUIRE));
+                uint32_t pos(ring->dumped);
+
+                // older events were overwritten
+                if (end - pos > kCarlaTraceRingSize)
+                    pos = end - kCarlaTraceRingSize;
+
+                for (; pos != end; ++pos)
+                {
+                    const CarlaTraceEvent& event(ring->events[pos & (kCarlaTraceRingSize - 1)]);
+
+                    w.str("{\"name\":\"");
+                    w.name(event.name != nullptr ? event.name : "");
+                    w.str("\",\"ph\":\"");
+                    w.chr(event.phase);
+                    w.str("\",\"ts\":");
+                    w.num(event.time / 1000);
+                    w.chr('.');
+                    w.num(event.time % 1000, 3);
+                    w.str(",\"pid\":");
+                    w.num(pid);
+                    w.str(",\"tid\":");
+                    w.num(static_cast<uint64_t>(ring->tid));
+                    w.str("},\n");
+                }
+
+                ring->dumped = end;
+            }
+        }
+
+        ::close(fd);
+    }
+
+    errno = savedErrno;
+    __atomic_store_n(&gCarlaTraceDumping, 0, __ATOMIC_RELEASE);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// setup, done when the library or program is loaded
+
+static inline
+void carla_trace_signal_handler(int) noexcept
+{
+    carla_trace_dump();
+}
+
+struct CarlaTraceSetup {
+    CarlaTraceSetup() noexcept
+    {
+        const char* const filename(std::getenv("MODGUI_TRACE"));
+
+        if (filename == nullptr || filename[0] == '\0')
+            return;
+
+        CARLA_SAFE_ASSERT_RETURN(std::strlen(filename) < sizeof(gCarlaTraceFilename),);
+        std::strcpy(gCarlaTraceFilename, filename);
+
+        // leave SIGUSR2 alone if the program uses it for something else
+        struct sigaction sig;
+
+        if (::sigaction(SIGUSR2, nullptr, &sig) == 0 && sig.sa_handler == SIG_DFL)
+        {
+            carla_zeroStruct(sig);
+            sig.sa_handler = carla_trace_signal_handler;
+            sig.sa_flags   = SA_RESTART;
+            sigemptyset(&sig.sa_mask);
+            ::sigaction(SIGUSR2, &sig, nullptr);
+        }
+
+        gCarlaTraceEnabled = true;
+    }
+
+    ~CarlaTraceSetup() noexcept
+    {
+        if (! gCarlaTraceEnabled)
+            return;
+
+        carla_trace_dump();
+        gCarlaTraceEnabled = false;
+
+        // the handler is about to be unloaded together with this library
+        struct sigaction sig;
+
+        if (::sigaction(SIGUSR2, nullptr, &sig) == 0 && sig.sa_handler == carla_trace_signal_handler)
+            ::signal(SIGUSR2, SIG_DFL);
+    }
+};
+
+static CarlaTraceSetup gCarlaTraceSetup;
+
+#else // CARLA_OS_WIN
+
+static inline void carla_trace_begin(const char* const) noexcept {}
+static inline void carla_trace_end(const char* const) noexcept {}
+static inline void carla_trace_dump() noexcept {}
+static inline void carla_trace_forked() noexcept {}
+
+static inline
+const char* carla_trace_intern(const char* const name) noexcept
+{
+    return name;
+}
+
+#endif // CARLA_OS_WIN
+
+// --------------------------------------------------------------------------------------------------------------------
+// scoped begin/end pair
+
+struct CarlaTraceScope {
+    CarlaTraceScope(const char* const name) noexcept
+        : fName(name)
+    {
+        carla_trace_begin(fName);
+    }
+
+    ~CarlaTraceScope() noexcept
+    {
+        carla_trace_end(fName);
+    }
+
+private:
+    const char* const fName;
+
+    CARLA_DECLARE_NON_COPY_STRUCT(CarlaTraceScope)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // CARLA_TRACE_UTILS_HPP_INCLUDED
@@ -17,10 +17,12 @@
 
 #include "CarlaPipeUtils.hpp"
 #include "CarlaThread.hpp"
+#include "CarlaTraceUtils.hpp"
 
 // -------------------------------------------------------------------------------------------------------------------
 
 typedef void* CarlaPipeClientHandle;
+typedef void* CarlaPipeZygoteHandle;
 typedef void (*CarlaPipeCallbackFunc)(void* ptr, const char* msg);
 
 // -------------------------------------------------------------------------------------------------------------------
@@ -31,14 +33,37 @@ public:
     CarlaPipeClientPlugin(const CarlaPipeCallbackFunc callbackFunc, void* const callbackPtr) noexcept
         : CarlaPipeClient(),
           fCallbackFunc(callbackFunc),
-          fCallbackPtr(callbackPtr)
+          fCallbackPtr(callbackPtr),
+          fStats()
     {
         CARLA_SAFE_ASSERT(fCallbackFunc != nullptr);
     }
 
     const char* readlineblock(const uint timeout) noexcept
     {
-        return CarlaPipeClient::_readlineblock(timeout);
+        return CarlaPipeClient::_readlineblock(false, timeout);
+    }
+
+    /*
+     * Read the atom of an "atom" message, valid until the next read.
+     */
+    const LV2_Atom* readNextAtom() noexcept
+    {
+        LV2_Atom* atom;
+
+        if (! readNextLineAsAtom(atom))
+            return nullptr;
+
+        return atom;
+    }
+
+    /*
+     * Get a snapshot of the runtime counters, valid until the next call.
+     */
+    const PipeStats* readStats() noexcept
+    {
+        getPipeStats(fStats);
+        return &fStats;
     }
 
     bool msgReceived(const char* const msg) noexcept
@@ -56,6 +81,7 @@ public:
 private:
     const CarlaPipeCallbackFunc fCallbackFunc;
     void* const fCallbackPtr;
+    PipeStats fStats;
 
     CARLA_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CarlaPipeClientPlugin)
 };
@@ -71,12 +97,43 @@ CARLA_EXPORT void carla_set_process_name(const char* name)
 
 // -------------------------------------------------------------------------------------------------------------------
 
-CARLA_EXPORT CarlaPipeClientHandle carla_pipe_client_new(const char* argv[], CarlaPipeCallbackFunc callbackFunc, void* callbackPtr)
+CARLA_EXPORT bool carla_trace_is_enabled()
 {
-    carla_debug("carla_pipe_client_new(%p, %p, %p)", argv, callbackFunc, callbackPtr);
+#ifdef CARLA_OS_WIN
+    return false;
+#else
+    return gCarlaTraceEnabled;
+#endif
+}
 
+CARLA_EXPORT void carla_trace_push(const char* name)
+{
+    CARLA_SAFE_ASSERT_RETURN(name != nullptr,);
+
+    carla_trace_begin(carla_trace_intern(name));
+}
+
+CARLA_EXPORT void carla_trace_pop(const char* name)
+{
+    CARLA_SAFE_ASSERT_RETURN(name != nullptr,);
+
+    carla_trace_end(carla_trace_intern(name));
+}
+
+CARLA_EXPORT void carla_trace_save()
+{
+    carla_trace_dump();
+}
+
+// -------------------------------------------------------------------------------------------------------------------
+
+static CarlaPipeClientHandle carla_pipe_client_new_common(const char* argv[], CarlaPipeCallbackFunc callbackFunc, void* callbackPtr, bool binaryMode)
+{
     CarlaPipeClientPlugin* const pipe(new CarlaPipeClientPlugin(callbackFunc, callbackPtr));
 
+    pipe->setPipeBinaryModeAllowed(binaryMode);
+    pipe->setPipeSharedMemoryAllowed(true);
+
     if (! pipe->initPipeClient(argv))
     {
         delete pipe;
@@ -86,6 +143,20 @@ CARLA_EXPORT CarlaPipeClientHandle carla_pipe_client_new(const char* argv[], Car
     return pipe;
 }
 
+CARLA_EXPORT CarlaPipeClientHandle carla_pipe_client_new(const char* argv[], CarlaPipeCallbackFunc callbackFunc, void* callbackPtr)
+{
+    carla_debug("carla_pipe_client_new(%p, %p, %p)", argv, callbackFunc, callbackPtr);
+
+    return carla_pipe_client_new_common(argv, callbackFunc, callbackPtr, false);
+}
+
+CARLA_EXPORT CarlaPipeClientHandle carla_pipe_client_new_binary(const char* argv[], CarlaPipeCallbackFunc callbackFunc, void* callbackPtr)
+{
+    carla_debug("carla_pipe_client_new_binary(%p, %p, %p)", argv, callbackFunc, callbackPtr);
+
+    return carla_pipe_client_new_common(argv, callbackFunc, callbackPtr, true);
+}
+
 CARLA_EXPORT void carla_pipe_client_idle(CarlaPipeClientHandle handle)
 {
     CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
@@ -100,6 +171,13 @@ CARLA_EXPORT bool carla_pipe_client_is_running(CarlaPipeClientHandle handle)
     return ((CarlaPipeClientPlugin*)handle)->isPipeRunning();
 }
 
+CARLA_EXPORT bool carla_pipe_client_is_binary(CarlaPipeClientHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr, false);
+
+    return ((CarlaPipeClientPlugin*)handle)->isPipeInBinaryMode();
+}
+
 CARLA_EXPORT void carla_pipe_client_lock(CarlaPipeClientHandle handle)
 {
     CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
@@ -121,6 +199,13 @@ CARLA_EXPORT const char* carla_pipe_client_readlineblock(CarlaPipeClientHandle h
     return ((CarlaPipeClientPlugin*)handle)->readlineblock(timeout);
 }
 
+CARLA_EXPORT const void* carla_pipe_client_read_atom(CarlaPipeClientHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr, nullptr);
+
+    return ((CarlaPipeClientPlugin*)handle)->readNextAtom();
+}
+
 CARLA_EXPORT bool carla_pipe_client_write_msg(CarlaPipeClientHandle handle, const char* msg)
 {
     CARLA_SAFE_ASSERT_RETURN(handle != nullptr, false);
@@ -135,6 +220,21 @@ CARLA_EXPORT bool carla_pipe_client_write_and_fix_msg(CarlaPipeClientHandle hand
     return ((CarlaPipeClientPlugin*)handle)->writeAndFixMessage(msg);
 }
 
+CARLA_EXPORT void carla_pipe_client_write_atom_msg(CarlaPipeClientHandle handle, uint index, const void* atom)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+    CARLA_SAFE_ASSERT_RETURN(atom != nullptr,);
+
+    ((CarlaPipeClientPlugin*)handle)->writeLv2AtomMessage(index, (const LV2_Atom*)atom);
+}
+
+CARLA_EXPORT void carla_pipe_client_write_control_msg(CarlaPipeClientHandle handle, uint index, float value)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+
+    ((CarlaPipeClientPlugin*)handle)->writeControlMessage(index, value);
+}
+
 CARLA_EXPORT bool carla_pipe_client_flush(CarlaPipeClientHandle handle)
 {
     CARLA_SAFE_ASSERT_RETURN(handle != nullptr, false);
@@ -152,6 +252,20 @@ CARLA_EXPORT bool carla_pipe_client_flush_and_unlock(CarlaPipeClientHandle handl
     return ret;
 }
 
+CARLA_EXPORT const void* carla_pipe_client_get_stats(CarlaPipeClientHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr, nullptr);
+
+    return ((CarlaPipeClientPlugin*)handle)->readStats();
+}
+
+CARLA_EXPORT void carla_pipe_client_dump_stats(CarlaPipeClientHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+
+    ((CarlaPipeClientPlugin*)handle)->dumpPipeStats(stderr);
+}
+
 CARLA_EXPORT void carla_pipe_client_destroy(CarlaPipeClientHandle handle)
 {
     CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
@@ -164,6 +278,66 @@ CARLA_EXPORT void carla_pipe_client_destroy(CarlaPipeClientHandle handle)
 
 // -------------------------------------------------------------------------------------------------------------------
 
+CARLA_EXPORT CarlaPipeZygoteHandle carla_zygote_new(int socket)
+{
+    CARLA_SAFE_ASSERT_RETURN(socket >= 0, nullptr);
+    carla_debug("carla_zygote_new(%i)", socket);
+
+    return new CarlaPipeZygoteClient(socket);
+}
+
+CARLA_EXPORT bool carla_zygote_wait(CarlaPipeZygoteHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr, false);
+
+    return ((CarlaPipeZygoteClient*)handle)->waitForRequest();
+}
+
+CARLA_EXPORT const char* const* carla_zygote_get_argv(CarlaPipeZygoteHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr, nullptr);
+
+    return ((CarlaPipeZygoteClient*)handle)->getClientArgv();
+}
+
+CARLA_EXPORT uint carla_zygote_get_instance_id(CarlaPipeZygoteHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr, 0);
+
+    return ((CarlaPipeZygoteClient*)handle)->getClientInstanceId();
+}
+
+CARLA_EXPORT void carla_zygote_host(CarlaPipeZygoteHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+
+    ((CarlaPipeZygoteClient*)handle)->setupHostedClient();
+}
+
+CARLA_EXPORT void carla_zygote_child(CarlaPipeZygoteHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+
+    ((CarlaPipeZygoteClient*)handle)->setupForkedClient();
+}
+
+CARLA_EXPORT void carla_zygote_parent(CarlaPipeZygoteHandle handle, int pid)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+
+    ((CarlaPipeZygoteClient*)handle)->finishRequest(pid);
+}
+
+CARLA_EXPORT void carla_zygote_destroy(CarlaPipeZygoteHandle handle)
+{
+    CARLA_SAFE_ASSERT_RETURN(handle != nullptr,);
+    carla_debug("carla_zygote_destroy(%p)", handle);
+
+    delete (CarlaPipeZygoteClient*)handle;
+}
+
+// -------------------------------------------------------------------------------------------------------------------
+
 #include "CarlaPipeUtils.cpp"
 
 // -------------------------------------------------------------------------------------------------------------------
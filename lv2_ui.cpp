@@ -16,41 +16,384 @@
  */
 
 #include "CarlaExternalUI.hpp"
+#include "CarlaThread.hpp"
 #include "CarlaPipeUtils.cpp"
 
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
 #include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
 
+// -----------------------------------------------------------------------
+// Zygote shared by all UIs, enabled by the MODGUI_X11UI_ZYGOTE env var.
+// With MODGUI_X11UI_SHARED all UIs are hosted by that one process instead of forked from it.
+
+static CarlaPipeZygote gZygote;
+
+/*
+ * Get the zygote for UIs using @a filename, starting it on first use.
+ * There is only one zygote, UIs of other bundles are always spawned.
+ */
+static CarlaPipeZygote* getZygote(const char* const filename) noexcept
+{
+    static const bool shared(std::getenv("MODGUI_X11UI_SHARED") != nullptr);
+    static const bool wanted(shared || std::getenv("MODGUI_X11UI_ZYGOTE") != nullptr);
+
+    if (! wanted)
+        return nullptr;
+
+    if (! gZygote.isZygoteRunning())
+    {
+        // reap a zygote that failed before
+        gZygote.stopZygote(1000);
+
+        if (! gZygote.startZygote(filename, shared))
+            return nullptr;
+    }
+
+    return &gZygote;
+}
+
+// -----------------------------------------------------------------------
+// Pipe I/O thread shared by all UIs of the process, enabled by the MODGUI_X11UI_IO_THREAD env var.
+// It waits on the pipes of all UIs in a single poll() and reads them, decoded messages are posted to each UI's mailbox.
+
+class MODEmbedExternalUI;
+
+class UiIoThread : public CarlaThread
+{
+public:
+    UiIoThread() noexcept;
+    ~UiIoThread() override;
+
+    /*
+     * Start reading the pipe of @a ui, starting the thread if needed.
+     * Returns false if there are too many UIs already.
+     */
+    bool addUi(MODEmbedExternalUI* const ui) noexcept;
+
+    /*
+     * Stop reading the pipe of @a ui, waiting for the thread to be done with it.
+     * The thread stops with the last UI, and is joined here if this was the last one.
+     */
+    void removeUi(MODEmbedExternalUI* const ui) noexcept;
+
+protected:
+    void run() override;
+
+private:
+    static const uint32_t kMaxUis = 256;
+
+    // serializes starting and joining the thread, taken before fLock
+    CarlaMutex fThreadLock;
+
+    CarlaMutex fLock;
+    MODEmbedExternalUI* fUis[kMaxUis];
+    uint32_t fUiCount;
+
+    // set by addUi() when starting the thread, cleared by the thread when it returns with no UIs left
+    bool fRunning;
+
+    // UI being read by the thread, removeUi() waits until it is not this one
+    MODEmbedExternalUI* fCurrentUi;
+
+    // wakes up the thread when UIs are added or removed, created with the first UI
+    int fWakeEvent;
+
+    bool takeUi(MODEmbedExternalUI* const ui) noexcept;
+    void wakeUp() const noexcept;
+
+    CARLA_DECLARE_NON_COPY_CLASS(UiIoThread)
+};
+
+static UiIoThread gIoThread;
+
 // -----------------------------------------------------------------------
 // C++ class to handle stuff from the host
 
 class MODEmbedExternalUI : public CarlaExternalUI
 {
 public:
+    /*!
+     * Counters for host port events, see getPortEventStats().
+     * @a received counts every accepted port_event call,
+     * @a coalesced the ones replaced by a newer value before being sent,
+     * @a unchanged the ones dropped because the value matched what was last sent,
+     * @a dropped the ones for ports beyond the shadow table that did not fit its overflow queue.
+     * Atom events are counted separately, @a atomsDropped being the ones that did not fit the atom queue.
+     */
+    struct PortEventStats {
+        uint64_t received;
+        uint64_t coalesced;
+        uint64_t unchanged;
+        uint64_t sent;
+        uint64_t dropped;
+        uint64_t atomsReceived;
+        uint64_t atomsSent;
+        uint64_t atomsDropped;
+        uint64_t uridsSent;
+    };
+
+    /*!
+     * Timings of the host GUI thread, see getIdleStats().
+     * Idle times are spent inside lv2ui_idle(), latency goes from decoding a message to handling it.
+     * Without the I/O thread messages are decoded inside idle, so the time waiting for it is not included.
+     */
+    struct IdleStats {
+        uint64_t idles;
+        uint64_t idleTimeTotal;
+        uint64_t idleTimeMax;
+        uint64_t events;
+        uint64_t latencyTotal;
+        uint64_t latencyMax;
+    };
+
     MODEmbedExternalUI(const LV2UI_Controller controller, const LV2UI_Write_Function writeFunction, const LV2UI_Resize* resize,
+          const LV2_URID_Map* const uridMap, const LV2_URID_Unmap* const uridUnmap,
           const char* const bundlePath, const char* const pluginURI, const uintptr_t parentId) noexcept
         : CarlaExternalUI(),
           fController(controller),
           fWriteFunction(writeFunction),
-          fResize(resize)
+          fResize(resize),
+          fUridMap(uridMap),
+          fUridUnmap(uridUnmap),
+          fShowPending(false),
+          fDirtyHead(0),
+          fDirtyTail(0),
+          fOverflowHead(0),
+          fOverflowTail(0),
+          fAtomHead(0),
+          fAtomTail(0),
+          fIoThreadWanted(std::getenv("MODGUI_X11UI_IO_THREAD") != nullptr),
+          fPostEvents(false),
+          fIoDetached(false),
+          fIoExiting(false),
+          fIoWaiting(0),
+          fSpaceEvent(-1),
+          fEventHead(0),
+          fEventTail(0),
+          fUiDataHead(0),
+          fUiDataTail(0)
+    {
+        carla_zeroStructs(fPorts, kMaxShadowPorts);
+        carla_zeroStruct(fPortStats);
+        carla_zeroStruct(fIdleStats);
+        carla_zeroStruct(fUrids);
+        carla_zeroStructs(fUridsSent, kMaxCachedUrids/32);
+        carla_zeroStructs(fUiUrids, kMaxCachedUrids);
+
+        if (fIoThreadWanted)
+        {
+            try {
+                fSpaceEvent = ::eventfd(0, EFD_NONBLOCK);
+            } CARLA_SAFE_EXCEPTION("eventfd");
+        }
+
+        // atoms are only supported with both map and unmap, the UI side needs the URIs
+        if (fUridMap != nullptr && fUridUnmap != nullptr)
+        {
+            fUrids.atomEventTransfer = fUridMap->map(fUridMap->handle, LV2_ATOM__eventTransfer);
+            fUrids.atomTransfer      = fUridMap->map(fUridMap->handle, LV2_ATOM__atomTransfer);
+            fUrids.atomBlank         = fUridMap->map(fUridMap->handle, LV2_ATOM__Blank);
+            fUrids.atomObject        = fUridMap->map(fUridMap->handle, LV2_ATOM__Object);
+            fUrids.atomSequence      = fUridMap->map(fUridMap->handle, LV2_ATOM__Sequence);
+            fUrids.atomTuple         = fUridMap->map(fUridMap->handle, LV2_ATOM__Tuple);
+            fUrids.atomURID          = fUridMap->map(fUridMap->handle, LV2_ATOM__URID);
+        }
+
+        CarlaString filename;
+        filename.appendFormat("%s" CARLA_OS_SEP_STR "modgui-x11", bundlePath);
+
+        setData(filename, pluginURI, CarlaString(parentId));
+        setPipeZygote(getZygote(filename));
+        setPipeBinaryModeAllowed(true);
+        setPipeSharedMemoryAllowed(true);
+        setPipeOutputBuffered(true);
+        setPipeNonBlockingSend(true);
+
+        // everything is written from the host GUI thread, the I/O thread only reads and posts events
+        setPipeSingleWriter(true);
+
+        setMsgHandler(kPipeMsgExiting, &MODEmbedExternalUI::msgExiting);
+        setMsgHandler(kPipeMsgControl, &MODEmbedExternalUI::msgControl);
+        setMsgHandler(kPipeMsgSize,    &MODEmbedExternalUI::msgSize);
+        setMsgHandler(kPipeMsgAtom,    &MODEmbedExternalUI::msgAtom);
+        setMsgHandler(kPipeMsgUrid,    &MODEmbedExternalUI::msgUrid);
+    }
+
+    ~MODEmbedExternalUI() override
     {
-        setData(CarlaString(bundlePath) + CARLA_OS_SEP_STR "modgui-x11", pluginURI, CarlaString(parentId));
+        carla_debug("MODEmbedExternalUI port events: " P_UINT64 " received, " P_UINT64 " coalesced, "
+                    P_UINT64 " unchanged, " P_UINT64 " sent, " P_UINT64 " dropped",
+                    fPortStats.received, fPortStats.coalesced, fPortStats.unchanged,
+                    fPortStats.sent, fPortStats.dropped);
+        carla_debug("MODEmbedExternalUI atom events: " P_UINT64 " received, " P_UINT64 " sent, "
+                    P_UINT64 " dropped, " P_UINT64 " urids sent",
+                    fPortStats.atomsReceived, fPortStats.atomsSent,
+                    fPortStats.atomsDropped, fPortStats.uridsSent);
+        carla_debug("MODEmbedExternalUI idle: " P_UINT64 " calls, " P_UINT64 "us total, " P_UINT64 "us max, "
+                    P_UINT64 " events, " P_UINT64 "us total latency, " P_UINT64 "us max latency",
+                    fIdleStats.idles, fIdleStats.idleTimeTotal, fIdleStats.idleTimeMax,
+                    fIdleStats.events, fIdleStats.latencyTotal, fIdleStats.latencyMax);
+
+        OutputStats outputStats;
+        getPipeOutputStats(outputStats);
+        carla_debug("MODEmbedExternalUI output: " P_UINT64 " bytes, " P_UINT64 " syscalls, " P_UINT64 " backlog peak, "
+                    P_UINT64 " coalesced, " P_UINT64 " dropped",
+                    outputStats.bytes, outputStats.syscalls, outputStats.backlogPeak,
+                    outputStats.coalesced, outputStats.dropped);
+
+        // must be stopped before the pipe is closed
+        stopIoThread();
+
+        // a UI that does not quit in time is terminated in the background, the host is not kept waiting
+        stopPipeServerAsync(5*1000);
+
+        if (fSpaceEvent >= 0)
+            ::close(fSpaceEvent);
     }
 
-    void lv2ui_port_event(uint32_t portIndex, uint32_t bufferSize, uint32_t format, const void* buffer) const
+    /*
+     * Start reading the pipe from the shared I/O thread, if requested via the MODGUI_X11UI_IO_THREAD env var.
+     * Must be called after the client has finished starting.
+     */
+    void startIoThreadIfWanted() noexcept
     {
-        if (format != 0 || bufferSize != sizeof(float) || buffer == nullptr)
+        if (! fIoThreadWanted || fSpaceEvent < 0)
             return;
 
-        const float value(*(const float*)buffer);
+        __atomic_store_n(&fPostEvents, true, __ATOMIC_RELEASE);
 
-        writeControlMessage(portIndex, value);
+        if (! gIoThread.addUi(this))
+            __atomic_store_n(&fPostEvents, false, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Read the pipe from the I/O thread, after polling the descriptor it got from preparePipeWait().
+     * Returns false once the thread must not read it anymore, lv2ui_idle() takes care of it from then on.
+     */
+    bool readFromIoThread(const int fd, const short revents) noexcept
+    {
+        finishPipeWait();
+
+        bool done = false;
+
+        if (fd < 0 || (revents & POLLIN) != 0)
+            idlePipe();
+        else if ((revents & (POLLHUP|POLLERR|POLLNVAL)) != 0)
+            done = true; // the other side is gone
+
+        // nothing else will be read after "exiting"
+        if (done || fIoExiting || ! isPipeRunning())
+        {
+            __atomic_store_n(&fPostEvents, false, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        return true;
+    }
+
+    // may be called from any single host thread, never blocks nor does syscalls
+    void lv2ui_port_event(uint32_t portIndex, uint32_t bufferSize, uint32_t format, const void* buffer) noexcept
+    {
+        if (buffer == nullptr)
+            return;
+
+        if (format != 0)
+        {
+            if (format == fUrids.atomEventTransfer || format == fUrids.atomTransfer)
+                queueAtom(portIndex, bufferSize, (const LV2_Atom*)buffer);
+            return;
+        }
+
+        if (bufferSize != sizeof(float))
+            return;
+
+        __atomic_add_fetch(&fPortStats.received, 1, __ATOMIC_RELAXED);
+
+        uint32_t valueBits;
+        std::memcpy(&valueBits, buffer, sizeof(float));
+
+        if (portIndex >= kMaxShadowPorts)
+        {
+            queueOverflowPort(portIndex, valueBits);
+            return;
+        }
+
+        PortShadow& port(fPorts[portIndex]);
+
+        // a newer value replaces an older one not yet sent, so a port is queued at most once
+        __atomic_store_n(&port.valueBits, valueBits, __ATOMIC_RELAXED);
+
+        if (__atomic_exchange_n(&port.dirty, 1, __ATOMIC_ACQ_REL) != 0)
+        {
+            __atomic_add_fetch(&fPortStats.coalesced, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        const uint32_t head(fDirtyHead);
+        fDirtyPorts[head % kMaxShadowPorts] = portIndex;
+        __atomic_store_n(&fDirtyHead, head + 1, __ATOMIC_RELEASE);
     }
 
     int lv2ui_idle()
     {
+        // port events wait in the shadow table and atom queue until the client is up
+        if (isPipeServerStarting())
+        {
+            if (! idlePipeServerStart())
+                return 1;
+            if (isPipeServerStarting())
+                return 0;
+
+            startIoThreadIfWanted();
+        }
+
+        // the client is gone, read whatever it sent before that and report a crash if it did not say it was exiting
+        if (hasPipeClientExited())
+        {
+            stopIoThread();
+            dispatchEvents();
+
+            if (isPipeRunning())
+                idlePipe();
+
+            setUiCrashedIfRunning();
+
+            if (getAndResetUiState() == CarlaExternalUI::UiCrashed)
+                carla_stderr2("MODEmbedExternalUI: UI process exited unexpectedly");
+
+            return 1;
+        }
+
         CARLA_SAFE_ASSERT_RETURN(isPipeRunning(), 1);
 
-        idlePipe();
+        const CarlaTraceScope cts("lv2ui_idle");
+        const uint64_t startTime(getMicrosecondCounter());
+
+        sendDirtyPorts();
+        sendQueuedAtoms();
+
+        // after the values, so the UI never shows stale ones
+        if (fShowPending)
+        {
+            fShowPending = false;
+            writeShowMessage();
+        }
+
+        // events decoded by the I/O thread, if any, then read the pipe here if the thread is not running
+        dispatchEvents();
+
+        if (isPipeRunning() && ! __atomic_load_n(&fPostEvents, __ATOMIC_ACQUIRE))
+            idlePipe();
+
+        drainMessages();
+
+        const uint64_t idleTime(getMicrosecondCounter() - startTime);
+
+        ++fIdleStats.idles;
+        fIdleStats.idleTimeTotal += idleTime;
+
+        if (idleTime > fIdleStats.idleTimeMax)
+            fIdleStats.idleTimeMax = idleTime;
 
         switch (getAndResetUiState())
         {
@@ -64,60 +407,1019 @@ public:
 
     int lv2ui_show()
     {
+        if (isPipeServerStarting())
+        {
+            fShowPending = true;
+            return 0;
+        }
+
         writeShowMessage();
+        drainMessages();
         return 0;
     }
 
     int lv2ui_hide()
     {
+        if (isPipeServerStarting())
+        {
+            fShowPending = false;
+            return 0;
+        }
+
         writeHideMessage();
+        drainMessages();
         return 0;
     }
 
+    void getPortEventStats(PortEventStats& stats) const noexcept
+    {
+        stats.received  = __atomic_load_n(&fPortStats.received, __ATOMIC_RELAXED);
+        stats.coalesced = __atomic_load_n(&fPortStats.coalesced, __ATOMIC_RELAXED);
+        stats.unchanged = fPortStats.unchanged;
+        stats.sent      = fPortStats.sent;
+        stats.dropped   = __atomic_load_n(&fPortStats.dropped, __ATOMIC_RELAXED);
+        stats.atomsReceived = __atomic_load_n(&fPortStats.atomsReceived, __ATOMIC_RELAXED);
+        stats.atomsSent     = fPortStats.atomsSent;
+        stats.atomsDropped  = __atomic_load_n(&fPortStats.atomsDropped, __ATOMIC_RELAXED);
+        stats.uridsSent     = fPortStats.uridsSent;
+    }
+
+    void getIdleStats(IdleStats& stats) const noexcept
+    {
+        stats = fIdleStats;
+    }
+
 protected:
     // -------------------------------------------------------------------
     // Pipe Server calls
 
-    bool msgReceived(const char* const msg) noexcept override
+    // message handlers, called from the host GUI thread, or from the I/O thread while it is running
+
+    bool msgExiting() noexcept
     {
-        if (CarlaExternalUI::msgReceived(msg))
-            return true;
+        UiEvent event;
+        carla_zeroStruct(event);
+        event.type = kUiEventExiting;
+
+        return handleUiEvent(event);
+    }
+
+    bool msgControl() noexcept
+    {
+        UiEvent event;
+        carla_zeroStruct(event);
+        event.type = kUiEventControl;
+
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(event.index), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsFloat(event.value), true);
+
+        return handleUiEvent(event);
+    }
+
+    bool msgSize() noexcept
+    {
+        UiEvent event;
+        carla_zeroStruct(event);
+        event.type = kUiEventSize;
+
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(event.width), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(event.height), true);
+
+        return handleUiEvent(event);
+    }
+
+    bool msgAtom() noexcept
+    {
+        UiEvent event;
+        carla_zeroStruct(event);
+        event.type = kUiEventAtom;
+
+        uint32_t size;
+        LV2_Atom* atom;
+
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(event.index), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(size), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsAtom(atom), true);
+        CARLA_SAFE_ASSERT_RETURN(lv2_atom_total_size(atom) == size, true);
+
+        event.data     = atom;
+        event.dataSize = size;
+
+        return handleUiEvent(event);
+    }
+
+    bool msgUrid() noexcept
+    {
+        UiEvent event;
+        carla_zeroStruct(event);
+        event.type = kUiEventUrid;
+
+        const char* uri;
 
-        if (std::strcmp(msg, "control") == 0)
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(event.index), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsString(uri, false), true);
+
+        event.data     = uri;
+        event.dataSize = static_cast<uint32_t>(std::strlen(uri) + 1);
+
+        return handleUiEvent(event);
+    }
+
+private:
+    const LV2UI_Controller     fController;
+    const LV2UI_Write_Function fWriteFunction;
+    const LV2UI_Resize*        fResize;
+    const LV2_URID_Map*        fUridMap;
+    const LV2_URID_Unmap*      fUridUnmap;
+
+    // show requested while the client is still starting
+    bool fShowPending;
+
+    // -------------------------------------------------------------------
+    // Host port event shadow table
+
+    static const uint32_t kMaxShadowPorts = 0x1000;
+
+    /*
+     * Latest value for a port, written by port_event and read by lv2ui_idle.
+     * sentValue and wasSent are only touched by lv2ui_idle, they hold the last value the UI has, sent or changed by it.
+     */
+    struct PortShadow {
+        uint32_t valueBits;
+        uint32_t dirty;
+        float    sentValue;
+        bool     wasSent;
+    };
+
+    PortShadow fPorts[kMaxShadowPorts];
+
+    /*
+     * Single-producer single-consumer queue of dirty port indices.
+     * Each port is in the queue at most once, so it can never overflow.
+     */
+    uint32_t fDirtyPorts[kMaxShadowPorts];
+    uint32_t fDirtyHead;
+    uint32_t fDirtyTail;
+
+    static const uint32_t kMaxOverflowPorts = 0x400;
+
+    /*
+     * Ports beyond the shadow table, for plugins with that many ports.
+     * Single-producer single-consumer queue of values in the order they came, without coalescing.
+     */
+    struct PortOverflow {
+        uint32_t portIndex;
+        uint32_t valueBits;
+    };
+
+    PortOverflow fOverflowPorts[kMaxOverflowPorts];
+    uint32_t fOverflowHead;
+    uint32_t fOverflowTail;
+
+    PortEventStats fPortStats;
+
+    void queueOverflowPort(const uint32_t portIndex, const uint32_t valueBits) noexcept
+    {
+        const uint32_t head(fOverflowHead);
+
+        // the UI is behind, losing values is better than blocking the host
+        if (head - __atomic_load_n(&fOverflowTail, __ATOMIC_ACQUIRE) == kMaxOverflowPorts)
         {
-            uint32_t param;
+            __atomic_add_fetch(&fPortStats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        PortOverflow& port(fOverflowPorts[head % kMaxOverflowPorts]);
+        port.portIndex = portIndex;
+        port.valueBits = valueBits;
+        __atomic_store_n(&fOverflowHead, head + 1, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Send one control message per dirty port, skipping values equal to the last one sent.
+     * Values of ports beyond the shadow table are all sent.
+     */
+    void sendDirtyPorts() noexcept
+    {
+        const uint32_t head(__atomic_load_n(&fDirtyHead, __ATOMIC_ACQUIRE));
+
+        for (; fDirtyTail != head;)
+        {
+            const uint32_t portIndex(fDirtyPorts[fDirtyTail % kMaxShadowPorts]);
+            PortShadow& port(fPorts[portIndex]);
+
+            // the queue slot must be read before clearing the dirty flag, so a re-queued port always fits.
+            // clearing with an exchange synchronizes with the last port_event that found the flag set,
+            // so its value is the one loaded below even if it was coalesced into this entry
+            ++fDirtyTail;
+            __atomic_exchange_n(&port.dirty, 0, __ATOMIC_ACQ_REL);
+
+            const uint32_t valueBits(__atomic_load_n(&port.valueBits, __ATOMIC_RELAXED));
+
             float value;
+            std::memcpy(&value, &valueBits, sizeof(float));
+
+            // compare exactly, small changes on meters and the like still count
+            if (port.wasSent && std::memcmp(&value, &port.sentValue, sizeof(float)) == 0)
+            {
+                ++fPortStats.unchanged;
+                continue;
+            }
+
+            writeControlMessage(portIndex, value);
+
+            port.sentValue = value;
+            port.wasSent   = true;
+            ++fPortStats.sent;
+        }
+
+        const uint32_t overflowHead(__atomic_load_n(&fOverflowHead, __ATOMIC_ACQUIRE));
+
+        for (; fOverflowTail != overflowHead;)
+        {
+            const PortOverflow& port(fOverflowPorts[fOverflowTail % kMaxOverflowPorts]);
+
+            float value;
+            std::memcpy(&value, &port.valueBits, sizeof(float));
+
+            writeControlMessage(port.portIndex, value);
+            ++fPortStats.sent;
+
+            __atomic_store_n(&fOverflowTail, fOverflowTail + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Host atom events
+
+    struct Urids {
+        LV2_URID atomEventTransfer;
+        LV2_URID atomTransfer;
+        LV2_URID atomBlank;
+        LV2_URID atomObject;
+        LV2_URID atomSequence;
+        LV2_URID atomTuple;
+        LV2_URID atomURID;
+    } fUrids;
+
+    static const uint32_t kAtomRingSize    = 0x10000;
+    static const uint32_t kMaxCachedUrids  = 0x1000;
+    static const uint32_t kMaxAtomDepth    = 8;
+    static const uint32_t kAtomWrapMarker  = 0xffffffff;
+
+    /*
+     * Entry in the atom queue, followed by the atom itself and padded to 8 bytes.
+     * An entry never wraps around, a wrap marker in its place sends the reader back to the start.
+     */
+    struct AtomEntry {
+        uint32_t portIndex;
+        uint32_t size;
+    };
+
+    /*
+     * Single-producer single-consumer queue of atoms, written by port_event and read by lv2ui_idle.
+     * Kept as uint64_t so atoms stay 8-byte aligned and can be sent from where they are.
+     */
+    uint64_t fAtomRing[kAtomRingSize/sizeof(uint64_t)];
+    uint32_t fAtomHead;
+    uint32_t fAtomTail;
+
+    // bitmap of URIDs already sent to the UI, higher URIDs are sent every time
+    uint32_t fUridsSent[kMaxCachedUrids/32];
+
+    // host URIDs for the ids the UI uses in its atoms, announced once by "urid" messages
+    LV2_URID fUiUrids[kMaxCachedUrids];
+
+    void queueAtom(const uint32_t portIndex, const uint32_t bufferSize, const LV2_Atom* const atom) noexcept
+    {
+        __atomic_add_fetch(&fPortStats.atomsReceived, 1, __ATOMIC_RELAXED);
+
+        if (bufferSize < sizeof(LV2_Atom) || lv2_atom_total_size(atom) > bufferSize)
+        {
+            __atomic_add_fetch(&fPortStats.atomsDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        const uint32_t atomSize(lv2_atom_total_size(atom));
+        const uint32_t entrySize(sizeof(AtomEntry) + lv2_atom_pad_size(atomSize));
+
+        const uint32_t head(fAtomHead);
+        const uint32_t offset(head % kAtomRingSize);
+        const uint32_t untilEnd(kAtomRingSize - offset);
+        const uint32_t needed(entrySize + (untilEnd < entrySize ? untilEnd : 0));
+
+        // the UI is behind, losing atoms is better than blocking the host
+        if (entrySize > kAtomRingSize/2 || kAtomRingSize - (head - __atomic_load_n(&fAtomTail, __ATOMIC_ACQUIRE)) < needed)
+        {
+            __atomic_add_fetch(&fPortStats.atomsDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        uint8_t* const ring((uint8_t*)fAtomRing);
+        AtomEntry entry = { portIndex, atomSize };
+        uint32_t writeOffset(offset);
+
+        if (untilEnd < entrySize)
+        {
+            const AtomEntry marker = { kAtomWrapMarker, 0 };
+            std::memcpy(ring + offset, &marker, sizeof(AtomEntry));
+            writeOffset = 0;
+        }
+
+        std::memcpy(ring + writeOffset, &entry, sizeof(AtomEntry));
+        std::memcpy(ring + writeOffset + sizeof(AtomEntry), atom, atomSize);
+        __atomic_store_n(&fAtomHead, head + needed, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Send all queued atoms, each preceded by the URIDs it uses that the UI does not know yet.
+     * Output is buffered, so everything queued since the last idle goes out together.
+     */
+    void sendQueuedAtoms() noexcept
+    {
+        const uint32_t head(__atomic_load_n(&fAtomHead, __ATOMIC_ACQUIRE));
+        const uint8_t* const ring((const uint8_t*)fAtomRing);
+
+        for (uint32_t tail = fAtomTail; tail != head;)
+        {
+            const uint32_t offset(tail % kAtomRingSize);
+
+            AtomEntry entry;
+            std::memcpy(&entry, ring + offset, sizeof(AtomEntry));
+
+            if (entry.portIndex == kAtomWrapMarker)
+            {
+                tail += kAtomRingSize - offset;
+                continue;
+            }
+
+            const LV2_Atom* const atom((const LV2_Atom*)(ring + offset + sizeof(AtomEntry)));
+
+            sendAtomUrids(atom, 0);
+            writeLv2AtomMessage(entry.portIndex, atom);
+            ++fPortStats.atomsSent;
+
+            // the atom is sent straight from the queue, so only release its space afterwards
+            tail += sizeof(AtomEntry) + lv2_atom_pad_size(entry.size);
+            __atomic_store_n(&fAtomTail, tail, __ATOMIC_RELEASE);
+        }
+    }
+
+    void sendAtomUrids(const LV2_Atom* const atom, const uint32_t depth) noexcept
+    {
+        sendUrid(atom->type);
+
+        if (depth >= kMaxAtomDepth)
+            return;
+
+        if (atom->type == fUrids.atomObject || atom->type == fUrids.atomBlank)
+        {
+            const LV2_Atom_Object* const obj((const LV2_Atom_Object*)atom);
+            sendUrid(obj->body.otype);
+
+            LV2_ATOM_OBJECT_FOREACH(obj, prop)
+            {
+                sendUrid(prop->key);
+                sendAtomUrids(&prop->value, depth + 1);
+            }
+        }
+        else if (atom->type == fUrids.atomSequence)
+        {
+            const LV2_Atom_Sequence* const seq((const LV2_Atom_Sequence*)atom);
+            sendUrid(seq->body.unit);
+
+            LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+                sendAtomUrids(&ev->body, depth + 1);
+        }
+        else if (atom->type == fUrids.atomTuple)
+        {
+            const LV2_Atom_Tuple* const tuple((const LV2_Atom_Tuple*)atom);
+
+            LV2_ATOM_TUPLE_FOREACH(tuple, item)
+                sendAtomUrids(item, depth + 1);
+        }
+        else if (atom->type == fUrids.atomURID)
+        {
+            sendUrid(((const LV2_Atom_URID*)atom)->body);
+        }
+    }
+
+    void sendUrid(const LV2_URID urid) noexcept
+    {
+        if (urid == 0)
+            return;
+
+        if (urid < kMaxCachedUrids)
+        {
+            const uint32_t bit(1U << (urid % 32));
+
+            if (fUridsSent[urid / 32] & bit)
+                return;
+
+            fUridsSent[urid / 32] |= bit;
+        }
+
+        const char* const uri(fUridUnmap->unmap(fUridUnmap->handle, urid));
+        CARLA_SAFE_ASSERT_RETURN(uri != nullptr,);
+
+        writeLv2UridMessage(urid, uri);
+        ++fPortStats.uridsSent;
+    }
+
+    /*
+     * Map a URI announced by the UI, so its id can be used in the atoms that follow.
+     */
+    void mapUiUrid(const uint32_t uiUrid, const char* const uri) noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(fUridMap != nullptr,);
+        CARLA_SAFE_ASSERT_RETURN(uiUrid != 0 && uiUrid < kMaxCachedUrids,);
+
+        fUiUrids[uiUrid] = fUridMap->map(fUridMap->handle, uri);
+    }
+
+    /*
+     * Replace the UI ids of an atom with host URIDs, in place.
+     * Returns false if the atom uses an id the UI did not announce, or a child atom does not fit its container.
+     */
+    bool translateUiUrid(uint32_t& urid) const noexcept
+    {
+        if (urid == 0)
+            return true;
+        if (urid >= kMaxCachedUrids || fUiUrids[urid] == 0)
+            return false;
+
+        urid = fUiUrids[urid];
+        return true;
+    }
 
-            CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(param), true);
-            CARLA_SAFE_ASSERT_RETURN(readNextLineAsFloat(value), true);
+    /*
+     * Check that a child atom of a container, header and body, lies within the container's body.
+     * Atoms from the UI are only checked as a whole when received, so each level must be checked before going into it.
+     */
+    static bool isAtomChildInside(const void* const body, const uint32_t bodySize, const LV2_Atom* const child) noexcept
+    {
+        const uint64_t offset(static_cast<uint64_t>((const uint8_t*)child - (const uint8_t*)body));
+
+        if (offset + sizeof(LV2_Atom) > bodySize)
+            return false;
 
-            fWriteFunction(fController, param, sizeof(float), 0, &value);
+        return offset + sizeof(LV2_Atom) + child->size <= bodySize;
+    }
 
+    bool translateAtomUrids(LV2_Atom* const atom, const uint32_t depth) const noexcept
+    {
+        if (! translateUiUrid(atom->type))
+            return false;
+
+        if (depth >= kMaxAtomDepth)
             return true;
+
+        if (atom->type == fUrids.atomObject || atom->type == fUrids.atomBlank)
+        {
+            LV2_Atom_Object* const obj((LV2_Atom_Object*)atom);
+
+            if (obj->atom.size < sizeof(LV2_Atom_Object_Body) || ! translateUiUrid(obj->body.otype))
+                return false;
+
+            LV2_ATOM_OBJECT_FOREACH(obj, prop)
+            {
+                if (! isAtomChildInside(&obj->body, obj->atom.size, &prop->value))
+                    return false;
+                if (! translateUiUrid(prop->key) || ! translateAtomUrids(&prop->value, depth + 1))
+                    return false;
+            }
+        }
+        else if (atom->type == fUrids.atomSequence)
+        {
+            LV2_Atom_Sequence* const seq((LV2_Atom_Sequence*)atom);
+
+            if (seq->atom.size < sizeof(LV2_Atom_Sequence_Body) || ! translateUiUrid(seq->body.unit))
+                return false;
+
+            LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+            {
+                if (! isAtomChildInside(&seq->body, seq->atom.size, &ev->body))
+                    return false;
+                if (! translateAtomUrids(&ev->body, depth + 1))
+                    return false;
+            }
         }
+        else if (atom->type == fUrids.atomTuple)
+        {
+            LV2_Atom_Tuple* const tuple((LV2_Atom_Tuple*)atom);
 
-        if (std::strcmp(msg, "size") == 0)
+            LV2_ATOM_TUPLE_FOREACH(tuple, item)
+            {
+                if (! isAtomChildInside(LV2_ATOM_BODY(tuple), tuple->atom.size, item))
+                    return false;
+                if (! translateAtomUrids(item, depth + 1))
+                    return false;
+            }
+        }
+        else if (atom->type == fUrids.atomURID)
         {
-            uint width, height;
+            if (atom->size < sizeof(LV2_URID))
+                return false;
 
-            CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(width), true);
-            CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(height), true);
+            return translateUiUrid(((LV2_Atom_URID*)atom)->body);
+        }
 
-            if (fResize != nullptr)
-                fResize->ui_resize(fResize->handle, width, height);
+        return true;
+    }
+
+    // -------------------------------------------------------------------
+    // Mailbox of events decoded by the I/O thread
+
+    enum UiEventType {
+        kUiEventControl = 1,
+        kUiEventSize,
+        kUiEventAtom,
+        kUiEventUrid,
+        kUiEventExiting
+    };
+
+    /*
+     * A decoded UI message.
+     * Atoms and URIs are handled straight from the pipe receive buffer, @a data points into it.
+     * Events posted by the I/O thread get a copy in the data ring instead, released once handled.
+     */
+    struct UiEvent {
+        uint32_t    type;
+        uint32_t    index;
+        float       value;
+        uint32_t    width;
+        uint32_t    height;
+        const void* data;
+        uint32_t    dataSize;
+        uint32_t    dataEnd;
+        uint64_t    time;
+    };
+
+    static const uint32_t kUiDataRingSize = 0x10000;
+
+    static const uint32_t kMaxUiEvents = 0x400;
 
+    const bool fIoThreadWanted;
+    bool       fPostEvents; // true while the I/O thread is reading the pipe
+    bool       fIoDetached; // set when the I/O thread stops reading the pipe, it must not wait for idle anymore
+    bool       fIoExiting;  // "exiting" was received by the I/O thread
+
+    // the I/O thread sleeps on fSpaceEvent while the mailbox is full, dispatchEvents() signals it when fIoWaiting is set
+    uint32_t fIoWaiting;
+    int      fSpaceEvent;
+
+    /*
+     * Single-producer single-consumer queue, written by the I/O thread and read by lv2ui_idle.
+     */
+    UiEvent  fEvents[kMaxUiEvents];
+    uint32_t fEventHead;
+    uint32_t fEventTail;
+
+    /*
+     * Event data copied by the I/O thread, in the same order as the events.
+     * Kept as uint64_t so atoms stay 8-byte aligned.
+     */
+    uint64_t fUiData[kUiDataRingSize/sizeof(uint64_t)];
+    uint32_t fUiDataHead;
+    uint32_t fUiDataTail;
+
+    IdleStats fIdleStats;
+
+    /*
+     * Copy the event data into the data ring, contiguous and padded to 8 bytes.
+     * Returns false if there is no room yet.
+     */
+    bool copyEventData(UiEvent& event) noexcept
+    {
+        const uint32_t size((event.dataSize + 7) & ~7U);
+
+        const uint32_t head(fUiDataHead);
+        const uint32_t offset(head % kUiDataRingSize);
+        const uint32_t untilEnd(kUiDataRingSize - offset);
+        const uint32_t skip(untilEnd < size ? untilEnd : 0);
+
+        if (kUiDataRingSize - (head - __atomic_load_n(&fUiDataTail, __ATOMIC_ACQUIRE)) < size + skip)
+            return false;
+
+        uint8_t* const data((uint8_t*)fUiData + (skip != 0 ? 0 : offset));
+        std::memcpy(data, event.data, event.dataSize);
+
+        fUiDataHead    = head + skip + size;
+        event.data     = data;
+        event.dataEnd  = fUiDataHead;
+        return true;
+    }
+
+    bool postEvent(const UiEvent& event) noexcept
+    {
+        const uint32_t head(fEventHead);
+
+        if (head - __atomic_load_n(&fEventTail, __ATOMIC_ACQUIRE) == kMaxUiEvents)
+            return false;
+
+        fEvents[head % kMaxUiEvents] = event;
+        __atomic_store_n(&fEventHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /*
+     * Handle a message decoded by one of the msg* handlers.
+     * It is dispatched right away, unless the I/O thread is reading the pipe, then it is posted to lv2ui_idle.
+     */
+    bool handleUiEvent(UiEvent& event) noexcept
+    {
+        event.time = getMicrosecondCounter();
+
+        if (! __atomic_load_n(&fPostEvents, __ATOMIC_ACQUIRE))
+        {
+            dispatchEvent(event);
             return true;
         }
 
-        return false;
+        // atoms and URIs point into the receive buffer, so they need a copy that lives until idle
+        if (event.data != nullptr)
+        {
+            CARLA_SAFE_ASSERT_RETURN(event.dataSize <= kUiDataRingSize/2, true);
+
+            while (! copyEventData(event))
+            {
+                if (! waitForMailboxSpace())
+                    return true;
+            }
+        }
+
+        // the host is slow to call idle, wait for it instead of dropping UI changes
+        while (! postEvent(event))
+        {
+            if (! waitForMailboxSpace())
+                return true;
+        }
+
+        __atomic_store_n(&fIoWaiting, 0, __ATOMIC_RELAXED);
+
+        // nothing else will be read after this
+        if (event.type == kUiEventExiting)
+            fIoExiting = true;
+
+        return true;
     }
 
-private:
-    const LV2UI_Controller     fController;
-    const LV2UI_Write_Function fWriteFunction;
-    const LV2UI_Resize*        fResize;
+    /*
+     * Called from the I/O thread when the mailbox is full, sleeps until dispatchEvents() makes room.
+     * The first call only asks for a signal, the caller then looks again before sleeping, so no wakeup is missed.
+     * Returns false if the UI is being removed from the I/O thread, the event is dropped then.
+     */
+    bool waitForMailboxSpace() noexcept
+    {
+        if (__atomic_load_n(&fIoDetached, __ATOMIC_ACQUIRE))
+            return false;
+
+        if (__atomic_exchange_n(&fIoWaiting, 1, __ATOMIC_SEQ_CST) == 0)
+            return true;
+
+        struct pollfd pfd;
+        pfd.fd      = fSpaceEvent;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        try {
+            ::poll(&pfd, 1, 50);
+        } CARLA_SAFE_EXCEPTION("poll");
+
+        // reset the event, it is non-blocking so this never waits
+        uint64_t value;
+        try {
+            if (::read(fSpaceEvent, &value, sizeof(value))) {}
+        } CARLA_SAFE_EXCEPTION("read(fSpaceEvent)");
+
+        return true;
+    }
+
+    void signalMailboxSpace() const noexcept
+    {
+        const uint64_t value = 1;
+
+        try {
+            if (::write(fSpaceEvent, &value, sizeof(value))) {}
+        } CARLA_SAFE_EXCEPTION("write(fSpaceEvent)");
+    }
+
+    /*
+     * Stop reading the pipe from the I/O thread, waking it up if it is waiting for idle.
+     */
+    void stopIoThread() noexcept
+    {
+        if (fSpaceEvent < 0)
+            return;
+
+        __atomic_store_n(&fIoDetached, true, __ATOMIC_RELEASE);
+        signalMailboxSpace();
+
+        gIoThread.removeUi(this);
+        __atomic_store_n(&fPostEvents, false, __ATOMIC_RELEASE);
+    }
+
+    void dispatchEvents() noexcept
+    {
+        const uint32_t head(__atomic_load_n(&fEventHead, __ATOMIC_ACQUIRE));
+
+        if (fEventTail == head)
+            return;
+
+        for (; fEventTail != head;)
+        {
+            const UiEvent event(fEvents[fEventTail % kMaxUiEvents]);
+            __atomic_store_n(&fEventTail, fEventTail + 1, __ATOMIC_RELEASE);
+
+            if (event.type == kUiEventExiting)
+                stopIoThread();
+
+            dispatchEvent(event);
+
+            if (event.data != nullptr)
+                __atomic_store_n(&fUiDataTail, event.dataEnd, __ATOMIC_RELEASE);
+        }
+
+        // pairs with the exchange in waitForMailboxSpace()
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&fIoWaiting, __ATOMIC_RELAXED) != 0)
+            signalMailboxSpace();
+    }
+
+    /*
+     * Handle a decoded message, always called from the host GUI thread.
+     */
+    void dispatchEvent(const UiEvent& event) noexcept
+    {
+        const uint64_t latency(getMicrosecondCounter() - event.time);
+
+        ++fIdleStats.events;
+        fIdleStats.latencyTotal += latency;
+
+        if (latency > fIdleStats.latencyMax)
+            fIdleStats.latencyMax = latency;
+
+        switch (event.type)
+        {
+        case kUiEventControl:
+            // the UI already shows this value, the host echoing it back must not be sent again
+            if (event.index < kMaxShadowPorts)
+            {
+                fPorts[event.index].sentValue = event.value;
+                fPorts[event.index].wasSent   = true;
+            }
+
+            fWriteFunction(fController, event.index, sizeof(float), 0, &event.value);
+            break;
+
+        case kUiEventSize:
+            if (fResize != nullptr)
+                fResize->ui_resize(fResize->handle, static_cast<int>(event.width), static_cast<int>(event.height));
+            break;
+
+        case kUiEventAtom: {
+            LV2_Atom* const atom((LV2_Atom*)event.data);
+
+            if (fUrids.atomEventTransfer == 0 || ! translateAtomUrids(atom, 0))
+            {
+                carla_stderr2("MODEmbedExternalUI - atom for port %u is malformed or uses unknown URIDs, dropping it", event.index);
+                break;
+            }
+
+            fWriteFunction(fController, event.index, lv2_atom_total_size(atom), fUrids.atomEventTransfer, atom);
+            break;
+        }
+
+        case kUiEventUrid:
+            mapUiUrid(event.index, (const char*)event.data);
+            break;
+
+        case kUiEventExiting:
+            CarlaExternalUI::msgExiting();
+            break;
+        }
+    }
+
+    CARLA_DECLARE_NON_COPY_CLASS(MODEmbedExternalUI)
 };
 
+// -----------------------------------------------------------------------
+
+UiIoThread::UiIoThread() noexcept
+    : CarlaThread("MODEmbedExternalUI:io"),
+      fThreadLock(),
+      fLock(),
+      fUiCount(0),
+      fRunning(false),
+      fCurrentUi(nullptr),
+      fWakeEvent(-1)
+{
+    carla_zeroPointers(fUis, kMaxUis);
+}
+
+UiIoThread::~UiIoThread()
+{
+    CARLA_SAFE_ASSERT(fUiCount == 0);
+
+    stopThread(-1);
+
+    if (fWakeEvent >= 0)
+        ::close(fWakeEvent);
+}
+
+bool UiIoThread::addUi(MODEmbedExternalUI* const ui) noexcept
+{
+    const CarlaMutexLocker cmtl(fThreadLock);
+
+    // hosts that never use the thread do not pay for it
+    if (fWakeEvent < 0)
+    {
+        try {
+            fWakeEvent = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        } CARLA_SAFE_EXCEPTION_RETURN("eventfd", false);
+
+        CARLA_SAFE_ASSERT_RETURN(fWakeEvent >= 0, false);
+    }
+
+    bool start;
+
+    {
+        const CarlaMutexLocker cml(fLock);
+
+        if (fUiCount == kMaxUis)
+        {
+            carla_stderr2("UiIoThread: too many UIs, reading the pipe from idle instead");
+            return false;
+        }
+
+        fUis[fUiCount++] = ui;
+
+        start = ! fRunning;
+        fRunning = true;
+    }
+
+    if (! start)
+    {
+        wakeUp();
+        return true;
+    }
+
+    // the previous run might still be returning
+    stopThread(-1);
+
+    if (startThread())
+        return true;
+
+    const CarlaMutexLocker cml(fLock);
+    takeUi(ui);
+    fRunning = false;
+    return false;
+}
+
+void UiIoThread::removeUi(MODEmbedExternalUI* const ui) noexcept
+{
+    {
+        const CarlaMutexLocker cml(fLock);
+        takeUi(ui);
+    }
+
+    wakeUp();
+
+    // only waits while the thread is reading this UI, which returns quickly once the UI is detached
+    for (;;)
+    {
+        {
+            const CarlaMutexLocker cml(fLock);
+
+            if (fCurrentUi != ui)
+                break;
+        }
+
+        carla_msleep(1);
+    }
+
+    // with no UIs left the thread returns by itself, join it unless another UI came in meanwhile
+    const CarlaMutexLocker cmtl(fThreadLock);
+
+    bool stop;
+
+    {
+        const CarlaMutexLocker cml(fLock);
+        stop = fUiCount == 0;
+    }
+
+    if (stop)
+        stopThread(-1);
+}
+
+void UiIoThread::run()
+{
+    struct pollfd pfds[kMaxUis + 1];
+    MODEmbedExternalUI* uis[kMaxUis];
+
+    pfds[0].fd     = fWakeEvent;
+    pfds[0].events = POLLIN;
+
+    for (;;)
+    {
+        uint32_t count = 0;
+        bool ready = false;
+
+        {
+            const CarlaMutexLocker cml(fLock);
+
+            if (fUiCount == 0 || shouldThreadExit())
+            {
+                fRunning = false;
+                return;
+            }
+
+            for (; count < fUiCount; ++count)
+            {
+                uis[count] = fUis[count];
+
+                pollfd& pfd(pfds[count + 1]);
+                pfd.fd      = uis[count]->preparePipeWait();
+                pfd.events  = POLLIN;
+                pfd.revents = 0;
+
+                // messages are there already, poll() ignores negative descriptors
+                if (pfd.fd < 0)
+                    ready = true;
+            }
+        }
+
+        pfds[0].revents = 0;
+
+        try {
+            ::poll(pfds, count + 1, ready ? 0 : 50);
+        } CARLA_SAFE_EXCEPTION("poll");
+
+        if (pfds[0].revents != 0)
+        {
+            uint64_t value;
+            try {
+                if (::read(fWakeEvent, &value, sizeof(value))) {}
+            } CARLA_SAFE_EXCEPTION("read(fWakeEvent)");
+        }
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            MODEmbedExternalUI* const ui(uis[i]);
+
+            // skip UIs removed meanwhile
+            {
+                const CarlaMutexLocker cml(fLock);
+
+                bool found = false;
+                for (uint32_t j=0; j < fUiCount && ! found; ++j)
+                    found = fUis[j] == ui;
+
+                if (! found)
+                    continue;
+
+                fCurrentUi = ui;
+            }
+
+            const bool keep(ui->readFromIoThread(pfds[i + 1].fd, pfds[i + 1].revents));
+
+            const CarlaMutexLocker cml(fLock);
+            fCurrentUi = nullptr;
+
+            if (! keep)
+                takeUi(ui);
+        }
+    }
+}
+
+bool UiIoThread::takeUi(MODEmbedExternalUI* const ui) noexcept
+{
+    for (uint32_t i=0; i < fUiCount; ++i)
+    {
+        if (fUis[i] != ui)
+            continue;
+
+        fUis[i] = fUis[--fUiCount];
+        fUis[fUiCount] = nullptr;
+        return true;
+    }
+
+    return false;
+}
+
+void UiIoThread::wakeUp() const noexcept
+{
+    if (fWakeEvent < 0)
+        return;
+
+    const uint64_t value = 1;
+
+    try {
+        if (::write(fWakeEvent, &value, sizeof(value))) {}
+    } CARLA_SAFE_EXCEPTION("write(fWakeEvent)");
+}
+
 // -----------------------------------------------------------------------
 // LV2 UI descriptor functions
 
@@ -127,8 +1429,10 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* plugi
 {
     CARLA_SAFE_ASSERT_RETURN(writeFunction != nullptr, nullptr);
 
-    const LV2UI_Resize* resize   = nullptr;
-    /* */ uintptr_t     parentId = 0;
+    const LV2UI_Resize*   resize    = nullptr;
+    const LV2_URID_Map*   uridMap   = nullptr;
+    const LV2_URID_Unmap* uridUnmap = nullptr;
+    /* */ uintptr_t       parentId  = 0;
 
     for (int i=0; features[i] != nullptr; ++i)
     {
@@ -141,14 +1445,23 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* plugi
             resize = (const LV2UI_Resize*)features[i]->data;
             resize->ui_resize(resize->handle, 1, 1);
         }
+        else if (std::strcmp(features[i]->URI, LV2_URID__map) == 0)
+        {
+            uridMap = (const LV2_URID_Map*)features[i]->data;
+        }
+        else if (std::strcmp(features[i]->URI, LV2_URID__unmap) == 0)
+        {
+            uridUnmap = (const LV2_URID_Unmap*)features[i]->data;
+        }
     }
 
     CARLA_SAFE_ASSERT_RETURN(parentId != 0, nullptr);
 
-    MODEmbedExternalUI* const thing(new MODEmbedExternalUI(controller, writeFunction, resize,
+    MODEmbedExternalUI* const thing(new MODEmbedExternalUI(controller, writeFunction, resize, uridMap, uridUnmap,
                                                            bundlePath, pluginURI, parentId));
 
-    if (! thing->startPipeServer(false))
+    // the client finishes starting in lv2ui_idle, so the host is not blocked meanwhile
+    if (! thing->startPipeServerAsync())
     {
         delete thing;
         return nullptr;
@@ -20,6 +20,7 @@
 # Imports (Global)
 
 from ctypes import *
+from struct import pack, unpack_from
 from sys import argv, platform
 
 # ------------------------------------------------------------------------------------------------------------
@@ -116,6 +117,8 @@ def toPythonType(value, attr):
         return numPtrToList(value)
     if isinstance(value, POINTER(c_char_p)):
         return charPtrPtrToStringList(value)
+    if isinstance(value, Array):
+        return list(value)
     print("..............", attr, ".....................", value, ":", type(value))
     return value
 
@@ -125,12 +128,171 @@ def toPythonType(value, attr):
 def structToDict(struct):
     return dict((attr, toPythonType(getattr(struct, attr), attr)) for attr, value in struct._fields_)
 
+# ------------------------------------------------------------------------------------------------------------
+# Convert an LV2 atom into a python (type, value) tuple
+# URIDs are resolved using the 'urids' dict, filled from the host "urid" messages
+
+LV2_ATOM_PREFIX     = "http://lv2plug.in/ns/ext/atom#"
+LV2_MIDI__MidiEvent = "http://lv2plug.in/ns/ext/midi#MidiEvent"
+
+def atomToPython(data, urids, offset=0):
+    size, atype = unpack_from("=II", data, offset)
+    return atomBodyToPython(data, offset + 8, size, urids.get(atype, atype), urids)
+
+def atomBodyToPython(data, offset, size, atype, urids):
+    if atype in (LV2_ATOM_PREFIX + "Object", LV2_ATOM_PREFIX + "Blank"):
+        _, otype = unpack_from("=II", data, offset)
+        value    = {}
+        end      = offset + size
+        offset  += 8
+        while offset < end:
+            key, _, vsize = unpack_from("=III", data, offset)
+            value[urids.get(key, key)] = atomToPython(data, urids, offset + 8)
+            offset += 16 + ((vsize + 7) & ~7)
+        return (atype, (urids.get(otype, otype), value))
+
+    if atype == LV2_ATOM_PREFIX + "Sequence":
+        value   = []
+        end     = offset + size
+        offset += 8
+        while offset < end:
+            frames, = unpack_from("=q", data, offset)
+            esize,  = unpack_from("=I", data, offset + 8)
+            value.append((frames, atomToPython(data, urids, offset + 8)))
+            offset += 16 + ((esize + 7) & ~7)
+        return (atype, value)
+
+    if atype == LV2_ATOM_PREFIX + "Tuple":
+        value = []
+        end   = offset + size
+        while offset < end:
+            isize, = unpack_from("=I", data, offset)
+            value.append(atomToPython(data, urids, offset))
+            offset += 8 + ((isize + 7) & ~7)
+        return (atype, value)
+
+    if atype == LV2_ATOM_PREFIX + "Bool":
+        return (atype, bool(unpack_from("=i", data, offset)[0]))
+    if atype == LV2_ATOM_PREFIX + "Int":
+        return (atype, unpack_from("=i", data, offset)[0])
+    if atype == LV2_ATOM_PREFIX + "Long":
+        return (atype, unpack_from("=q", data, offset)[0])
+    if atype == LV2_ATOM_PREFIX + "Float":
+        return (atype, unpack_from("=f", data, offset)[0])
+    if atype == LV2_ATOM_PREFIX + "Double":
+        return (atype, unpack_from("=d", data, offset)[0])
+    if atype == LV2_ATOM_PREFIX + "URID":
+        urid, = unpack_from("=I", data, offset)
+        return (atype, urids.get(urid, urid))
+    if atype in (LV2_ATOM_PREFIX + "String", LV2_ATOM_PREFIX + "Path", LV2_ATOM_PREFIX + "URI"):
+        return (atype, bytes(data[offset:offset+size]).split(b"\0", 1)[0].decode("utf-8", errors="ignore"))
+    if atype == LV2_ATOM_PREFIX + "Literal":
+        return (atype, bytes(data[offset+8:offset+size]).split(b"\0", 1)[0].decode("utf-8", errors="ignore"))
+
+    # MIDI and unknown types stay as raw bytes
+    return (atype, bytes(data[offset:offset+size]))
+
+# ------------------------------------------------------------------------------------------------------------
+# Convert a python (type, value) tuple into an LV2 atom, the reverse of atomToPython
+# URIs are turned into ids using the 'urid' function
+
+def pythonToAtom(atom, urid):
+    atype, value = atom
+    body = pythonToAtomBody(atype, value, urid)
+    return pack("=II", len(body), urid(atype)) + body
+
+def atomPad(data):
+    return data + b"\0" * (-len(data) % 8)
+
+def pythonToAtomBody(atype, value, urid):
+    if atype in (LV2_ATOM_PREFIX + "Object", LV2_ATOM_PREFIX + "Blank"):
+        otype, props = value
+        body = pack("=II", 0, urid(otype))
+        for key, propValue in props.items():
+            body += pack("=II", urid(key), 0) + atomPad(pythonToAtom(propValue, urid))
+        return body
+
+    if atype == LV2_ATOM_PREFIX + "Sequence":
+        body = pack("=II", 0, 0)
+        for frames, event in value:
+            body += pack("=q", frames) + atomPad(pythonToAtom(event, urid))
+        return body
+
+    if atype == LV2_ATOM_PREFIX + "Tuple":
+        return b"".join(atomPad(pythonToAtom(item, urid)) for item in value)
+
+    if atype in (LV2_ATOM_PREFIX + "Bool", LV2_ATOM_PREFIX + "Int"):
+        return pack("=i", int(value))
+    if atype == LV2_ATOM_PREFIX + "Long":
+        return pack("=q", value)
+    if atype == LV2_ATOM_PREFIX + "Float":
+        return pack("=f", value)
+    if atype == LV2_ATOM_PREFIX + "Double":
+        return pack("=d", value)
+    if atype == LV2_ATOM_PREFIX + "URID":
+        return pack("=I", urid(value))
+    if atype in (LV2_ATOM_PREFIX + "String", LV2_ATOM_PREFIX + "Path", LV2_ATOM_PREFIX + "URI"):
+        return value.encode("utf-8") + b"\0"
+
+    # MIDI and unknown types are raw bytes
+    return bytes(value)
+
 # ------------------------------------------------------------------------------------------------------------
 # Carla Utils API (C stuff)
 
 CarlaPipeClientHandle = c_void_p
+CarlaPipeZygoteHandle = c_void_p
 CarlaPipeCallbackFunc = CFUNCTYPE(None, c_void_p, c_char_p)
 
+# Number of buckets in the pipe stats histograms
+CARLA_PIPE_STATS_HISTOGRAM_SIZE = 16
+
+# Runtime counters of a pipe, see CarlaPipeCommon::PipeStats
+class CarlaPipeStats(Structure):
+    _fields_ = [
+        ("messagesIn", c_uint64),
+        ("messagesOut", c_uint64),
+        ("bytesIn", c_uint64),
+        ("bytesOut", c_uint64),
+        ("readSyscalls", c_uint64),
+        ("writeSyscalls", c_uint64),
+        ("readEagains", c_uint64),
+        ("writeEagains", c_uint64),
+        ("readTimeouts", c_uint64),
+        ("lockWaits", c_uint64),
+        ("lockWaitTimeTotal", c_uint64),
+        ("maxLineLength", c_uint64),
+        # histograms, bucket N counts durations below 2^N microseconds
+        ("readTime", c_uint64 * CARLA_PIPE_STATS_HISTOGRAM_SIZE),
+        ("writeTime", c_uint64 * CARLA_PIPE_STATS_HISTOGRAM_SIZE),
+        ("lockWaitTime", c_uint64 * CARLA_PIPE_STATS_HISTOGRAM_SIZE)
+    ]
+
+# ------------------------------------------------------------------------------------------------------------
+# Trace scope, records a begin/end pair when tracing is enabled (MODGUI_TRACE env var)
+
+class CarlaTraceScope(object):
+    def __init__(self, lib, name):
+        object.__init__(self)
+
+        self.lib  = lib
+        self.name = name.encode("utf-8")
+
+    def __enter__(self):
+        self.lib.carla_trace_push(self.name)
+        return self
+
+    def __exit__(self, excType, excValue, traceback):
+        self.lib.carla_trace_pop(self.name)
+        return False
+
+class CarlaNullTraceScope(object):
+    def __enter__(self):
+        return self
+
+    def __exit__(self, excType, excValue, traceback):
+        return False
+
 # ------------------------------------------------------------------------------------------------------------
 # Carla Utils object using a DLL
 
@@ -143,15 +305,33 @@ class CarlaUtils(object):
         self.lib.carla_set_process_name.argtypes = [c_char_p]
         self.lib.carla_set_process_name.restype = None
 
+        self.lib.carla_trace_is_enabled.argtypes = None
+        self.lib.carla_trace_is_enabled.restype = c_bool
+
+        self.lib.carla_trace_push.argtypes = [c_char_p]
+        self.lib.carla_trace_push.restype = None
+
+        self.lib.carla_trace_pop.argtypes = [c_char_p]
+        self.lib.carla_trace_pop.restype = None
+
+        self.lib.carla_trace_save.argtypes = None
+        self.lib.carla_trace_save.restype = None
+
         self.lib.carla_pipe_client_new.argtypes = [POINTER(c_char_p), CarlaPipeCallbackFunc, c_void_p]
         self.lib.carla_pipe_client_new.restype = CarlaPipeClientHandle
 
+        self.lib.carla_pipe_client_new_binary.argtypes = [POINTER(c_char_p), CarlaPipeCallbackFunc, c_void_p]
+        self.lib.carla_pipe_client_new_binary.restype = CarlaPipeClientHandle
+
         self.lib.carla_pipe_client_idle.argtypes = [CarlaPipeClientHandle]
         self.lib.carla_pipe_client_idle.restype = None
 
         self.lib.carla_pipe_client_is_running.argtypes = [CarlaPipeClientHandle]
         self.lib.carla_pipe_client_is_running.restype = c_bool
 
+        self.lib.carla_pipe_client_is_binary.argtypes = [CarlaPipeClientHandle]
+        self.lib.carla_pipe_client_is_binary.restype = c_bool
+
         self.lib.carla_pipe_client_lock.argtypes = [CarlaPipeClientHandle]
         self.lib.carla_pipe_client_lock.restype = None
 
@@ -161,36 +341,104 @@ class CarlaUtils(object):
         self.lib.carla_pipe_client_readlineblock.argtypes = [CarlaPipeClientHandle, c_uint]
         self.lib.carla_pipe_client_readlineblock.restype = c_char_p
 
+        self.lib.carla_pipe_client_read_atom.argtypes = [CarlaPipeClientHandle]
+        self.lib.carla_pipe_client_read_atom.restype = c_void_p
+
         self.lib.carla_pipe_client_write_msg.argtypes = [CarlaPipeClientHandle, c_char_p]
         self.lib.carla_pipe_client_write_msg.restype = c_bool
 
         self.lib.carla_pipe_client_write_and_fix_msg.argtypes = [CarlaPipeClientHandle, c_char_p]
         self.lib.carla_pipe_client_write_and_fix_msg.restype = c_bool
 
+        self.lib.carla_pipe_client_write_atom_msg.argtypes = [CarlaPipeClientHandle, c_uint, c_void_p]
+        self.lib.carla_pipe_client_write_atom_msg.restype = None
+
+        self.lib.carla_pipe_client_write_control_msg.argtypes = [CarlaPipeClientHandle, c_uint, c_float]
+        self.lib.carla_pipe_client_write_control_msg.restype = None
+
         self.lib.carla_pipe_client_flush.argtypes = [CarlaPipeClientHandle]
         self.lib.carla_pipe_client_flush.restype = c_bool
 
         self.lib.carla_pipe_client_flush_and_unlock.argtypes = [CarlaPipeClientHandle]
         self.lib.carla_pipe_client_flush_and_unlock.restype = c_bool
 
+        self.lib.carla_pipe_client_get_stats.argtypes = [CarlaPipeClientHandle]
+        self.lib.carla_pipe_client_get_stats.restype = POINTER(CarlaPipeStats)
+
+        self.lib.carla_pipe_client_dump_stats.argtypes = [CarlaPipeClientHandle]
+        self.lib.carla_pipe_client_dump_stats.restype = None
+
         self.lib.carla_pipe_client_destroy.argtypes = [CarlaPipeClientHandle]
         self.lib.carla_pipe_client_destroy.restype = None
 
+        self.lib.carla_zygote_new.argtypes = [c_int]
+        self.lib.carla_zygote_new.restype = CarlaPipeZygoteHandle
+
+        self.lib.carla_zygote_wait.argtypes = [CarlaPipeZygoteHandle]
+        self.lib.carla_zygote_wait.restype = c_bool
+
+        self.lib.carla_zygote_get_argv.argtypes = [CarlaPipeZygoteHandle]
+        self.lib.carla_zygote_get_argv.restype = POINTER(c_char_p)
+
+        self.lib.carla_zygote_get_instance_id.argtypes = [CarlaPipeZygoteHandle]
+        self.lib.carla_zygote_get_instance_id.restype = c_uint
+
+        self.lib.carla_zygote_host.argtypes = [CarlaPipeZygoteHandle]
+        self.lib.carla_zygote_host.restype = None
+
+        self.lib.carla_zygote_child.argtypes = [CarlaPipeZygoteHandle]
+        self.lib.carla_zygote_child.restype = None
+
+        self.lib.carla_zygote_parent.argtypes = [CarlaPipeZygoteHandle, c_int]
+        self.lib.carla_zygote_parent.restype = None
+
+        self.lib.carla_zygote_destroy.argtypes = [CarlaPipeZygoteHandle]
+        self.lib.carla_zygote_destroy.restype = None
+
+        self.fTraceEnabled   = bool(self.lib.carla_trace_is_enabled())
+        self.fNullTraceScope = CarlaNullTraceScope()
+
+        self.fPipeClientCallbacks = {}
+
     # --------------------------------------------------------------------------------------------------------
 
     def set_process_name(self, name):
         self.lib.carla_set_process_name(name.encode("utf-8"))
 
-    def pipe_client_new(self, func):
-        argc      = len(argv)
-        cagrvtype = c_char_p * argc
+    def trace(self, name):
+        if not self.fTraceEnabled:
+            return self.fNullTraceScope
+        return CarlaTraceScope(self.lib, name)
+
+    def trace_save(self):
+        self.lib.carla_trace_save()
+
+    # 'args' defaults to our own arguments, a shared process passes the ones of each hosted client
+    def pipe_client_new(self, func, binary=False, args=None):
+        if args is None:
+            args = argv
+
+        argc      = len(args)
+        cagrvtype = c_char_p * (argc + 1)
         cargv     = cagrvtype()
 
         for i in range(argc):
-            cargv[i] = c_char_p(argv[i].encode("utf-8"))
+            cargv[i] = c_char_p(args[i].encode("utf-8"))
+
+        cargv[argc] = None
+
+        # must be kept alive for as long as the client exists
+        callback = CarlaPipeCallbackFunc(func)
+
+        if binary:
+            handle = self.lib.carla_pipe_client_new_binary(cargv, callback, None)
+        else:
+            handle = self.lib.carla_pipe_client_new(cargv, callback, None)
+
+        if handle:
+            self.fPipeClientCallbacks[handle] = callback
 
-        self._pipeClientCallback = CarlaPipeCallbackFunc(func)
-        return self.lib.carla_pipe_client_new(cargv, self._pipeClientCallback, None)
+        return handle
 
     def pipe_client_idle(self, handle):
         self.lib.carla_pipe_client_idle(handle)
@@ -198,6 +446,9 @@ class CarlaUtils(object):
     def pipe_client_is_running(self, handle):
         return bool(self.lib.carla_pipe_client_is_running(handle))
 
+    def pipe_client_is_binary(self, handle):
+        return bool(self.lib.carla_pipe_client_is_binary(handle))
+
     def pipe_client_lock(self, handle):
         self.lib.carla_pipe_client_lock(handle)
 
@@ -207,19 +458,68 @@ class CarlaUtils(object):
     def pipe_client_readlineblock(self, handle, timeout):
         return charPtrToString(self.lib.carla_pipe_client_readlineblock(handle, timeout))
 
+    def pipe_client_read_atom(self, handle, size):
+        data = self.lib.carla_pipe_client_read_atom(handle)
+        if not data:
+            return None
+        return string_at(data, size)
+
     def pipe_client_write_msg(self, handle, msg):
         return bool(self.lib.carla_pipe_client_write_msg(handle, msg.encode("utf-8")))
 
     def pipe_client_write_and_fix_msg(self, handle, msg):
         return bool(self.lib.carla_pipe_client_write_and_fix_msg(handle, msg.encode("utf-8")))
 
+    def pipe_client_write_atom_msg(self, handle, index, atom):
+        # atoms must be 64-bit aligned
+        buf = (c_uint64 * ((len(atom) + 7) // 8))()
+        memmove(buf, atom, len(atom))
+        self.lib.carla_pipe_client_write_atom_msg(handle, index, buf)
+
+    def pipe_client_write_control_msg(self, handle, index, value):
+        self.lib.carla_pipe_client_write_control_msg(handle, index, value)
+
     def pipe_client_flush(self, handle):
         return bool(self.lib.carla_pipe_client_flush(handle))
 
     def pipe_client_flush_and_unlock(self, handle):
         return bool(self.lib.carla_pipe_client_flush_and_unlock(handle))
 
+    def pipe_client_get_stats(self, handle):
+        stats = self.lib.carla_pipe_client_get_stats(handle)
+        if not stats:
+            return None
+        return structToDict(stats.contents)
+
+    def pipe_client_dump_stats(self, handle):
+        self.lib.carla_pipe_client_dump_stats(handle)
+
     def pipe_client_destroy(self, handle):
         self.lib.carla_pipe_client_destroy(handle)
+        self.fPipeClientCallbacks.pop(handle, None)
+
+    def zygote_new(self, socket):
+        return self.lib.carla_zygote_new(socket)
+
+    def zygote_wait(self, handle):
+        return bool(self.lib.carla_zygote_wait(handle))
+
+    def zygote_get_argv(self, handle):
+        return charPtrPtrToStringList(self.lib.carla_zygote_get_argv(handle))
+
+    def zygote_get_instance_id(self, handle):
+        return int(self.lib.carla_zygote_get_instance_id(handle))
+
+    def zygote_host(self, handle):
+        self.lib.carla_zygote_host(handle)
+
+    def zygote_child(self, handle):
+        self.lib.carla_zygote_child(handle)
+
+    def zygote_parent(self, handle, pid):
+        self.lib.carla_zygote_parent(handle, pid)
+
+    def zygote_destroy(self, handle):
+        self.lib.carla_zygote_destroy(handle)
 
 # ------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,1479 @@
+/*
+ * Pipe transport benchmark for MODGUI X11UI
+ * Copyright (C) 2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the doc/GPL.txt file.
+ */
+
+#include "CarlaPipeUtils.cpp"
+
+#include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
+
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+// -----------------------------------------------------------------------
+// The same binary runs as server (the "host") and as its client child.
+// Results are written as JSON (default) or CSV, one row per transport and test,
+// to the --output file or to stdout. The pipe code logs to stdout too, so prefer a file for parsing.
+// With --check the exit status also fails if the server allocated memory for a round-trip message,
+// or copying a short CarlaString allocated. Timings are only reported, a loaded machine must not fail the check.
+// With --ui the LV2 UI library is loaded too, and its port_event timed with the UI process running and stopped,
+// --check fails if port_event made a read or write syscall.
+// --transport limits the run to the named transports (repeatable), --no-startup skips the client startup tests.
+
+// -----------------------------------------------------------------------
+// Allocation counter, malloc and friends are replaced by counting wrappers around the glibc allocator.
+// Sanitizer builds bring their own allocator, nothing is counted there.
+
+#if defined(__GLIBC__) && ! defined(__SANITIZE_ADDRESS__) && ! defined(__SANITIZE_THREAD__)
+# define PIPE_BENCH_COUNT_ALLOCATIONS
+
+static uint64_t gAllocationCount = 0;
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+__attribute__((visibility("default")))
+void* malloc(size_t size) noexcept
+{
+    __atomic_add_fetch(&gAllocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+__attribute__((visibility("default")))
+void* calloc(size_t count, size_t size) noexcept
+{
+    __atomic_add_fetch(&gAllocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+__attribute__((visibility("default")))
+void* realloc(void* ptr, size_t size) noexcept
+{
+    __atomic_add_fetch(&gAllocationCount, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+}
+#endif
+
+static uint64_t getAllocationCount() noexcept
+{
+#ifdef PIPE_BENCH_COUNT_ALLOCATIONS
+    return __atomic_load_n(&gAllocationCount, __ATOMIC_RELAXED);
+#else
+    return 0;
+#endif
+}
+
+// -----------------------------------------------------------------------
+
+static uint64_t getNanosecondCounter() noexcept
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+static uint64_t getProcessCpuMicroseconds() noexcept
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+         + static_cast<uint64_t>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+/*
+ * Read and write syscalls made by this process so far, from /proc/self/io.
+ * Reading the file counts as 1 read syscall itself, callers take that into account.
+ */
+static bool getProcessIoSyscalls(uint64_t& reads, uint64_t& writes) noexcept
+{
+    const int fd(open("/proc/self/io", O_RDONLY|O_CLOEXEC));
+    CARLA_SAFE_ASSERT_RETURN(fd >= 0, false);
+
+    char buf[512];
+    const ssize_t r(read(fd, buf, sizeof(buf) - 1));
+    close(fd);
+    CARLA_SAFE_ASSERT_RETURN(r > 0, false);
+    buf[r] = '\0';
+
+    const char* const syscr(std::strstr(buf, "syscr: "));
+    const char* const syscw(std::strstr(buf, "syscw: "));
+    CARLA_SAFE_ASSERT_RETURN(syscr != nullptr && syscw != nullptr, false);
+
+    reads  = std::strtoull(syscr + 7, nullptr, 10);
+    writes = std::strtoull(syscw + 7, nullptr, 10);
+    return true;
+}
+
+static const char* getPathBasename(const char* const path) noexcept
+{
+    const char* const sep(std::strrchr(path, '/'));
+    return (sep != nullptr) ? sep + 1 : path;
+}
+
+// -----------------------------------------------------------------------
+// Client side, counts what it receives and answers "ping" and "sync".
+// The "sync" reply carries the number of read syscalls since the previous one as value.
+
+class BenchClient : public CarlaPipeClient
+{
+public:
+    BenchClient() noexcept
+        : CarlaPipeClient(),
+          fReceived(0),
+          fReadSyscalls(0),
+          fQuit(false)
+    {
+        setMsgHandler(kPipeMsgControl,   &BenchClient::msgControl);
+        setMsgHandler(kPipeMsgAtom,      &BenchClient::msgAtom);
+        setMsgHandler(kPipeMsgConfigure, &BenchClient::msgConfigure);
+        setMsgHandler(kPipeMsgQuit,      &BenchClient::msgQuit);
+    }
+
+    bool shouldQuit() const noexcept
+    {
+        return fQuit;
+    }
+
+protected:
+    bool msgControl() noexcept
+    {
+        uint32_t index;
+        float value;
+
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(index), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsFloat(value), true);
+
+        ++fReceived;
+        return true;
+    }
+
+    bool msgAtom() noexcept
+    {
+        uint32_t index, size;
+        LV2_Atom* atom;
+
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(index), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(size), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsAtom(atom), true);
+
+        ++fReceived;
+        return true;
+    }
+
+    bool msgConfigure() noexcept
+    {
+        const char* key;
+        const char* value;
+
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsString(key, false), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsString(value, false), true);
+
+        ++fReceived;
+        return true;
+    }
+
+    bool msgQuit() noexcept
+    {
+        fQuit = true;
+        return true;
+    }
+
+    // bench only messages, without an opcode of their own
+    bool msgReceived(const char* const msg) noexcept override
+    {
+        if (std::strcmp(msg, "ping") == 0)
+        {
+            uint32_t seq;
+            CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(seq), true);
+
+            writeControlMessage(seq, 0.0f);
+            return true;
+        }
+
+        if (std::strcmp(msg, "sync") == 0)
+        {
+            uint32_t count;
+            CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(count), true);
+
+            if (count != fReceived)
+                carla_stderr2("pipe-bench client: expected %u messages, received %u", count, fReceived);
+
+            PipeStats stats;
+            getPipeStats(stats);
+
+            // exact as float up to 2^24, far more than a single test needs
+            const float reads(static_cast<float>(stats.readSyscalls - fReadSyscalls));
+            fReadSyscalls = stats.readSyscalls;
+
+            fReceived = 0;
+            writeControlMessage(count, reads);
+            return true;
+        }
+
+        return false;
+    }
+
+private:
+    uint32_t fReceived;
+    uint64_t fReadSyscalls;
+    bool     fQuit;
+};
+
+static int runClient(const char* argv[], const char* const flags, const bool ui = false)
+{
+    BenchClient client;
+    client.setPipeBinaryModeAllowed(std::strchr(flags, 'b') != nullptr);
+    client.setPipeSharedMemoryAllowed(std::strchr(flags, 's') != nullptr);
+    client.setPipeSingleWriter(std::strchr(flags, '1') != nullptr);
+
+    if (! client.initPipeClient(argv))
+        return 1;
+
+    // the LV2 UI host gets the pid as value of port 0, so it can stop us
+    if (ui)
+        client.writeControlMessage(0, static_cast<float>(getpid()));
+
+    for (; client.isPipeRunning() && ! client.shouldQuit();)
+    {
+        if (client.waitForPipeMessages(100))
+            client.idlePipe();
+    }
+
+    client.closePipeClient();
+    return 0;
+}
+
+/*
+ * Zygote for the startup test, forks a client for every request.
+ */
+static int runZygote(const int socket)
+{
+    CarlaPipeZygoteClient zygote(socket);
+
+    while (zygote.waitForRequest())
+    {
+        const pid_t pid(fork());
+
+        if (pid == 0)
+        {
+            zygote.setupForkedClient();
+            const char** const argv(zygote.getClientArgv());
+            _exit(runClient(argv, argv[2]));
+        }
+
+        zygote.finishRequest(pid);
+    }
+
+    return 0;
+}
+
+static void* runHostedClient(void* const arg)
+{
+    const char** const argv((const char**)arg);
+
+    runClient(argv, argv[2]);
+
+    for (int i=0; argv[i] != nullptr; ++i)
+        delete[] argv[i];
+    delete[] argv;
+
+    return nullptr;
+}
+
+/*
+ * Shared zygote for the startup test, runs every client in a thread of its own.
+ */
+static int runShared(const int socket)
+{
+    CarlaPipeZygoteClient zygote(socket);
+
+    while (zygote.waitForRequest())
+    {
+        const char** const clientArgv(zygote.getClientArgv());
+        zygote.setupHostedClient();
+
+        // the request arguments are only valid until the next one
+        int argc = 0;
+        for (; clientArgv[argc] != nullptr; ++argc) {}
+
+        const char** const argv(new const char*[argc + 1]);
+
+        for (int i=0; i < argc; ++i)
+            argv[i] = carla_strdup(clientArgv[i]);
+        argv[argc] = nullptr;
+
+        pthread_t thread;
+
+        if (pthread_create(&thread, nullptr, runHostedClient, argv) == 0)
+            pthread_detach(thread);
+        else
+            runHostedClient(argv);
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------
+// Server side
+
+struct BenchResult {
+    const char* transport;
+    const char* test;
+    uint32_t size;
+    uint32_t messages;
+    double   messagesPerSecond;
+    double   syscallsPerMessage;     // writes
+    double   readSyscallsPerMessage; // reads, on the side receiving the messages
+    double   allocationsPerMessage;  // server only
+    double   cpuPer1kMessages;  // microseconds
+    double   latency[4];        // p50, p90, p99 and max, in microseconds
+};
+
+class BenchServer : public CarlaPipeServer
+{
+public:
+    BenchServer() noexcept
+        : CarlaPipeServer(),
+          fReplied(false),
+          fReplyIndex(0),
+          fReplyValue(0.0f)
+    {
+        setMsgHandler(kPipeMsgControl, &BenchServer::msgControl);
+    }
+
+    /*
+     * Wait for the client to answer with a "control" message, which it uses for all replies.
+     * The value of the reply is kept, see getReplyValue().
+     */
+    bool waitForReply(const uint32_t index) noexcept
+    {
+        const uint64_t timeout(getNanosecondCounter() + 10000000000ULL);
+
+        for (;;)
+        {
+            if (waitForPipeMessages(100))
+                idlePipe();
+
+            if (fReplied)
+            {
+                fReplied = false;
+
+                if (fReplyIndex == index)
+                    return true;
+            }
+
+            if (! isPipeRunning() || getNanosecondCounter() > timeout)
+                return false;
+        }
+    }
+
+    float getReplyValue() const noexcept
+    {
+        return fReplyValue;
+    }
+
+    /*
+     * Ask the client to check it received 'count' messages since the previous sync.
+     * On success 'reads' is the number of read syscalls the client made meanwhile.
+     */
+    bool syncClient(const uint32_t count, uint64_t& reads) noexcept
+    {
+        char syncMsg[0xff];
+        std::snprintf(syncMsg, 0xff, "sync\n%u\n", count);
+
+        lockPipe();
+        writeMessage(syncMsg);
+        flushMessages();
+        unlockPipe();
+
+        if (! waitForReply(count))
+            return false;
+
+        reads = static_cast<uint64_t>(fReplyValue);
+        return true;
+    }
+
+    uint64_t getReadSyscalls() const noexcept
+    {
+        PipeStats stats;
+        getPipeStats(stats);
+        return stats.readSyscalls;
+    }
+
+protected:
+    bool msgControl() noexcept
+    {
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsUInt(fReplyIndex), true);
+        CARLA_SAFE_ASSERT_RETURN(readNextLineAsFloat(fReplyValue), true);
+
+        fReplied = true;
+        return true;
+    }
+
+private:
+    bool     fReplied;
+    uint32_t fReplyIndex;
+    float    fReplyValue;
+};
+
+enum BenchTest {
+    kBenchControl,
+    kBenchAtom,
+    kBenchConfigure
+};
+
+/*
+ * Send 'count' messages of one kind, then wait for the client to confirm it got all of them.
+ */
+static bool runThroughput(BenchServer& server, const BenchTest test, const uint32_t size, const uint32_t count,
+                          const char* const transport, const char* const name, BenchResult& result)
+{
+    uint64_t* atomBuf = nullptr;
+    char* configureValue = nullptr;
+
+    if (test == kBenchAtom)
+    {
+        atomBuf = (uint64_t*)std::calloc(1, sizeof(LV2_Atom) + size + 8);
+        CARLA_SAFE_ASSERT_RETURN(atomBuf != nullptr, false);
+
+        LV2_Atom* const atom((LV2_Atom*)atomBuf);
+        atom->size = size;
+        atom->type = 1;
+    }
+    else if (test == kBenchConfigure)
+    {
+        configureValue = (char*)std::malloc(size + 1);
+        CARLA_SAFE_ASSERT_RETURN(configureValue != nullptr, false);
+
+        std::memset(configureValue, 'v', size);
+        configureValue[size] = '\0';
+    }
+
+    // start counting the client reads from here
+    uint64_t reads = 0;
+
+    if (! server.syncClient(0, reads))
+    {
+        std::free(atomBuf);
+        std::free(configureValue);
+        return false;
+    }
+
+    CarlaPipeCommon::OutputStats statsBefore, statsAfter;
+    server.getPipeOutputStats(statsBefore);
+
+    const uint64_t allocationsBefore(getAllocationCount());
+    const uint64_t cpuBefore(getProcessCpuMicroseconds());
+    const uint64_t timeBefore(getNanosecondCounter());
+
+    for (uint32_t i=0; i < count; ++i)
+    {
+        switch (test)
+        {
+        case kBenchControl:
+            server.writeControlMessage(i % 64, static_cast<float>(i));
+            break;
+        case kBenchAtom:
+            server.writeLv2AtomMessage(i % 64, (const LV2_Atom*)atomBuf);
+            break;
+        case kBenchConfigure:
+            server.writeConfigureMessage("key", configureValue);
+            break;
+        }
+    }
+
+    const bool ok(server.syncClient(count, reads));
+
+    const uint64_t timeAfter(getNanosecondCounter());
+    const uint64_t cpuAfter(getProcessCpuMicroseconds());
+    const uint64_t allocations(getAllocationCount() - allocationsBefore);
+    server.getPipeOutputStats(statsAfter);
+
+    std::free(atomBuf);
+    std::free(configureValue);
+
+    carla_zeroStruct(result);
+    result.transport          = transport;
+    result.test               = name;
+    result.size               = size;
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+    result.syscallsPerMessage = static_cast<double>(statsAfter.syscalls - statsBefore.syscalls) / count;
+    result.readSyscallsPerMessage = static_cast<double>(reads) / count;
+    result.allocationsPerMessage  = static_cast<double>(allocations) / count;
+    result.cpuPer1kMessages   = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+    return ok;
+}
+
+struct BenchWriter {
+    BenchServer* server;
+    uint32_t     first;
+    uint32_t     count;
+};
+
+static void* runBenchWriter(void* const arg)
+{
+    const BenchWriter* const writer((const BenchWriter*)arg);
+
+    for (uint32_t i=writer->first, end=writer->first+writer->count; i < end; ++i)
+        writer->server->writeControlMessage(i % 64, static_cast<float>(i));
+
+    return nullptr;
+}
+
+/*
+ * Like runThroughput() for control messages, but written from 2 threads at once to measure the write lock under
+ * contention. Also gives ThreadSanitizer builds something to check the lock with.
+ */
+static bool runThroughputThreads(BenchServer& server, const uint32_t count, const char* const transport,
+                                 BenchResult& result)
+{
+    uint64_t reads = 0;
+
+    if (! server.syncClient(0, reads))
+        return false;
+
+    CarlaPipeCommon::OutputStats statsBefore, statsAfter;
+    server.getPipeOutputStats(statsBefore);
+
+    const uint64_t cpuBefore(getProcessCpuMicroseconds());
+    const uint64_t timeBefore(getNanosecondCounter());
+
+    BenchWriter writers[2];
+    pthread_t threads[2];
+    uint32_t started = 0;
+
+    for (uint32_t i=0; i < 2; ++i)
+    {
+        writers[i].server = &server;
+        writers[i].first  = i * (count / 2);
+        writers[i].count  = (i == 0) ? count / 2 : count - count / 2;
+
+        if (pthread_create(&threads[i], nullptr, runBenchWriter, &writers[i]) != 0)
+            break;
+
+        ++started;
+    }
+
+    for (uint32_t i=0; i < started; ++i)
+        pthread_join(threads[i], nullptr);
+
+    // a writer that could not be started still has its messages counted by the client
+    for (uint32_t i=started; i < 2; ++i)
+        runBenchWriter(&writers[i]);
+
+    const bool ok(server.syncClient(count, reads));
+
+    const uint64_t timeAfter(getNanosecondCounter());
+    const uint64_t cpuAfter(getProcessCpuMicroseconds());
+    server.getPipeOutputStats(statsAfter);
+
+    carla_zeroStruct(result);
+    result.transport          = transport;
+    result.test               = "control-2threads";
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+    result.syscallsPerMessage = static_cast<double>(statsAfter.syscalls - statsBefore.syscalls) / count;
+    result.readSyscallsPerMessage = static_cast<double>(reads) / count;
+    result.cpuPer1kMessages   = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+    return ok;
+}
+
+/*
+ * Ping the client 'count' times, one at a time, and keep the round-trip time percentiles.
+ */
+static bool runLatency(BenchServer& server, const uint32_t count, const char* const transport, BenchResult& result)
+{
+    uint64_t* const times((uint64_t*)std::malloc(sizeof(uint64_t) * count));
+    CARLA_SAFE_ASSERT_RETURN(times != nullptr, false);
+
+    uint64_t clientReads = 0;
+
+    if (! server.syncClient(0, clientReads))
+    {
+        std::free(times);
+        return false;
+    }
+
+    CarlaPipeCommon::OutputStats statsBefore, statsAfter;
+    server.getPipeOutputStats(statsBefore);
+
+    const uint64_t serverReadsBefore(server.getReadSyscalls());
+    const uint64_t allocationsBefore(getAllocationCount());
+    const uint64_t cpuBefore(getProcessCpuMicroseconds());
+    const uint64_t timeBefore(getNanosecondCounter());
+
+    bool ok = true;
+    char pingMsg[0xff];
+
+    for (uint32_t i=0; i < count && ok; ++i)
+    {
+        std::snprintf(pingMsg, 0xff, "ping\n%u\n", i);
+
+        const uint64_t start(getNanosecondCounter());
+
+        server.lockPipe();
+        server.writeMessage(pingMsg);
+        server.flushMessages();
+        server.unlockPipe();
+
+        ok = server.waitForReply(i);
+        times[i] = getNanosecondCounter() - start;
+    }
+
+    const uint64_t timeAfter(getNanosecondCounter());
+    const uint64_t cpuAfter(getProcessCpuMicroseconds());
+    const uint64_t allocations(getAllocationCount() - allocationsBefore);
+    const uint64_t serverReads(server.getReadSyscalls() - serverReadsBefore);
+    server.getPipeOutputStats(statsAfter);
+
+    ok = ok && server.syncClient(0, clientReads);
+
+    std::sort(times, times + count);
+
+    carla_zeroStruct(result);
+    result.transport          = transport;
+    result.test               = "roundtrip";
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+    result.syscallsPerMessage = static_cast<double>(statsAfter.syscalls - statsBefore.syscalls) / count;
+    result.readSyscallsPerMessage = static_cast<double>(serverReads + clientReads) / (2 * count); // ping and reply
+    result.allocationsPerMessage  = static_cast<double>(allocations) / count;
+    result.cpuPer1kMessages   = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+    result.latency[0]         = times[count * 50 / 100] / 1000.0;
+    result.latency[1]         = times[count * 90 / 100] / 1000.0;
+    result.latency[2]         = times[count * 99 / 100] / 1000.0;
+    result.latency[3]         = times[count - 1] / 1000.0;
+
+    std::free(times);
+    return ok;
+}
+
+/*
+ * Send 'count' pings split in two writes, the second line 'delay' ms after the first.
+ * The client is left blocked in the middle of a message, the time kept is from writing
+ * the last line until the reply arrives.
+ */
+static bool runSlowWriter(BenchServer& server, const uint32_t count, const uint32_t delay,
+                          const char* const transport, BenchResult& result)
+{
+    uint64_t* const times((uint64_t*)std::malloc(sizeof(uint64_t) * count));
+    CARLA_SAFE_ASSERT_RETURN(times != nullptr, false);
+
+    uint64_t clientReads = 0;
+
+    if (! server.syncClient(0, clientReads))
+    {
+        std::free(times);
+        return false;
+    }
+
+    const uint64_t cpuBefore(getProcessCpuMicroseconds());
+    const uint64_t timeBefore(getNanosecondCounter());
+
+    bool ok = true;
+    char seqMsg[0xff];
+
+    for (uint32_t i=0; i < count && ok; ++i)
+    {
+        std::snprintf(seqMsg, 0xff, "%u\n", i);
+
+        server.lockPipe();
+        server.writeMessage("ping\n");
+        server.flushMessages();
+        server.unlockPipe();
+
+        carla_msleep(delay);
+
+        const uint64_t start(getNanosecondCounter());
+
+        server.lockPipe();
+        server.writeMessage(seqMsg);
+        server.flushMessages();
+        server.unlockPipe();
+
+        ok = server.waitForReply(i);
+        times[i] = getNanosecondCounter() - start;
+    }
+
+    const uint64_t timeAfter(getNanosecondCounter());
+    const uint64_t cpuAfter(getProcessCpuMicroseconds());
+
+    ok = ok && server.syncClient(0, clientReads);
+
+    std::sort(times, times + count);
+
+    carla_zeroStruct(result);
+    result.transport          = transport;
+    result.test               = "multiline-slow";
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+    result.readSyscallsPerMessage = static_cast<double>(clientReads) / count;
+    result.cpuPer1kMessages   = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+    result.latency[0]         = times[count * 50 / 100] / 1000.0;
+    result.latency[1]         = times[count * 90 / 100] / 1000.0;
+    result.latency[2]         = times[count * 99 / 100] / 1000.0;
+    result.latency[3]         = times[count - 1] / 1000.0;
+
+    std::free(times);
+    return ok;
+}
+
+/*
+ * Start a client 'count' times, spawned or through 'zygote', and keep the time until it answers a ping.
+ * An untimed start goes first, so the zygote is ready and the binary is in the page cache.
+ */
+static bool runStartup(const char* const self, CarlaPipeZygote* const zygote, const uint32_t count,
+                       const char* const name, BenchResult& result)
+{
+    uint64_t* const times((uint64_t*)std::malloc(sizeof(uint64_t) * count));
+    CARLA_SAFE_ASSERT_RETURN(times != nullptr, false);
+
+    uint64_t cpuTotal  = 0;
+    uint64_t timeTotal = 0;
+    bool ok = true;
+
+    for (uint32_t i=0; i <= count && ok; ++i)
+    {
+        BenchServer server;
+        server.setPipeBinaryModeAllowed(true);
+        server.setPipeZygote(zygote);
+
+        const uint64_t cpuBefore(getProcessCpuMicroseconds());
+        const uint64_t start(getNanosecondCounter());
+
+        ok = server.startPipeServer(self, "client", "b");
+
+        if (ok)
+        {
+            server.lockPipe();
+            server.writeMessage("ping\n0\n");
+            server.flushMessages();
+            server.unlockPipe();
+
+            ok = server.waitForReply(0);
+        }
+
+        const uint64_t time(getNanosecondCounter() - start);
+        const uint64_t cpu(getProcessCpuMicroseconds() - cpuBefore);
+
+        server.stopPipeServer(5000);
+
+        if (i == 0)
+            continue;
+
+        times[i - 1] = time;
+        timeTotal   += time;
+        cpuTotal    += cpu;
+    }
+
+    if (! ok)
+    {
+        std::free(times);
+        return false;
+    }
+
+    std::sort(times, times + count);
+
+    carla_zeroStruct(result);
+    result.transport          = "binary";
+    result.test               = name;
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeTotal);
+    result.cpuPer1kMessages   = static_cast<double>(cpuTotal) * 1000.0 / count;
+    result.latency[0]         = times[count * 50 / 100] / 1000.0;
+    result.latency[1]         = times[count * 90 / 100] / 1000.0;
+    result.latency[2]         = times[count * 99 / 100] / 1000.0;
+    result.latency[3]         = times[count - 1] / 1000.0;
+
+    std::free(times);
+    return ok;
+}
+
+/*
+ * Do the runtime counter updates of a message 'count' times, as the pipe does when writing it on one side and
+ * reading it on the other, without the messages. Shows what the counters add to each message.
+ */
+static void runCounters(const uint32_t count, BenchResult& result)
+{
+    static CarlaPipeCommon::PipeStats stats;
+    uint32_t writeTimeSample = 0;
+
+    carla_zeroStruct(stats);
+
+    const uint64_t cpuBefore(getProcessCpuMicroseconds());
+    const uint64_t timeBefore(getNanosecondCounter());
+
+    for (uint32_t i=0; i < count; ++i)
+    {
+        // writing side, see startWrite() and finishWrite()
+        const uint64_t start(((++writeTimeSample & (kPipeStatsWriteSampling - 1)) != 0) ? 0 : getMicrosecondCounter());
+
+        pipeStatsAdd(stats.messagesOut, 1);
+        pipeStatsAdd(stats.writeSyscalls, 1);
+        pipeStatsAdd(stats.bytesOut, 16);
+
+        if (start != 0)
+            pipeStatsHistogram(stats.writeTime, getMicrosecondCounter() - start);
+
+        // reading side
+        pipeStatsAdd(stats.readSyscalls, 1);
+        pipeStatsAdd(stats.bytesIn, 16);
+        pipeStatsMax(stats.maxLineLength, 8 + (i & 7));
+        pipeStatsAdd(stats.messagesIn, 1);
+    }
+
+    const uint64_t timeAfter(getNanosecondCounter());
+    const uint64_t cpuAfter(getProcessCpuMicroseconds());
+
+    CARLA_SAFE_ASSERT(stats.messagesIn == count);
+
+    carla_zeroStruct(result);
+    result.transport          = "none";
+    result.test               = "counters";
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+    result.cpuPer1kMessages   = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+}
+
+enum StringTest {
+    kStringPath,   // client path and arguments, as the LV2 UI builds them when instantiated
+    kStringAppend, // 64 appends of 16 characters
+    kStringBase64, // 48 bytes of atom data as base64
+    kStringShort   // copy and assignment of a short string
+};
+
+static const struct {
+    StringTest  test;
+    const char* name;
+} kStringCases[] = {
+    { kStringPath,   "string-path"   },
+    { kStringAppend, "string-append" },
+    { kStringBase64, "string-base64" },
+    { kStringShort,  "string-short"  }
+};
+
+static const uint32_t kStringCaseCount = sizeof(kStringCases)/sizeof(kStringCases[0]);
+
+static void runStringTest(const StringTest test, CarlaString& out)
+{
+    switch (test)
+    {
+    case kStringPath: {
+        static const char* const bundlePath = "/usr/lib/lv2/mod-some-plugin-name.lv2/modgui-x11ui.lv2";
+        CarlaString filename;
+        filename.appendFormat("%s" CARLA_OS_SEP_STR "modgui-x11", bundlePath);
+        const CarlaString parentId(static_cast<uintptr_t>(0x4a00007));
+        out = filename;
+        out = parentId;
+        break;
+    }
+    case kStringAppend: {
+        CarlaString str;
+        for (int i=0; i < 64; ++i)
+            str += "0123456789abcdef";
+        out = str;
+        break;
+    }
+    case kStringBase64: {
+        static const char data[48] = { 1 };
+        out = CarlaString::asBase64(data, sizeof(data));
+        break;
+    }
+    case kStringShort: {
+        const CarlaString str("control 12");
+        CarlaString copy(str);
+        copy = str;
+        out = copy;
+        break;
+    }
+    }
+}
+
+/*
+ * Build strings as the UI and pipe code do with CarlaString, 'count' times per case.
+ * Results go into 'results', one row per case, with the allocations each time took.
+ */
+static void runStrings(const uint32_t count, BenchResult* const results)
+{
+    for (uint32_t c=0; c < kStringCaseCount; ++c)
+    {
+        CarlaString out;
+
+        // the first run sizes 'out'
+        runStringTest(kStringCases[c].test, out);
+
+        const uint64_t allocationsBefore(getAllocationCount());
+        const uint64_t cpuBefore(getProcessCpuMicroseconds());
+        const uint64_t timeBefore(getNanosecondCounter());
+
+        for (uint32_t i=0; i < count; ++i)
+            runStringTest(kStringCases[c].test, out);
+
+        const uint64_t timeAfter(getNanosecondCounter());
+        const uint64_t cpuAfter(getProcessCpuMicroseconds());
+        const uint64_t allocations(getAllocationCount() - allocationsBefore);
+
+        BenchResult& result(results[c]);
+        carla_zeroStruct(result);
+        result.transport             = "none";
+        result.test                  = kStringCases[c].name;
+        result.messages              = count;
+        result.messagesPerSecond     = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+        result.allocationsPerMessage = static_cast<double>(allocations) / count;
+        result.cpuPer1kMessages      = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+    }
+}
+
+// -----------------------------------------------------------------------
+// LV2 UI host side, the UI library is loaded and its client started from a temporary bundle,
+// where "modgui-x11" links back to this binary.
+
+struct UiBenchHost {
+    const LV2UI_Descriptor*     descriptor;
+    const LV2UI_Idle_Interface* idleIface;
+    LV2UI_Handle handle;
+    pid_t clientPid;
+};
+
+static void uiBenchWrite(LV2UI_Controller controller, uint32_t portIndex, uint32_t bufferSize,
+                         uint32_t format, const void* buffer)
+{
+    UiBenchHost* const host((UiBenchHost*)controller);
+
+    if (portIndex == 0 && format == 0 && bufferSize == sizeof(float))
+        host->clientPid = static_cast<pid_t>(*(const float*)buffer);
+}
+
+/*
+ * Send 'count' port events to the UI without calling idle, and count the read and write syscalls made meanwhile.
+ * Nothing else in this process reads or writes while it runs, unless the UI I/O thread is enabled.
+ */
+static bool countPortEventSyscalls(UiBenchHost& host, const uint32_t count, uint64_t& reads, uint64_t& writes)
+{
+    uint64_t reads1, writes1, reads2, writes2, reads3, writes3;
+
+    // the 2nd read of /proc/self/io counts the 1st, and so does the 3rd count the 2nd
+    CARLA_SAFE_ASSERT_RETURN(getProcessIoSyscalls(reads1, writes1), false);
+    CARLA_SAFE_ASSERT_RETURN(getProcessIoSyscalls(reads2, writes2), false);
+
+    for (uint32_t i=0; i < count; ++i)
+    {
+        const float value(static_cast<float>(i));
+        host.descriptor->port_event(host.handle, 1 + i % 64, sizeof(float), 0, &value);
+    }
+
+    CARLA_SAFE_ASSERT_RETURN(getProcessIoSyscalls(reads3, writes3), false);
+
+    reads  = (reads3 - reads2) - (reads2 - reads1);
+    writes = (writes3 - writes2) - (writes2 - writes1);
+    return true;
+}
+
+/*
+ * Send 'count' port events to the UI, calling idle in between like a host does, and keep the port_event times.
+ * The syscall columns come from a separate run without idle, port_event alone must not make any.
+ */
+static bool runPortEvents(UiBenchHost& host, const uint32_t count, const char* const name, BenchResult& result)
+{
+    uint64_t reads, writes;
+
+    if (! countPortEventSyscalls(host, count, reads, writes))
+        return false;
+
+    // send what the run above left behind
+    host.idleIface->idle(host.handle);
+
+    uint64_t* const times((uint64_t*)std::malloc(sizeof(uint64_t) * count));
+    CARLA_SAFE_ASSERT_RETURN(times != nullptr, false);
+
+    const uint64_t cpuBefore(getProcessCpuMicroseconds());
+    const uint64_t timeBefore(getNanosecondCounter());
+
+    for (uint32_t i=0; i < count; ++i)
+    {
+        const float value(static_cast<float>(i));
+        const uint64_t start(getNanosecondCounter());
+
+        host.descriptor->port_event(host.handle, 1 + i % 64, sizeof(float), 0, &value);
+        times[i] = getNanosecondCounter() - start;
+
+        if (i % 64 == 63)
+            host.idleIface->idle(host.handle);
+    }
+
+    const uint64_t timeAfter(getNanosecondCounter());
+    const uint64_t cpuAfter(getProcessCpuMicroseconds());
+
+    std::sort(times, times + count);
+
+    carla_zeroStruct(result);
+    result.transport          = "lv2-ui";
+    result.test               = name;
+    result.messages           = count;
+    result.messagesPerSecond  = count * 1e9 / static_cast<double>(timeAfter - timeBefore);
+    result.syscallsPerMessage = static_cast<double>(writes) / count;
+    result.readSyscallsPerMessage = static_cast<double>(reads) / count;
+    result.cpuPer1kMessages   = static_cast<double>(cpuAfter - cpuBefore) * 1000.0 / count;
+    result.latency[0]         = times[count * 50 / 100] / 1000.0;
+    result.latency[1]         = times[count * 90 / 100] / 1000.0;
+    result.latency[2]         = times[count * 99 / 100] / 1000.0;
+    result.latency[3]         = times[count - 1] / 1000.0;
+
+    std::free(times);
+    return true;
+}
+
+/*
+ * Time port_event with the UI process running, and again while it is stopped with SIGSTOP.
+ * Neither port_event nor idle may wait for the UI, so both results should be the same.
+ */
+static bool runUiPortEvents(const char* const self, const char* const uiLibrary, const uint32_t count,
+                            BenchResult* const results)
+{
+    // never closed, the UI keeps threads running in the background after cleanup
+    void* const lib(dlopen(uiLibrary, RTLD_NOW|RTLD_LOCAL));
+
+    if (lib == nullptr)
+    {
+        carla_stderr2("pipe-bench: cannot load '%s': %s", uiLibrary, dlerror());
+        return false;
+    }
+
+    typedef const LV2UI_Descriptor* (*DescriptorFunction)(uint32_t index);
+
+    const DescriptorFunction descFn((DescriptorFunction)dlsym(lib, "lv2ui_descriptor"));
+    CARLA_SAFE_ASSERT_RETURN(descFn != nullptr, false);
+
+    UiBenchHost host;
+    carla_zeroStruct(host);
+    host.descriptor = descFn(0);
+    CARLA_SAFE_ASSERT_RETURN(host.descriptor != nullptr, false);
+
+    host.idleIface = (const LV2UI_Idle_Interface*)host.descriptor->extension_data(LV2_UI__idleInterface);
+    CARLA_SAFE_ASSERT_RETURN(host.idleIface != nullptr, false);
+
+    char bundle[] = "/tmp/pipe-bench-XXXXXX";
+    CARLA_SAFE_ASSERT_RETURN(mkdtemp(bundle) != nullptr, false);
+
+    char link[PATH_MAX];
+    std::snprintf(link, PATH_MAX, "%s/modgui-x11", bundle);
+
+    bool ok = symlink(self, link) == 0;
+
+    if (ok)
+    {
+        const LV2_Feature parentFeature = { LV2_UI__parent, (void*)1 };
+        const LV2_Feature* const features[] = { &parentFeature, nullptr };
+        LV2UI_Widget widget;
+
+        host.handle = host.descriptor->instantiate(host.descriptor, "urn:pipe-bench", bundle,
+                                                   uiBenchWrite, &host, &widget, features);
+        ok = host.handle != nullptr;
+    }
+
+    // wait for the client to start and tell its pid
+    for (const uint64_t timeout(getNanosecondCounter() + 10000000000ULL); ok && host.clientPid == 0;)
+    {
+        if (host.idleIface->idle(host.handle) != 0 || getNanosecondCounter() > timeout)
+            ok = false;
+        else
+            carla_msleep(1);
+    }
+
+    if (ok)
+    {
+        ok = runPortEvents(host, count, "port-event", results[0]);
+
+        kill(host.clientPid, SIGSTOP);
+        ok = ok && runPortEvents(host, count, "port-event-stopped", results[1]);
+        kill(host.clientPid, SIGCONT);
+    }
+
+    if (host.handle != nullptr)
+        host.descriptor->cleanup(host.handle);
+
+    unlink(link);
+    rmdir(bundle);
+    return ok;
+}
+
+// -----------------------------------------------------------------------
+
+struct BenchTransport {
+    const char* name;
+    const char* flags; // 'b' for binary, 's' for shared memory, '1' for single writer mode
+};
+
+static const BenchTransport kBenchTransports[] = {
+    { "text",          "t"   },
+    { "binary",        "b"   },
+    { "binary-single", "b1"  },
+    { "shm",           "bs"  },
+    { "shm-single",    "bs1" }
+};
+
+struct BenchCase {
+    BenchTest   test;
+    const char* name;
+    uint32_t    size;
+    uint32_t    count;
+};
+
+static const BenchCase kBenchCases[] = {
+    { kBenchControl,   "control",   0,     200000 },
+    { kBenchAtom,      "atom",      16,    100000 },
+    { kBenchAtom,      "atom",      256,   50000  },
+    { kBenchAtom,      "atom",      4096,  10000  },
+    { kBenchAtom,      "atom",      65536, 1000   },
+    { kBenchConfigure, "configure", 64,    50000  }
+};
+
+static const uint32_t kBenchCaseCount = sizeof(kBenchCases)/sizeof(kBenchCases[0]);
+
+static void printResults(FILE* const out, const BenchResult* const results, const uint32_t count, const bool csv)
+{
+    if (csv)
+    {
+        std::fprintf(out, "transport,test,size,messages,msgs_per_sec,syscalls_per_msg,read_syscalls_per_msg,"
+                          "allocs_per_msg,cpu_us_per_1k,p50_us,p90_us,p99_us,max_us\n");
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            const BenchResult& r(results[i]);
+            std::fprintf(out, "%s,%s,%u,%u,%.1f,%.4f,%.4f,%.4f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+                        r.transport, r.test, r.size, r.messages, r.messagesPerSecond, r.syscallsPerMessage,
+                        r.readSyscallsPerMessage, r.allocationsPerMessage, r.cpuPer1kMessages,
+                        r.latency[0], r.latency[1], r.latency[2], r.latency[3]);
+        }
+        return;
+    }
+
+    std::fprintf(out, "{\n  \"results\": [\n");
+
+    for (uint32_t i=0; i < count; ++i)
+    {
+        const BenchResult& r(results[i]);
+        std::fprintf(out, "    { \"transport\": \"%s\", \"test\": \"%s\", \"size\": %u, \"messages\": %u, "
+                    "\"msgs_per_sec\": %.1f, \"syscalls_per_msg\": %.4f, \"read_syscalls_per_msg\": %.4f, "
+                    "\"allocs_per_msg\": %.4f, \"cpu_us_per_1k\": %.2f",
+                    r.transport, r.test, r.size, r.messages, r.messagesPerSecond, r.syscallsPerMessage,
+                    r.readSyscallsPerMessage, r.allocationsPerMessage, r.cpuPer1kMessages);
+
+        if (std::strcmp(r.test, "roundtrip") == 0 || std::strcmp(r.test, "multiline-slow") == 0 ||
+            std::strncmp(r.test, "startup", 7) == 0 || std::strncmp(r.test, "port-event", 10) == 0)
+            std::fprintf(out, ", \"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f",
+                        r.latency[0], r.latency[1], r.latency[2], r.latency[3]);
+
+        std::fprintf(out, " }%s\n", (i + 1 < count) ? "," : "");
+    }
+
+    std::fprintf(out, "  ]\n}\n");
+}
+
+static const uint32_t kMaxBenchTransports = sizeof(kBenchTransports)/sizeof(kBenchTransports[0]);
+
+// per transport: round-trip, slow writer, the cases and threads. then counters, strings, 2 port_event and 3 startup rows
+static const uint32_t kMaxResults = kMaxBenchTransports * (kBenchCaseCount + 3) + 1 + kStringCaseCount + 2 + 3;
+
+struct BenchOptions {
+    bool   csv;
+    bool   check; // fail if a round-trip message made the server allocate, or port_event made a syscall
+    bool   startup; // time client startup, spawning processes
+    double scale;
+    const char* uiLibrary; // LV2 UI to time port_event of, optional
+    const char* transports[kMaxBenchTransports]; // transports to run, all if none given
+    uint32_t transportCount;
+};
+
+static bool isTransportSelected(const BenchOptions& options, const char* const name)
+{
+    if (options.transportCount == 0)
+        return true;
+
+    for (uint32_t i=0; i < options.transportCount; ++i)
+    {
+        if (std::strcmp(options.transports[i], name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static int runServer(const char* const self, FILE* const out, const BenchOptions& options)
+{
+    const double scale(options.scale);
+
+    BenchResult results[kMaxResults];
+    uint32_t resultCount = 0;
+    bool ok = true;
+    bool checksOk = true;
+
+    for (uint32_t t=0; t < kMaxBenchTransports && ok; ++t)
+    {
+        const BenchTransport& transport(kBenchTransports[t]);
+
+        if (! isTransportSelected(options, transport.name))
+            continue;
+
+        BenchServer server;
+        server.setPipeBinaryModeAllowed(std::strchr(transport.flags, 'b') != nullptr);
+        server.setPipeSharedMemoryAllowed(std::strchr(transport.flags, 's') != nullptr);
+        server.setPipeSingleWriter(std::strchr(transport.flags, '1') != nullptr);
+
+        if (! server.startPipeServer(self, "client", transport.flags))
+        {
+            carla_stderr2("pipe-bench: failed to start the %s client", transport.name);
+            return 1;
+        }
+
+        const uint32_t pings(std::max(1U, static_cast<uint32_t>(5000 * scale)));
+        ok = runLatency(server, pings, transport.name, results[resultCount]);
+
+        // receiving the reply and writing the next ping must only use the pipe buffers
+        if (ok && options.check && results[resultCount].allocationsPerMessage != 0.0)
+        {
+            carla_stderr2("pipe-bench: %s round-trip messages made %.4f allocations each",
+                          transport.name, results[resultCount].allocationsPerMessage);
+            checksOk = false;
+        }
+
+        ++resultCount;
+
+        // a message completed by a slow writer, the reader must wake up when the last line arrives.
+        // polling with sleeps in between would take milliseconds, but timings are only reported, never checked
+        if (ok)
+        {
+            const uint32_t slowPings(std::max(1U, static_cast<uint32_t>(500 * scale)));
+            ok = runSlowWriter(server, slowPings, 2, transport.name, results[resultCount++]);
+        }
+
+        for (uint32_t c=0; c < kBenchCaseCount && ok; ++c)
+        {
+            const BenchCase& bcase(kBenchCases[c]);
+            const uint32_t count(std::max(1U, static_cast<uint32_t>(bcase.count * scale)));
+
+            ok = runThroughput(server, bcase.test, bcase.size, count, transport.name, bcase.name, results[resultCount++]);
+        }
+
+        // a single writer pipe must not be written from more than 1 thread
+        if (ok && std::strchr(transport.flags, '1') == nullptr)
+        {
+            const uint32_t count(std::max(2U, static_cast<uint32_t>(200000 * scale)));
+
+            ok = runThroughputThreads(server, count, transport.name, results[resultCount++]);
+        }
+
+        server.stopPipeServer(5000);
+
+        if (! ok)
+            carla_stderr2("pipe-bench: the %s client stopped answering", transport.name);
+    }
+
+    // what the runtime counters cost per message, to compare with the message rates above
+    if (ok)
+        runCounters(std::max(1U, static_cast<uint32_t>(20000000 * scale)), results[resultCount++]);
+
+    // what building strings costs, short ones must stay inline
+    if (ok)
+    {
+        runStrings(std::max(1U, static_cast<uint32_t>(200000 * scale)), results + resultCount);
+
+        const BenchResult& shortResult(results[resultCount + kStringShort]);
+
+        if (options.check && shortResult.allocationsPerMessage != 0.0)
+        {
+            carla_stderr2("pipe-bench: copying a short string made %.4f allocations", shortResult.allocationsPerMessage);
+            checksOk = false;
+        }
+
+        resultCount += kStringCaseCount;
+    }
+
+    // port_event must not wait for the UI process, even when it is not running at all
+    if (ok && options.uiLibrary != nullptr)
+    {
+        const uint32_t count(std::max(64U, static_cast<uint32_t>(100000 * scale)));
+
+        ok = runUiPortEvents(self, options.uiLibrary, count, results + resultCount);
+
+        if (! ok)
+            carla_stderr2("pipe-bench: failed to start the LV2 UI");
+
+        for (uint32_t i=0; ok && options.check && i < 2; ++i)
+        {
+            const BenchResult& result(results[resultCount + i]);
+
+            if (result.syscallsPerMessage != 0.0 || result.readSyscallsPerMessage != 0.0)
+            {
+                carla_stderr2("pipe-bench: %s made %.4f write and %.4f read syscalls per call",
+                              result.test, result.syscallsPerMessage, result.readSyscallsPerMessage);
+                checksOk = false;
+            }
+        }
+
+        if (ok)
+            resultCount += 2;
+    }
+
+    // client startup, spawning a new process each time versus forking it from a zygote or hosting it in a shared one
+    const uint32_t starts(std::max(1U, static_cast<uint32_t>(200 * scale)));
+
+    if (ok && options.startup)
+    {
+        ok = runStartup(self, nullptr, starts, "startup-cold", results[resultCount++]);
+
+        if (! ok)
+            carla_stderr2("pipe-bench: failed to start a client");
+    }
+
+    if (ok && options.startup)
+    {
+        CarlaPipeZygote zygote;
+
+        ok = zygote.startZygote(self);
+
+        // measure forked clients only
+        for (const uint64_t timeout(getNanosecondCounter() + 10000000000ULL); ok && ! zygote.isZygoteReady();)
+        {
+            if (getNanosecondCounter() > timeout)
+                ok = false;
+            else
+                carla_msleep(1);
+        }
+
+        ok = ok && runStartup(self, &zygote, starts, "startup-zygote", results[resultCount++]);
+
+        if (! ok)
+            carla_stderr2("pipe-bench: failed to start a client through the zygote");
+
+        zygote.stopZygote(5000);
+    }
+
+    if (ok && options.startup)
+    {
+        CarlaPipeZygote zygote;
+
+        ok = zygote.startZygote(self, true);
+
+        for (const uint64_t timeout(getNanosecondCounter() + 10000000000ULL); ok && ! zygote.isZygoteReady();)
+        {
+            if (getNanosecondCounter() > timeout)
+                ok = false;
+            else
+                carla_msleep(1);
+        }
+
+        ok = ok && runStartup(self, &zygote, starts, "startup-shared", results[resultCount++]);
+
+        if (! ok)
+            carla_stderr2("pipe-bench: failed to start a client in the shared zygote");
+
+        zygote.stopZygote(5000);
+    }
+
+    printResults(out, results, resultCount, options.csv);
+    return (ok && checksOk) ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    // started by ourselves as the client
+    if (argc >= 7 && std::strcmp(argv[1], "client") == 0)
+        return runClient(argv, argv[2]);
+
+    // started by the LV2 UI of the port_event test, through the "modgui-x11" link in its bundle
+    if (argc >= 7 && std::strcmp(getPathBasename(argv[0]), "modgui-x11") == 0)
+        return runClient(argv, "bs", true);
+
+    // started by ourselves as the zygote of the startup test
+    if (argc >= 3 && std::strcmp(argv[1], "--zygote") == 0)
+        return runZygote(std::atoi(argv[2]));
+    if (argc >= 3 && std::strcmp(argv[1], "--shared") == 0)
+        return runShared(std::atoi(argv[2]));
+
+    BenchOptions options;
+    options.csv   = false;
+    options.check = false;
+    options.startup = true;
+    options.scale = 1.0;
+    options.uiLibrary = nullptr;
+    options.transportCount = 0;
+
+    const char* output = nullptr;
+
+    for (int i=1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            options.csv = true;
+        else if (std::strcmp(argv[i], "--json") == 0)
+            options.csv = false;
+        else if (std::strcmp(argv[i], "--check") == 0)
+            options.check = true;
+        else if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+            options.scale = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (std::strcmp(argv[i], "--ui") == 0 && i + 1 < argc)
+            options.uiLibrary = argv[++i];
+        else if (std::strcmp(argv[i], "--transport") == 0 && i + 1 < argc && options.transportCount < kMaxBenchTransports)
+            options.transports[options.transportCount++] = argv[++i];
+        else if (std::strcmp(argv[i], "--no-startup") == 0)
+            options.startup = false;
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--json|--csv] [--check] [--scale <factor>] [--output <file>] [--ui <library>]"
+                                 " [--transport <name>]... [--no-startup]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    CARLA_SAFE_ASSERT_RETURN(options.scale > 0.0, 1);
+
+    FILE* const out((output != nullptr) ? std::fopen(output, "w") : stdout);
+
+    if (out == nullptr)
+    {
+        carla_stderr2("pipe-bench: cannot write to '%s'", output);
+        return 1;
+    }
+
+    // the client is this same binary
+    char self[PATH_MAX];
+    const ssize_t selfLen(readlink("/proc/self/exe", self, PATH_MAX - 1));
+
+    if (selfLen > 0)
+        self[selfLen] = '\0';
+
+    const int ret(runServer((selfLen > 0) ? self : argv[0], out, options));
+
+    if (out != stdout)
+        std::fclose(out);
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------